@@ -0,0 +1,31 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "shell.h"
+
+using namespace shell;
+
+namespace {
+   // Arg: 1 to serve the stages from inside the shell, 0 to start the coreutils.
+   void builtin_pipeline( benchmark::State& st, const char* line ) {
+      shell_state state;
+
+      parse_command( line, state );
+      RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+      run_commands->builtins = st.range( 0 );
+
+      for ( auto _ : st )
+         run_commands->execute();
+   }
+
+   BENCHMARK_CAPTURE( builtin_pipeline, true, "true" )
+      ->Arg( 0 )->Arg( 1 )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+
+   BENCHMARK_CAPTURE( builtin_pipeline, echo_head_wc, "echo hello | head -n 1 | wc -l > /dev/null" )
+      ->Arg( 0 )->Arg( 1 )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+}
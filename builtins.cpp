@@ -0,0 +1,487 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <string>
+
+#include "builtins.h"
+#include "transfer.h"
+
+namespace shell
+{
+   namespace
+   {
+      const size_t chunk_size = 64 * 1024;
+
+      // Buffered writes to a stage's output. Once the reader has gone away nothing more is written.
+      class output
+      {
+      private:
+         int fd;
+         char buffer[ chunk_size ];
+         size_t used = 0;
+         int error = 0;
+      public:
+         output( int fd ) noexcept : fd( fd ) { }
+         ~output() noexcept { flush(); }
+
+         void put( const char* data, size_t size ) noexcept
+         {
+            if ( used + size > sizeof( buffer ) ) {
+               flush();
+               if ( size > sizeof( buffer ) ) {
+                  write_all( data, size );
+                  return;
+               }
+            }
+            memcpy( buffer + used, data, size );
+            used += size;
+         }
+
+         void put( std::string_view text ) noexcept
+         {
+            put( text.data(), text.size() );
+         }
+
+         void flush() noexcept
+         {
+            write_all( buffer, used );
+            used = 0;
+         }
+
+         // 0 when everything got out, otherwise what the tool would have exited with.
+         int status() noexcept
+         {
+            flush();
+            if ( error == EPIPE )
+               return SIGPIPE;
+            return error ? W_EXITCODE( 1, 0 ) : 0;
+         }
+      private:
+         void write_all( const char* data, size_t size ) noexcept
+         {
+            ssize_t written;
+
+            while ( size > 0 && error == 0 ) {
+               if ( ( written = write( fd, data, size ) ) < 0 ) {
+                  if ( errno != EINTR )
+                     error = errno;
+                  continue;
+               }
+               data += written;
+               size -= written;
+            }
+         }
+      };
+
+      void complain( const char* tool, std::string_view what, int error ) noexcept
+      {
+         std::string message( tool );
+
+         message.append( ": " ).append( what ).append( ": " ).append( strerror( error ) ).append( "\n" );
+         write( STDERR_FILENO, message.data(), message.size() );
+      }
+
+      ssize_t read_some( int fd, char* buffer, size_t size ) noexcept
+      {
+         ssize_t n;
+
+         while ( ( n = read( fd, buffer, size ) ) < 0 && errno == EINTR )
+            ;
+         return n;
+      }
+
+      bool parse_count( const char* text, unsigned long long& count ) noexcept
+      {
+         char* end;
+
+         if ( text == nullptr || *text < '0' || *text > '9' )
+            return false;
+         errno = 0;
+         count = strtoull( text, &end, 10 );
+         return *end == '\0' && errno == 0;
+      }
+
+      bool is_help( char** argv ) noexcept
+      {
+         return argv[1] && !argv[2] && ( strcmp( argv[1], "--help" ) == 0 || strcmp( argv[1], "--version" ) == 0 );
+      }
+
+      // Opens a file operand, or hands out in_fd for none or "-". -1 after complaining.
+      int open_input( const char* tool, const char* file, int in_fd ) noexcept
+      {
+         int fd;
+
+         if ( file == nullptr || strcmp( file, "-" ) == 0 )
+            return in_fd;
+         if ( ( fd = open( file, O_RDONLY | O_CLOEXEC ) ) < 0 ) {
+            if ( strcmp( tool, "cat" ) == 0 || strcmp( tool, "wc" ) == 0 )
+               complain( tool, file, errno );
+            else
+               complain( tool, std::string( "cannot open '" ) + file + "' for reading", errno );
+         }
+         return fd;
+      }
+
+      void close_input( int fd, int in_fd ) noexcept
+      {
+         if ( fd >= 0 && fd != in_fd )
+            close( fd );
+      }
+
+      // true
+
+      bool true_accepts( char** argv ) noexcept
+      {
+         return !is_help( argv );
+      }
+
+      int true_run( char**, int, int ) noexcept
+      {
+         return 0;
+      }
+
+      // echo [-nE] [text...], without the backslash escapes of -e.
+
+      bool echo_options( char** argv, int& first, bool& newline ) noexcept
+      {
+         newline = true;
+         for ( first = 1; argv[ first ] && argv[ first ][0] == '-' && argv[ first ][1] != '\0'; ++first ) {
+            const char* flags = argv[ first ] + 1;
+            if ( strspn( flags, "neE" ) != strlen( flags ) )
+               break;                                       // Not an option after all, it gets printed.
+            if ( strchr( flags, 'e' ) )
+               return false;
+            if ( strchr( flags, 'n' ) )
+               newline = false;
+         }
+         return true;
+      }
+
+      bool echo_accepts( char** argv ) noexcept
+      {
+         int first;
+         bool newline;
+
+         return !is_help( argv ) && echo_options( argv, first, newline );
+      }
+
+      int echo_run( char** argv, int, int out_fd ) noexcept
+      {
+         output out( out_fd );
+         int first;
+         bool newline;
+
+         echo_options( argv, first, newline );
+         for ( int i = first; argv[i]; ++i ) {
+            if ( i > first )
+               out.put( " ", 1 );
+            out.put( argv[i] );
+         }
+         if ( newline )
+            out.put( "\n", 1 );
+
+         return out.status();
+      }
+
+      // cat [file...], no options.
+
+      bool cat_accepts( char** argv ) noexcept
+      {
+         for ( int i = 1; argv[i]; ++i ) {
+            if ( argv[i][0] == '-' && argv[i][1] != '\0' )
+               return false;
+         }
+         return true;
+      }
+
+      int cat_run( char** argv, int in_fd, int out_fd ) noexcept
+      {
+         static const char* const standard_input[] = { "-", nullptr };
+         const char* const* files = argv[1] ? argv + 1 : standard_input;
+         int status = 0, fd;
+
+         for ( ; *files; ++files ) {
+            if ( ( fd = open_input( "cat", *files, in_fd ) ) < 0 ) {
+               status = W_EXITCODE( 1, 0 );
+               continue;
+            }
+            if ( !transfer( fd, out_fd ) ) {
+               if ( errno == EPIPE ) {
+                  close_input( fd, in_fd );
+                  return SIGPIPE;
+               }
+               complain( "cat", *files, errno );
+               status = W_EXITCODE( 1, 0 );
+            }
+            close_input( fd, in_fd );
+         }
+
+         return status;
+      }
+
+      // head and tail: [-n N | -c N | -N] [file]
+
+      struct range
+      {
+         bool bytes = false;
+         unsigned long long count = 10;
+         const char* file = nullptr;
+      };
+
+      bool parse_range( char** argv, range& r ) noexcept
+      {
+         for ( int i = 1; argv[i]; ++i ) {
+            const char* arg = argv[i];
+            if ( arg[0] != '-' || arg[1] == '\0' ) {
+               if ( r.file )
+                  return false;                             // Several files get headers, leave that to the real thing.
+               r.file = arg;
+            }
+            else if ( arg[1] == 'n' || arg[1] == 'c' ) {
+               r.bytes = arg[1] == 'c';
+               if ( !parse_count( arg[2] ? arg + 2 : argv[ ++i ], r.count ) )
+                  return false;
+            }
+            else if ( i != 1 || !parse_count( arg + 1, r.count ) ) {
+               return false;                                // -N is only an option in front.
+            }
+         }
+         return true;
+      }
+
+      bool range_accepts( char** argv ) noexcept
+      {
+         range r;
+
+         return parse_range( argv, r );
+      }
+
+      int head_run( char** argv, int in_fd, int out_fd ) noexcept
+      {
+         output out( out_fd );
+         char buffer[ chunk_size ];
+         unsigned long long left;
+         ssize_t n;
+         size_t take;
+         range r;
+         int fd;
+
+         parse_range( argv, r );
+         if ( ( fd = open_input( "head", r.file, in_fd ) ) < 0 )
+            return W_EXITCODE( 1, 0 );
+
+         for ( left = r.count; left > 0 && ( n = read_some( fd, buffer, sizeof( buffer ) ) ) > 0; ) {
+            if ( r.bytes ) {
+               take = std::min< unsigned long long >( n, left );
+               left -= take;
+            }
+            else {
+               for ( take = 0; take < size_t( n ) && left > 0; left-- ) {
+                  const char* newline = static_cast< const char* >( memchr( buffer + take, '\n', n - take ) );
+                  if ( newline == nullptr ) {
+                     take = n;
+                     break;
+                  }
+                  take = newline - buffer + 1;
+               }
+            }
+            out.put( buffer, take );
+            if ( take < size_t( n ) )
+               lseek( fd, take - n, SEEK_CUR );            // Like head(1), leave the rest of seekable input to whoever reads next.
+         }
+
+         close_input( fd, in_fd );
+         return out.status();
+      }
+
+      // Where the last `count` lines of text start. An unfinished last line counts as a line.
+      size_t last_lines( std::string_view text, unsigned long long count ) noexcept
+      {
+         size_t end = text.size();
+
+         if ( count == 0 )
+            return end;
+         if ( end > 0 && text[ end - 1 ] == '\n' )
+            end--;
+         for ( size_t i = end; i > 0; --i ) {
+            if ( text[ i - 1 ] == '\n' && --count == 0 )
+               return i;
+         }
+         return 0;
+      }
+
+      int tail_run( char** argv, int in_fd, int out_fd ) noexcept
+      {
+         output out( out_fd );
+         std::string kept;                                  // At least the last `count` lines or bytes.
+         char buffer[ chunk_size ];
+         ssize_t n;
+         range r;
+         int fd;
+
+         parse_range( argv, r );
+         if ( ( fd = open_input( "tail", r.file, in_fd ) ) < 0 )
+            return W_EXITCODE( 1, 0 );
+
+         while ( ( n = read_some( fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+            kept.append( buffer, n );
+            if ( kept.size() < 16 * chunk_size )
+               continue;
+            kept.erase( 0, r.bytes                          // Trimmed now and then, so a long input doesn't pile up.
+               ? kept.size() - std::min< unsigned long long >( kept.size(), r.count )
+               : last_lines( kept, r.count ) );
+         }
+
+         close_input( fd, in_fd );
+         if ( r.bytes )
+            out.put( std::string_view( kept ).substr( kept.size() - std::min< unsigned long long >( kept.size(), r.count ) ) );
+         else
+            out.put( std::string_view( kept ).substr( last_lines( kept, r.count ) ) );
+
+         return out.status();
+      }
+
+      // wc [-lwc] [file]
+
+      struct counts
+      {
+         bool lines = false, words = false, bytes = false;
+         const char* file = nullptr;
+      };
+
+      // What a word is depends on the locale; we only know the C one.
+      bool c_locale() noexcept
+      {
+         for ( const char* name : { "LC_ALL", "LC_CTYPE", "LANG" } ) {
+            const char* value = getenv( name );
+            if ( value && *value )
+               return strcmp( value, "C" ) == 0 || strcmp( value, "POSIX" ) == 0;
+         }
+         return true;
+      }
+
+      bool parse_counts( char** argv, counts& c ) noexcept
+      {
+         for ( int i = 1; argv[i]; ++i ) {
+            const char* arg = argv[i];
+            if ( arg[0] != '-' ) {
+               if ( c.file )
+                  return false;                             // Several files get a total line.
+               c.file = arg;
+               continue;
+            }
+            if ( arg[1] == '\0' || strspn( arg + 1, "lwc" ) != strlen( arg + 1 ) )
+               return false;
+            c.lines |= strchr( arg + 1, 'l' ) != nullptr;
+            c.words |= strchr( arg + 1, 'w' ) != nullptr;
+            c.bytes |= strchr( arg + 1, 'c' ) != nullptr;
+         }
+         if ( !c.lines && !c.words && !c.bytes )
+            c.lines = c.words = c.bytes = true;
+         return true;
+      }
+
+      bool wc_accepts( char** argv ) noexcept
+      {
+         counts c;
+
+         return parse_counts( argv, c ) && ( !c.words || c_locale() );
+      }
+
+      // The column width wc(1) picks: just the number for a single count, otherwise wide enough for the
+      // size of a regular file, and at least 7 for anything else.
+      int count_width( const counts& c, int fd ) noexcept
+      {
+         struct stat st;
+         int width = 1;
+
+         if ( c.lines + c.words + c.bytes == 1 || fstat( fd, &st ) < 0 )
+            return 1;
+         if ( !S_ISREG( st.st_mode ) )
+            return 7;
+         for ( off_t size = st.st_size; size >= 10; size /= 10 )
+            width++;
+         return width;
+      }
+
+      int wc_run( char** argv, int in_fd, int out_fd ) noexcept
+      {
+         output out( out_fd );
+         char buffer[ chunk_size ];
+         unsigned long long lines = 0, words = 0, bytes = 0;
+         bool in_word = false;
+         std::string line;
+         ssize_t n;
+         counts c;
+         int fd, width, status = 0;
+
+         parse_counts( argv, c );
+         if ( ( fd = open_input( "wc", c.file, in_fd ) ) < 0 )
+            return W_EXITCODE( 1, 0 );
+         width = count_width( c, fd );
+
+         while ( ( n = read_some( fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+            bytes += n;
+            for ( ssize_t i = 0; i < n; ++i ) {
+               unsigned char ch = buffer[i];
+               if ( ch == '\n' ) {
+                  lines++;
+                  in_word = false;
+               }
+               else if ( ch == ' ' || ( ch >= '\t' && ch <= '\r' ) ) {
+                  in_word = false;
+               }
+               else if ( ch > ' ' && ch < 0x7f && !in_word ) {  // Only printable characters start a word.
+                  words++;
+                  in_word = true;
+               }
+            }
+         }
+         if ( n < 0 ) {
+            complain( "wc", c.file ? c.file : "standard input", errno );
+            status = W_EXITCODE( 1, 0 );
+         }
+         close_input( fd, in_fd );
+
+         for ( auto [ wanted, count ] : { std::pair( c.lines, lines ), std::pair( c.words, words ), std::pair( c.bytes, bytes ) } ) {
+            if ( !wanted )
+               continue;
+            std::string number = std::to_string( count );
+            if ( !line.empty() )
+               line += ' ';
+            line.append( std::max< int >( 0, width - number.size() ), ' ' ).append( number );
+         }
+         if ( c.file )
+            line.append( " " ).append( c.file );
+         line += '\n';
+         out.put( line );
+
+         return status ? status : out.status();
+      }
+
+      const builtin builtins[] = {
+         { "cat", true, cat_accepts, cat_run },
+         { "echo", false, echo_accepts, echo_run },
+         { "head", true, range_accepts, head_run },
+         { "tail", true, range_accepts, tail_run },
+         { "true", false, true_accepts, true_run },
+         { "wc", true, wc_accepts, wc_run },
+      };
+   }
+
+   const builtin* find_builtin( std::string_view name ) noexcept
+   {
+      for ( const builtin& b : builtins ) {
+         if ( name == b.name )
+            return &b;
+      }
+      return nullptr;
+   }
+}
@@ -0,0 +1,24 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <string_view>
+
+namespace shell
+{
+   // Small coreutils the shell serves itself instead of starting a process: echo, cat, head, tail, wc and true.
+   //
+   // run() takes argv like main() and the fds of its stage, and returns a wait status as if it had been a
+   // process: a reader that went away gives SIGPIPE. accepts() is asked once, when the pipeline is planned;
+   // anything it doesn't know (options, several files, a locale that changes what a word is) is left to
+   // the real tool, so the output is always the same.
+   struct builtin
+   {
+      const char* name;
+      bool reads_input;                                    // Reads stdin when it has no file operands.
+      bool (*accepts)( char** argv ) noexcept;
+      int (*run)( char** argv, int in_fd, int out_fd ) noexcept;
+   };
+
+   const builtin* find_builtin( std::string_view name ) noexcept;
+}
+#endif
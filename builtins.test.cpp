@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "builtins.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   struct outcome
+   {
+      std::string out, err;
+      int status;
+   };
+
+   outcome run_builtin( std::vector< const char* > args, const std::string& input, bool piped );
+   outcome run_external( std::vector< const char* > args, const std::string& input, bool piped );
+   bool accepts( std::vector< const char* > args );
+
+   const std::vector< std::string > inputs = {
+      "",
+      "one line\n",
+      "a\nb\nc\nd\ne\nf\ng\nh\ni\nj\nk\nl\n",
+      "no newline at the end",
+      "  leading   and\ttrailing  \n\n\nblank\x01lines \xc3\xa9 \n",
+   };
+
+   TEST( Builtins, MatchTheExternalTools ) {
+      const std::vector< std::vector< const char* > > supported = {
+         { "true" }, { "true", "ignored" },
+         { "echo" }, { "echo", "a", "b" }, { "echo", "-n", "a" }, { "echo", "-nE", "a\\nb" }, { "echo", "-", "-x" },
+         { "cat" }, { "cat", "-" },
+         { "head" }, { "head", "-n", "2" }, { "head", "-n3" }, { "head", "-4" }, { "head", "-c", "5" }, { "head", "-n", "0" },
+         { "tail" }, { "tail", "-n", "2" }, { "tail", "-n3" }, { "tail", "-4" }, { "tail", "-c", "5" }, { "tail", "-n", "0" },
+         { "wc" }, { "wc", "-l" }, { "wc", "-w" }, { "wc", "-c" }, { "wc", "-lw" }, { "wc", "-c", "-l" },
+      };
+
+      setenv( "LC_ALL", "C", 1 );                           // Words are only the builtin's business in the C locale.
+      for ( const auto& args : supported ) {
+         EXPECT_TRUE( accepts( args ) ) << args[0] << " " << ( args.size() > 1 ? args[1] : "" );
+         for ( const std::string& input : inputs ) {
+            for ( bool piped : { false, true } ) {
+               SCOPED_TRACE( std::string( args[0] ) + " " + ( args.size() > 1 ? args[1] : "" ) + ( piped ? " from a pipe: " : " from a file: " ) + input );
+               outcome expected = run_external( args, input, piped ), actual = run_builtin( args, input, piped );
+               EXPECT_EQ( expected.out, actual.out );
+               EXPECT_EQ( expected.status, actual.status );
+            }
+         }
+      }
+      unsetenv( "LC_ALL" );
+   }
+
+   TEST( Builtins, FileOperands ) {
+      const std::vector< std::vector< const char* > > supported = {
+         { "cat", "../test-dir/1" }, { "cat", "../test-dir/1", "-", "../test-dir/2" }, { "cat", "file-that-doesnt-exist" },
+         { "head", "-n", "2", "../test-dir/1" }, { "head", "file-that-doesnt-exist" },
+         { "tail", "-n", "2", "../test-dir/1" }, { "tail", "file-that-doesnt-exist" },
+         { "wc", "../test-dir/1" }, { "wc", "-l", "../test-dir/1" }, { "wc", "file-that-doesnt-exist" },
+      };
+
+      setenv( "LC_ALL", "C", 1 );
+      for ( const auto& args : supported ) {
+         SCOPED_TRACE( std::string( args[0] ) + " " + args[1] );
+         EXPECT_TRUE( accepts( args ) );
+         outcome expected = run_external( args, "from stdin\n", false ), actual = run_builtin( args, "from stdin\n", false );
+         EXPECT_EQ( expected.out, actual.out );
+         EXPECT_EQ( expected.err, actual.err );
+         EXPECT_EQ( expected.status, actual.status );
+      }
+      unsetenv( "LC_ALL" );
+   }
+
+   TEST( Builtins, LeaveTheRestToTheRealTools ) {
+      EXPECT_EQ( nullptr, find_builtin( "sort" ) );
+      EXPECT_FALSE( accepts( { "echo", "-e", "a\\nb" } ) );
+      EXPECT_FALSE( accepts( { "echo", "--help" } ) );
+      EXPECT_FALSE( accepts( { "cat", "-n" } ) );
+      EXPECT_FALSE( accepts( { "head", "-n", "-2" } ) );
+      EXPECT_FALSE( accepts( { "head", "a", "b" } ) );
+      EXPECT_FALSE( accepts( { "tail", "-f" } ) );
+      EXPECT_FALSE( accepts( { "tail", "-n", "+2" } ) );
+      EXPECT_FALSE( accepts( { "wc", "-m" } ) );
+
+      setenv( "LC_ALL", "en_US.UTF-8", 1 );
+      EXPECT_FALSE( accepts( { "wc", "-w" } ) );
+      EXPECT_TRUE( accepts( { "wc", "-l" } ) );
+      unsetenv( "LC_ALL" );
+   }
+
+   TEST( Builtins, StopWhenTheReaderGoesAway ) {
+      std::vector< char* > argv = { const_cast< char* >( "cat" ), nullptr };
+      std::string big( 1 << 20, 'x' );
+      int in = memfd_create( "input", MFD_CLOEXEC ), out[2];
+      sigset_t sigpipe;
+
+      write( in, big.data(), big.size() );
+      lseek( in, 0, SEEK_SET );
+      pipe2( out, O_CLOEXEC );
+      close( out[0] );
+
+      sigemptyset( &sigpipe );                              // As the shell does for its stages.
+      sigaddset( &sigpipe, SIGPIPE );
+      pthread_sigmask( SIG_BLOCK, &sigpipe, NULL );
+      EXPECT_EQ( SIGPIPE, find_builtin( "cat" )->run( argv.data(), in, out[1] ) );
+      argv[0] = const_cast< char* >( "echo" );
+      EXPECT_EQ( SIGPIPE, find_builtin( "echo" )->run( argv.data(), in, out[1] ) );
+      struct timespec poll = { 0, 0 };
+      while ( sigtimedwait( &sigpipe, NULL, &poll ) == SIGPIPE )
+         ;
+      pthread_sigmask( SIG_UNBLOCK, &sigpipe, NULL );
+
+      close( in );
+      close( out[1] );
+   }
+
+   //////////////// HELPERS
+
+   std::string read_all( int fd ) {
+      std::string text;
+      char buffer[ 4096 ];
+      ssize_t n;
+
+      lseek( fd, 0, SEEK_SET );
+      while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+         text.append( buffer, n );
+
+      return text;
+   }
+
+   int input_fd( const std::string& input, bool piped ) {
+      int fds[2];
+
+      if ( !piped ) {
+         fds[0] = memfd_create( "input", MFD_CLOEXEC );
+         write( fds[0], input.data(), input.size() );
+         lseek( fds[0], 0, SEEK_SET );
+         return fds[0];
+      }
+
+      pipe2( fds, O_CLOEXEC );                              // Small enough to fit in the pipe.
+      write( fds[1], input.data(), input.size() );
+      close( fds[1] );
+      return fds[0];
+   }
+
+   std::vector< char* > argv_of( std::vector< const char* > args ) {
+      std::vector< char* > argv;
+
+      for ( const char* arg : args )
+         argv.push_back( const_cast< char* >( arg ) );
+      argv.push_back( nullptr );
+
+      return argv;
+   }
+
+   bool accepts( std::vector< const char* > args ) {
+      const builtin* tool = find_builtin( args[0] );
+
+      return tool && tool->accepts( argv_of( args ).data() );
+   }
+
+   outcome run_builtin( std::vector< const char* > args, const std::string& input, bool piped ) {
+      int in = input_fd( input, piped ), out = memfd_create( "out", MFD_CLOEXEC ), err = memfd_create( "err", MFD_CLOEXEC );
+      int saved_err = dup( STDERR_FILENO );
+      outcome result;
+
+      dup2( err, STDERR_FILENO );                           // Builtins complain straight to fd 2.
+      result.status = find_builtin( args[0] )->run( argv_of( args ).data(), in, out );
+      dup2( saved_err, STDERR_FILENO );
+      close( saved_err );
+
+      result.out = read_all( out );
+      result.err = read_all( err );
+      close( in );
+      close( out );
+      close( err );
+      return result;
+   }
+
+   outcome run_external( std::vector< const char* > args, const std::string& input, bool piped ) {
+      int in = input_fd( input, piped ), out = memfd_create( "out", MFD_CLOEXEC ), err = memfd_create( "err", MFD_CLOEXEC );
+      posix_spawn_file_actions_t actions;
+      outcome result;
+      pid_t pid;
+
+      posix_spawn_file_actions_init( &actions );
+      posix_spawn_file_actions_adddup2( &actions, in, STDIN_FILENO );
+      posix_spawn_file_actions_adddup2( &actions, out, STDOUT_FILENO );
+      posix_spawn_file_actions_adddup2( &actions, err, STDERR_FILENO );
+      if ( posix_spawnp( &pid, args[0], &actions, NULL, argv_of( args ).data(), environ ) == 0 )
+         waitpid( pid, &result.status, 0 );
+      posix_spawn_file_actions_destroy( &actions );
+
+      result.out = read_all( out );
+      result.err = read_all( err );
+      close( in );
+      close( out );
+      close( err );
+      return result;
+   }
+}
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+
+#include "server.h"
+
+namespace shell
+{
+   static int connect_to( const char* path ) noexcept
+   {
+      struct sockaddr_un address = {};
+      int fd;
+
+      if ( strlen( path ) >= sizeof( address.sun_path ) ) {
+         errno = ENAMETOOLONG;
+         return -1;
+      }
+      address.sun_family = AF_UNIX;
+      strcpy( address.sun_path, path );
+
+      if ( ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) < 0 )
+         return -1;
+      if ( connect( fd, reinterpret_cast< struct sockaddr* >( &address ), sizeof( address ) ) < 0 ) {
+         close( fd );
+         return -1;
+      }
+
+      return fd;
+   }
+
+   // The fds go with the first byte of the request; a closed one is sent as /dev/null.
+   static bool send_request( int fd, const std::string& text ) noexcept
+   {
+      int fds[3], null = -1;
+      char control[ CMSG_SPACE( sizeof( fds ) ) ] = {};
+      struct iovec data = { const_cast< char* >( text.data() ), text.size() };
+      struct msghdr message = {};
+      struct cmsghdr* header;
+      ssize_t sent;
+
+      for ( int i = 0; i < 3; ++i ) {
+         if ( fcntl( i, F_GETFD ) < 0 ) {
+            if ( null < 0 )
+               null = open( "/dev/null", O_RDWR | O_CLOEXEC );
+            fds[i] = null;
+         }
+         else {
+            fds[i] = i;
+         }
+      }
+
+      message.msg_iov = &data;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof( control );
+      header = CMSG_FIRSTHDR( &message );
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN( sizeof( fds ) );
+      memcpy( CMSG_DATA( header ), fds, sizeof( fds ) );
+
+      while ( ( sent = sendmsg( fd, &message, MSG_NOSIGNAL ) ) < 0 && errno == EINTR )
+         ;
+      if ( null >= 0 )
+         close( null );
+      if ( sent < 0 )
+         return false;
+
+      for ( size_t at = sent; at < text.size(); at += sent ) {
+         if ( ( sent = send( fd, text.data() + at, text.size() - at, MSG_NOSIGNAL ) ) < 0 ) {
+            if ( errno != EINTR )
+               return false;
+            sent = 0;
+         }
+      }
+
+      return shutdown( fd, SHUT_WR ) == 0;
+   }
+
+   bool request( const char* path, std::string_view lines, int& status ) noexcept
+   {
+      char cwd[ PATH_MAX ];
+      std::string text;
+      int fd, answer;
+      size_t received = 0;
+      ssize_t n;
+
+      if ( getcwd( cwd, sizeof( cwd ) ) == NULL || ( fd = connect_to( path ) ) < 0 )
+         return false;
+
+      text.reserve( strlen( cwd ) + lines.size() + 2 );
+      text.append( cwd );
+      text += '\0';
+      text.append( lines );
+      if ( text.back() != '\n' )
+         text += '\n';
+
+      if ( !send_request( fd, text ) ) {
+         close( fd );
+         return false;
+      }
+
+      while ( received < sizeof( answer ) ) {
+         n = read( fd, reinterpret_cast< char* >( &answer ) + received, sizeof( answer ) - received );
+         if ( n < 0 && errno == EINTR )
+            continue;
+         if ( n <= 0 )
+            break;
+         received += n;
+      }
+      close( fd );
+
+      if ( received < sizeof( answer ) ) {
+         errno = ECONNRESET;                                // The server's child died without an answer.
+         return false;
+      }
+      status = answer;
+      return true;
+   }
+}
@@ -0,0 +1,151 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <iomanip>
+
+#include "command_hash.h"
+
+namespace shell
+{
+   CommandHash& command_hash() noexcept
+   {
+      static CommandHash table;
+      return table;
+   }
+
+   // Walks $PATH the same way execvp(3) would, but with stat(2) instead of failed execve(2) calls.
+   std::string CommandHash::search( std::string_view name ) noexcept
+   {
+      struct stat st;
+      std::string candidate;
+
+      for ( const path_directory& dir : directories ) {
+         candidate = dir.name;                              // An empty $PATH entry means the current directory.
+         if ( !candidate.empty() )
+            candidate += '/';
+         candidate += name;
+         if ( stat( candidate.c_str(), &st ) == 0 && S_ISREG( st.st_mode ) && access( candidate.c_str(), X_OK ) == 0 )
+            return candidate;
+      }
+
+      return "";
+   }
+
+   bool CommandHash::directories_changed() noexcept
+   {
+      const char* path = getenv( "PATH" );
+      struct stat st;
+
+      if ( path_variable != ( path ? path : "/bin:/usr/bin" ) )
+         return true;
+
+      for ( const path_directory& dir : directories ) {
+         if ( stat( dir.name.empty() ? "." : dir.name.c_str(), &st ) != 0 ) {
+            if ( dir.mtime.tv_sec != 0 || dir.mtime.tv_nsec != 0 )
+               return true;                                 // Directory disappeared.
+         }
+         else if ( st.st_mtim.tv_sec != dir.mtime.tv_sec || st.st_mtim.tv_nsec != dir.mtime.tv_nsec ) {
+            return true;                                    // Something was added to or removed from the directory.
+         }
+      }
+
+      return false;
+   }
+
+   void CommandHash::snapshot_directories() noexcept
+   {
+      const char* path = getenv( "PATH" );
+      std::string::size_type begin = 0, end;
+      struct stat st;
+
+      path_variable = path ? path : "/bin:/usr/bin";        // execvp's default when $PATH is unset.
+      directories.clear();
+      has_relative_directories = false;
+
+      do {
+         end = path_variable.find( ':', begin );
+         path_directory dir;
+         dir.name = path_variable.substr( begin, end == std::string::npos ? std::string::npos : end - begin );
+         dir.mtime = {};
+         if ( stat( dir.name.empty() ? "." : dir.name.c_str(), &st ) == 0 )
+            dir.mtime = st.st_mtim;
+         if ( dir.name.empty() || dir.name[0] != '/' )
+            has_relative_directories = true;
+         directories.push_back( dir );
+         begin = end + 1;
+      } while ( end != std::string::npos );
+   }
+
+   void CommandHash::validate() noexcept
+   {
+      if ( directories.empty() || directories_changed() )
+         rehash();
+   }
+
+   // Returns the path to execute for a command name, or nullptr when it can't be found.
+   const char* CommandHash::lookup( std::string_view name ) noexcept
+   {
+      if ( name.find( '/' ) != std::string::npos ) {
+         explicit_path = name;                              // Explicit paths are never searched for.
+         return explicit_path.c_str();
+      }
+
+      if ( directories.empty() )
+         snapshot_directories();
+
+      auto found = entries.find( std::string( name ) );
+      if ( found != entries.end() ) {
+         found->second.hits++;
+         return found->second.path.empty() ? nullptr : found->second.path.c_str();
+      }
+
+      entry resolved;
+      resolved.path = search( name );
+      resolved.hits = 1;
+
+      if ( has_relative_directories ) {                     // The answer depends on the current directory, so don't keep it.
+         uncached_path = resolved.path;
+         return uncached_path.empty() ? nullptr : uncached_path.c_str();
+      }
+
+      entry& stored = entries[ std::string( name ) ] = resolved;
+      return stored.path.empty() ? nullptr : stored.path.c_str();
+   }
+
+   // Looks a command up without running it, as `hash name` does.
+   bool CommandHash::remember( std::string_view name ) noexcept
+   {
+      const char* path = lookup( name );
+      auto found = entries.find( std::string( name ) );
+
+      if ( found != entries.end() )
+         found->second.hits = 0;
+
+      return path != nullptr;
+   }
+
+   void CommandHash::rehash() noexcept
+   {
+      entries.clear();
+      snapshot_directories();
+      rehashes++;
+   }
+
+   void CommandHash::print( std::ostream& out ) const noexcept
+   {
+      bool empty = true;
+
+      for ( const auto& e : entries ) {
+         if ( e.second.path.empty() )
+            continue;                                       // Misses are an implementation detail.
+         if ( empty )
+            out << "hits\tcommand\n";
+         out << std::setw( 4 ) << e.second.hits << "\t" << e.second.path << "\n";
+         empty = false;
+      }
+
+      if ( empty )
+         out << "hash: hash table empty\n";
+   }
+}
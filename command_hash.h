@@ -0,0 +1,51 @@
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include <sys/stat.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace shell
+{
+   // Remembers where commands live on $PATH (and which ones don't exist), like bash's `hash`.
+   // The table is dropped as soon as $PATH changes or one of its directories is modified.
+   class CommandHash
+   {
+   private:
+      struct entry
+      {
+         std::string path;                                  // Empty for a remembered miss.
+         int hits = 0;
+      };
+      struct path_directory
+      {
+         std::string name;
+         struct timespec mtime;
+      };
+      std::unordered_map< std::string, entry > entries;
+      std::vector< path_directory > directories;
+      std::string path_variable;
+      std::string explicit_path, uncached_path;
+      bool has_relative_directories = false;
+      unsigned rehashes = 0;
+      std::string search( std::string_view name ) noexcept;
+      bool directories_changed() noexcept;
+      void snapshot_directories() noexcept;
+   public:
+      void validate() noexcept;
+      const char* lookup( std::string_view name ) noexcept;
+      bool remember( std::string_view name ) noexcept;
+      void rehash() noexcept;
+      void print( std::ostream& out ) const noexcept;
+      // Changes whenever answers handed out earlier may have gone stale.
+      unsigned generation() const noexcept { return rehashes; }
+      bool depends_on_cwd() const noexcept { return has_relative_directories; }
+   };
+
+   CommandHash& command_hash() noexcept;
+}
+#endif
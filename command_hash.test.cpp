@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <sstream>
+
+#include "command_hash.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   std::string make_scratch_directory();
+   void make_executable( std::string path );
+
+   TEST( CommandHash, LookupFindsCommandsOnPath ) {
+      CommandHash hash;
+      const char* path = hash.lookup( "ls" );
+
+      ASSERT_NE( nullptr, path );
+      EXPECT_EQ( '/', path[0] );
+      EXPECT_EQ( 0, access( path, X_OK ) );
+   }
+
+   TEST( CommandHash, ExplicitPathsAreNotSearched ) {
+      CommandHash hash;
+
+      EXPECT_STREQ( "./foo", hash.lookup( "./foo" ) );
+   }
+
+   TEST( CommandHash, RemembersHitsAndMisses ) {
+      CommandHash hash;
+      std::ostringstream out;
+
+      EXPECT_EQ( nullptr, hash.lookup( "program-that-doesnt-exist" ) );
+      EXPECT_EQ( nullptr, hash.lookup( "program-that-doesnt-exist" ) );
+      hash.lookup( "ls" );
+      hash.lookup( "ls" );
+
+      hash.print( out );
+      EXPECT_NE( std::string::npos, out.str().find( "   2\t" ) );
+      EXPECT_EQ( std::string::npos, out.str().find( "program-that-doesnt-exist" ) );
+
+      hash.rehash();
+      out.str( "" );
+      hash.print( out );
+      EXPECT_EQ( "hash: hash table empty\n", out.str() );
+   }
+
+   TEST( CommandHash, InvalidatedWhenPathDirectoryChanges ) {
+      std::string dir = make_scratch_directory();
+      std::string old_path = getenv( "PATH" );
+      CommandHash hash;
+
+      setenv( "PATH", dir.c_str(), 1 );
+      hash.validate();
+
+      EXPECT_EQ( nullptr, hash.lookup( "fresh-command" ) );
+
+      make_executable( dir + "/fresh-command" );
+      EXPECT_EQ( nullptr, hash.lookup( "fresh-command" ) );   // Still the remembered miss.
+
+      hash.validate();
+      ASSERT_NE( nullptr, hash.lookup( "fresh-command" ) );
+      EXPECT_EQ( dir + "/fresh-command", hash.lookup( "fresh-command" ) );
+
+      setenv( "PATH", old_path.c_str(), 1 );
+      hash.validate();
+      EXPECT_EQ( nullptr, hash.lookup( "fresh-command" ) );
+
+      system( ( "rm -rf " + dir ).c_str() );
+   }
+
+
+   //////////////// HELPERS
+
+   std::string make_scratch_directory() {
+      char name[] = "/tmp/command-hash-XXXXXX";
+      return mkdtemp( name );
+   }
+
+   void make_executable( std::string path ) {
+      int fd = open( path.c_str(), O_WRONLY | O_CREAT, S_IRWXU );
+      close( fd );
+   }
+}
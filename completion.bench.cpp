@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "completion.h"
+
+using namespace shell;
+
+namespace {
+   const std::string path_directory = "/tmp/shellbench-path";
+
+   // A $PATH of nothing but the given number of executables, tool-0 ... tool-N.
+   void make_path( int executables ) {
+      system( ( "rm -rf " + path_directory ).c_str() );
+      mkdir( path_directory.c_str(), 0700 );
+      for ( int i = 0; i < executables; ++i )
+         close( open( ( path_directory + "/tool-" + std::to_string( i ) ).c_str(), O_WRONLY | O_CREAT, 0700 ) );
+      setenv( "PATH", path_directory.c_str(), 1 );
+   }
+
+   // Tab on a command name, with the trie already built: the latency a keypress sees. "tool-1234" has a
+   // handful of candidates, "tool-1" a thousand and more, cut off at the limit.
+   void complete_command( benchmark::State& st, const char* word ) {
+      std::string saved = getenv( "PATH" );
+      std::vector< std::string > candidates;
+      std::string line( word );
+      Completer completer;
+      size_t start;
+
+      make_path( st.range( 0 ) );
+      completer.complete( line, line.size(), start, candidates );
+      for ( auto _ : st ) {
+         completer.complete( line, line.size(), start, candidates );
+         benchmark::DoNotOptimize( candidates.data() );
+      }
+
+      setenv( "PATH", saved.c_str(), 1 );
+      system( ( "rm -rf " + path_directory ).c_str() );
+   }
+
+   // The first Tab of a session, which builds the trie and sets up the watches.
+   void build_trie( benchmark::State& st ) {
+      std::string saved = getenv( "PATH" );
+      std::vector< std::string > candidates;
+      size_t start;
+
+      make_path( st.range( 0 ) );
+      for ( auto _ : st ) {
+         Completer completer;
+         completer.complete( "t", 1, start, candidates );
+      }
+
+      setenv( "PATH", saved.c_str(), 1 );
+      system( ( "rm -rf " + path_directory ).c_str() );
+   }
+
+   // Tab in a directory of that many files. Repeated Tabs mostly find the listing in the cache, as they do at the prompt.
+   void complete_path( benchmark::State& st ) {
+      std::string saved = getenv( "PATH" );
+      std::vector< std::string > candidates;
+      std::string line = "cat " + path_directory + "/tool-1234";
+      Completer completer;
+      size_t start;
+
+      make_path( st.range( 0 ) );
+      for ( auto _ : st ) {
+         completer.complete( line, line.size(), start, candidates );
+         benchmark::DoNotOptimize( candidates.data() );
+      }
+
+      setenv( "PATH", saved.c_str(), 1 );
+      system( ( "rm -rf " + path_directory ).c_str() );
+   }
+
+   BENCHMARK_CAPTURE( complete_command, few, "tool-1234" )->Arg( 30000 )->Unit( benchmark::kMicrosecond );
+   BENCHMARK_CAPTURE( complete_command, many, "tool-1" )->Arg( 30000 )->Unit( benchmark::kMicrosecond );
+   BENCHMARK( build_trie )->Arg( 30000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( complete_path )->Arg( 30000 )->Unit( benchmark::kMicrosecond );
+}
@@ -0,0 +1,308 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+
+#include "completion.h"
+#include "read_directory.h"
+
+namespace shell
+{
+   Completer& completer() noexcept
+   {
+      static Completer instance;
+      return instance;
+   }
+
+   static const uint32_t npos = UINT32_MAX;
+
+   static const char* const shell_builtins[] = {
+      "bg", "cd", "exit", "export", "fg", "hash", "history", "jobs", "parallel", "pipesize", "set", "time", "unset", "wait",
+   };
+
+   static bool is_executable( int dir_fd, const char* name ) noexcept
+   {
+      struct stat st;
+
+      return fstatat( dir_fd, name, &st, 0 ) == 0 && S_ISREG( st.st_mode ) && faccessat( dir_fd, name, X_OK, 0 ) == 0;
+   }
+
+   //////////////// CommandTrie
+
+   CommandTrie::CommandTrie() noexcept
+   {
+      nodes.emplace_back();
+   }
+
+   CommandTrie::~CommandTrie() noexcept
+   {
+      drop();
+   }
+
+   uint32_t CommandTrie::find( std::string_view prefix ) const noexcept
+   {
+      uint32_t at = 0, child;
+
+      for ( char c : prefix ) {
+         for ( child = nodes[ at ].first_child; child != 0 && nodes[ child ].c < c; child = nodes[ child ].next_sibling )
+            ;
+         if ( child == 0 || nodes[ child ].c != c )
+            return npos;
+         at = child;
+      }
+
+      return at;
+   }
+
+   // Counts a name in (+1) or out (-1), making the nodes it needs on the way in.
+   void CommandTrie::add( std::string_view name, int change ) noexcept
+   {
+      uint32_t at = 0, previous, child;
+
+      nodes[0].below += change;
+      for ( char c : name ) {
+         previous = 0;
+         for ( child = nodes[ at ].first_child; child != 0 && nodes[ child ].c < c; child = nodes[ child ].next_sibling )
+            previous = child;
+         if ( child == 0 || nodes[ child ].c != c ) {
+            node fresh;
+            fresh.c = c;
+            fresh.next_sibling = child;
+            nodes.push_back( fresh );                       // Indices only: this may move every node.
+            child = nodes.size() - 1;
+            if ( previous != 0 )
+               nodes[ previous ].next_sibling = child;
+            else
+               nodes[ at ].first_child = child;
+         }
+         at = child;
+         nodes[ at ].below += change;
+      }
+      nodes[ at ].ends_here += change;
+   }
+
+   void CommandTrie::collect( uint32_t at, std::string& name, std::vector< std::string >& names, size_t limit ) const noexcept
+   {
+      if ( names.size() >= limit )
+         return;
+      if ( nodes[ at ].ends_here > 0 )
+         names.push_back( name );
+
+      for ( uint32_t child = nodes[ at ].first_child; child != 0; child = nodes[ child ].next_sibling ) {
+         if ( nodes[ child ].below == 0 )
+            continue;                                       // Everything under it was removed again.
+         name.push_back( nodes[ child ].c );
+         collect( child, name, names, limit );
+         name.pop_back();
+      }
+   }
+
+   // Every name that starts with the prefix, in order, up to the limit.
+   void CommandTrie::complete( std::string_view prefix, std::vector< std::string >& names, size_t limit ) const noexcept
+   {
+      uint32_t at = find( prefix );
+      std::string name( prefix );
+
+      if ( at != npos && nodes[ at ].below > 0 )
+         collect( at, name, names, limit );
+   }
+
+   void CommandTrie::scan( path_directory& dir ) noexcept
+   {
+      int fd = open( dir.name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+      if ( fd < 0 )
+         return;
+
+      read_directory( fd, [&]( const char* name, unsigned char type ) {
+         if ( ( type == DT_REG || type == DT_LNK || type == DT_UNKNOWN ) && is_executable( fd, name ) && dir.executables.insert( name ).second )
+            add( name, 1 );
+      } );
+      close( fd );
+   }
+
+   // One name in one directory changed; it may have become a command, or stopped being one.
+   void CommandTrie::update( path_directory& dir, std::string_view name ) noexcept
+   {
+      std::string key( name );
+      int fd = open( dir.name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+      bool now = fd >= 0 && is_executable( fd, key.c_str() ), was = dir.executables.count( key ) > 0;
+
+      if ( fd >= 0 )
+         close( fd );
+      if ( now && !was ) {
+         dir.executables.insert( key );
+         add( name, 1 );
+      }
+      else if ( !now && was ) {
+         dir.executables.erase( key );
+         add( name, -1 );
+      }
+   }
+
+   // Relative directories on $PATH depend on where the shell happens to be, so completion leaves them out.
+   void CommandTrie::build() noexcept
+   {
+      const char* path = getenv( "PATH" );
+      std::string::size_type begin = 0, end;
+
+      path_variable = path ? path : "/bin:/usr/bin";
+      notify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+      do {
+         end = path_variable.find( ':', begin );
+         std::string name = path_variable.substr( begin, end == std::string::npos ? std::string::npos : end - begin );
+         begin = end + 1;
+         if ( name.empty() || name[0] != '/' )
+            continue;
+         if ( std::any_of( directories.begin(), directories.end(), [&]( const path_directory& dir ) { return dir.name == name; } ) )
+            continue;
+
+         directories.emplace_back();
+         directories.back().name = name;
+         if ( notify >= 0 )
+            directories.back().watch = inotify_add_watch( notify, name.c_str(),
+               IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+         scan( directories.back() );
+      } while ( end != std::string::npos );
+
+      built = true;
+   }
+
+   void CommandTrie::drop() noexcept
+   {
+      if ( notify >= 0 )
+         close( notify );                                   // Takes every watch with it.
+
+      notify = -1;
+      directories.clear();
+      nodes.assign( 1, node() );
+      built = false;
+   }
+
+   // Builds the trie the first time, and from then on applies what inotify has queued up since the last time.
+   // A new $PATH, a directory that went away, or a queue that overflowed, mean starting over.
+   void CommandTrie::sync() noexcept
+   {
+      const char* path = getenv( "PATH" );
+      alignas( struct inotify_event ) char buffer[ 16 * 1024 ];
+      bool start_over = false;
+      ssize_t n;
+
+      if ( built && path_variable != ( path ? path : "/bin:/usr/bin" ) )
+         drop();
+      if ( !built ) {
+         build();
+         return;
+      }
+
+      while ( notify >= 0 && ( n = read( notify, buffer, sizeof( buffer ) ) ) > 0 ) {
+         for ( ssize_t at = 0; at < n; ) {
+            const struct inotify_event* event = reinterpret_cast< const struct inotify_event* >( buffer + at );
+            at += sizeof( struct inotify_event ) + event->len;
+
+            if ( event->mask & ( IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED ) ) {
+               start_over = true;
+               continue;
+            }
+            for ( path_directory& dir : directories ) {
+               if ( dir.watch == event->wd && event->len > 0 )
+                  update( dir, event->name );
+            }
+         }
+      }
+
+      if ( start_over ) {
+         drop();
+         build();
+      }
+   }
+
+   //////////////// DirectoryCache
+
+   const std::vector< std::pair< std::string, bool > >& DirectoryCache::list( const std::string& directory ) noexcept
+   {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      std::unordered_map< std::string, listing >::iterator found;
+      int fd;
+
+      for ( auto it = listings.begin(); it != listings.end(); ) {
+         if ( now - it->second.read_at >= lifetime )
+            it = listings.erase( it );
+         else
+            ++it;
+      }
+      if ( ( found = listings.find( directory ) ) != listings.end() )
+         return found->second.names;
+
+      listing& fresh = listings[ directory ];
+      fresh.read_at = now;
+      if ( ( fd = open( directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ) < 0 )
+         return fresh.names;
+
+      read_directory( fd, [&]( const char* name, unsigned char type ) {
+         struct stat st;
+         bool is_directory = type == DT_DIR;
+         if ( type == DT_LNK || type == DT_UNKNOWN )
+            is_directory = fstatat( fd, name, &st, 0 ) == 0 && S_ISDIR( st.st_mode );
+         fresh.names.emplace_back( name, is_directory );
+      } );
+      close( fd );
+      std::sort( fresh.names.begin(), fresh.names.end() );
+
+      return fresh.names;
+   }
+
+   //////////////// Completer
+
+   bool Completer::complete( std::string_view line, size_t cursor, size_t& word_start, std::vector< std::string >& candidates ) noexcept
+   {
+      std::string_view before = line.substr( 0, cursor ), word, earlier;
+      std::string_view::size_type boundary, last;
+
+      boundary = before.find_last_of( " \t|<>&" );
+      word_start = boundary == std::string_view::npos ? 0 : boundary + 1;
+      word = before.substr( word_start );
+      earlier = before.substr( 0, word_start );
+      last = earlier.find_last_not_of( " \t" );
+      candidates.clear();
+
+      if ( ( last == std::string_view::npos || earlier[ last ] == '|' ) && word.find( '/' ) == std::string_view::npos ) {
+         commands.sync();
+         commands.complete( word, candidates, limit );
+         for ( const char* name : shell_builtins ) {
+            if ( std::string_view( name ).substr( 0, word.size() ) == word )
+               candidates.push_back( name );
+         }
+         std::sort( candidates.begin(), candidates.end() );
+         candidates.erase( std::unique( candidates.begin(), candidates.end() ), candidates.end() );
+      }
+      else {
+         complete_path( word, candidates );
+      }
+
+      return !candidates.empty();
+   }
+
+   void Completer::complete_path( std::string_view word, std::vector< std::string >& candidates ) noexcept
+   {
+      std::string_view::size_type slash = word.rfind( '/' );
+      std::string_view directory = slash == std::string_view::npos ? "" : word.substr( 0, slash + 1 );
+      std::string_view name = word.substr( directory.size() );
+      const std::vector< std::pair< std::string, bool > >& names = directories.list( directory.empty() ? "." : std::string( directory ) );
+      auto it = std::lower_bound( names.begin(), names.end(), name, []( const std::pair< std::string, bool >& entry, std::string_view name ) {
+         return std::string_view( entry.first ) < name;
+      } );
+
+      for ( ; it != names.end() && it->first.compare( 0, name.size(), name ) == 0 && candidates.size() < limit; ++it ) {
+         if ( it->first[0] == '.' && ( name.empty() || name[0] != '.' ) )
+            continue;                                       // Hidden, unless asked for.
+         candidates.push_back( std::string( directory ) + it->first + ( it->second ? "/" : "" ) );
+      }
+   }
+}
@@ -0,0 +1,90 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace shell
+{
+   // The executables on $PATH, in a trie. Filled once, from the first completion on, and from then on only
+   // changed by what inotify reports about the $PATH directories: a keypress never rescans them.
+   //
+   // A name can live in more than one directory; each node counts the directories that have its name, and how
+   // many names there are below it, so a removed name leaves no dead branch for completion to walk into.
+   class CommandTrie
+   {
+   private:
+      struct node
+      {
+         uint32_t first_child = 0;                         // 0 for none: the root is nobody's child.
+         uint32_t next_sibling = 0;                        // Siblings are kept sorted by c.
+         uint32_t ends_here = 0;                           // Directories with this name in them.
+         uint32_t below = 0;                               // Names at or below this node, counted like ends_here.
+         char c = 0;
+      };
+      struct path_directory
+      {
+         std::string name;
+         int watch = -1;
+         std::unordered_set< std::string > executables;
+      };
+      std::vector< node > nodes;
+      std::vector< path_directory > directories;
+      std::string path_variable;
+      int notify = -1;
+      bool built = false;
+      uint32_t find( std::string_view prefix ) const noexcept;
+      void add( std::string_view name, int change ) noexcept;
+      void collect( uint32_t at, std::string& name, std::vector< std::string >& names, size_t limit ) const noexcept;
+      void scan( path_directory& dir ) noexcept;
+      void update( path_directory& dir, std::string_view name ) noexcept;
+      void build() noexcept;
+      void drop() noexcept;
+   public:
+      CommandTrie() noexcept;
+      ~CommandTrie() noexcept;
+      CommandTrie( const CommandTrie& ) = delete;
+      CommandTrie& operator=( const CommandTrie& ) = delete;
+      void sync() noexcept;
+      size_t size() const noexcept { return nodes.empty() ? 0 : nodes[0].below; }
+      void complete( std::string_view prefix, std::vector< std::string >& names, size_t limit ) const noexcept;
+   };
+
+   // Directory listings for path completion, read with getdents64(2) and kept for a moment, so that the second
+   // Tab, or the next character's, doesn't read the same directory again.
+   class DirectoryCache
+   {
+   private:
+      struct listing
+      {
+         std::chrono::steady_clock::time_point read_at;
+         std::vector< std::pair< std::string, bool > > names;  // Sorted, with whether each is a directory.
+      };
+      std::unordered_map< std::string, listing > listings;
+   public:
+      static constexpr std::chrono::milliseconds lifetime{ 2000 };
+      const std::vector< std::pair< std::string, bool > >& list( const std::string& directory ) noexcept;
+   };
+
+   // What Tab offers for the word before the cursor: commands and shell builtins for the first word of a stage,
+   // paths for everything else. Every candidate replaces the whole word; directories end in '/'.
+   class Completer
+   {
+   private:
+      CommandTrie commands;
+      DirectoryCache directories;
+      void complete_path( std::string_view word, std::vector< std::string >& candidates ) noexcept;
+   public:
+      static const size_t limit = 1000;                    // More than anyone reads through.
+      bool complete( std::string_view line, size_t cursor, size_t& word_start, std::vector< std::string >& candidates ) noexcept;
+   };
+
+   Completer& completer() noexcept;
+}
+#endif
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "completion.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const std::string first_directory = "/tmp/shelltest-path-1", second_directory = "/tmp/shelltest-path-2";
+
+   std::vector< std::string > complete( Completer& completer, std::string line );
+   void make_file( const std::string& path, bool executable );
+   void remove_directory( const std::string& path );
+
+   class CompletionTest : public testing::Test {
+   protected:
+      std::string saved_path;
+
+      void SetUp() override {
+         saved_path = getenv( "PATH" );
+         mkdir( first_directory.c_str(), 0700 );
+         mkdir( second_directory.c_str(), 0700 );
+         setenv( "PATH", ( first_directory + ":" + second_directory + ":relative" ).c_str(), 1 );
+      }
+
+      void TearDown() override {
+         setenv( "PATH", saved_path.c_str(), 1 );
+         remove_directory( first_directory );
+         remove_directory( second_directory );
+      }
+   };
+
+   TEST_F( CompletionTest, CommandsFromPath ) {
+      Completer completer;
+      std::vector< std::string > expected;
+
+      make_file( first_directory + "/alpha", true );
+      make_file( first_directory + "/alpine", true );
+      make_file( second_directory + "/beta", false );
+
+      expected = { "alpha", "alpine" };
+      EXPECT_EQ( expected, complete( completer, "al" ) );
+      EXPECT_EQ( expected, complete( completer, "ls | al" ) );
+      EXPECT_EQ( expected, complete( completer, "  al" ) );
+
+      expected = { "bg" };                                  // beta isn't executable, bg is a builtin.
+      EXPECT_EQ( expected, complete( completer, "b" ) );
+
+      expected = { "export" };
+      EXPECT_EQ( expected, complete( completer, "exp" ) );
+      expected = { "unset" };
+      EXPECT_EQ( expected, complete( completer, "un" ) );
+
+      expected = {};
+      EXPECT_EQ( expected, complete( completer, "x" ) );
+   }
+
+   TEST_F( CompletionTest, FollowsChangesToThePath ) {
+      Completer completer;
+      std::vector< std::string > expected;
+
+      make_file( first_directory + "/alpha", true );
+      make_file( second_directory + "/alpha", true );
+      complete( completer, "al" );                          // Built from here on.
+
+      make_file( first_directory + "/alto", true );
+      make_file( second_directory + "/beta", false );
+      expected = { "alpha", "alto" };
+      EXPECT_EQ( expected, complete( completer, "al" ) );
+
+      chmod( ( second_directory + "/beta" ).c_str(), 0700 );
+      expected = { "beta", "bg" };
+      EXPECT_EQ( expected, complete( completer, "b" ) );
+
+      unlink( ( first_directory + "/alpha" ).c_str() );     // Still in the second directory.
+      rename( ( first_directory + "/alto" ).c_str(), ( first_directory + "/.alto" ).c_str() );
+      expected = { "alpha" };
+      EXPECT_EQ( expected, complete( completer, "al" ) );
+
+      unlink( ( second_directory + "/alpha" ).c_str() );
+      expected = {};
+      EXPECT_EQ( expected, complete( completer, "al" ) );
+
+      setenv( "PATH", first_directory.c_str(), 1 );
+      expected = { "bg" };
+      EXPECT_EQ( expected, complete( completer, "b" ) );
+   }
+
+   TEST_F( CompletionTest, Paths ) {
+      Completer completer;
+      std::vector< std::string > expected;
+
+      expected = { "../test-dir/" };
+      EXPECT_EQ( expected, complete( completer, "cat ../test-d" ) );
+
+      expected = { "../test-dir/1", "../test-dir/2", "../test-dir/3", "../test-dir/4" };
+      EXPECT_EQ( expected, complete( completer, "cat ../test-dir/" ) );
+      EXPECT_EQ( expected, complete( completer, "cat < ../test-dir/" ) );
+
+      expected = { "../test-dir/2" };
+      EXPECT_EQ( expected, complete( completer, "ls | wc ../test-dir/2" ) );
+
+      expected = { "./alpha" };                             // A path to a command.
+      make_file( "./alpha", true );
+      EXPECT_EQ( expected, complete( completer, "./al" ) );
+      unlink( "./alpha" );
+   }
+
+   //////////////// HELPERS
+
+   std::vector< std::string > complete( Completer& completer, std::string line ) {
+      std::vector< std::string > candidates;
+      size_t start;
+
+      completer.complete( line, line.size(), start, candidates );
+      return candidates;
+   }
+
+   void make_file( const std::string& path, bool executable ) {
+      close( open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, executable ? 0700 : 0600 ) );
+   }
+
+   void remove_directory( const std::string& path ) {
+      std::string command = "rm -rf " + path;
+      system( command.c_str() );
+   }
+}
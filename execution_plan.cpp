@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "execution_plan.h"
+#include "command_hash.h"
+
+namespace shell
+{
+   ExecutionPlan::ExecutionPlan() noexcept
+      : stages( &arena )
+   {
+   }
+
+   const char* ExecutionPlan::copy( std::string_view text ) noexcept
+   {
+      char* copied = static_cast< char* >( arena.allocate( text.size() + 1, 1 ) );
+
+      memcpy( copied, text.data(), text.size() );
+      copied[ text.size() ] = '\0';
+
+      return copied;
+   }
+
+   bool ExecutionPlan::is_current( bool zero_copy, bool builtins ) const noexcept
+   {
+      return reusable
+         && generation == command_hash().generation()
+         && this->zero_copy == zero_copy
+         && this->builtins == builtins;
+   }
+
+   // Packs argv into one block: the pointer array first, then the strings it points to.
+   char** ExecutionPlan::convert_to_c_args( const std::pmr::vector< std::pmr::string >& args, std::pmr::memory_resource* arena ) noexcept
+   {
+      size_t pointers = ( args.size() + 1 ) * sizeof( char* ), size = pointers;
+      char** c_args;
+      char* text;
+
+      for ( const std::pmr::string& arg : args )
+         size += arg.size() + 1;
+
+      c_args = static_cast< char** >( arena->allocate( size, alignof( char* ) ) );
+      text = reinterpret_cast< char* >( c_args ) + pointers;
+
+      for ( size_t i = 0; i < args.size(); ++i ) {
+         c_args[i] = text;
+         memcpy( text, args[i].c_str(), args[i].size() + 1 );
+         text += args[i].size() + 1;
+      }
+      c_args[ args.size() ] = NULL;
+
+      return c_args;
+   }
+
+   char** ExecutionPlan::convert_to_c_args( const std::pmr::vector< std::pmr::string >& args ) noexcept
+   {
+      return convert_to_c_args( args, &arena );
+   }
+
+   // base with the NAME=value assignments on top. Only the assignments are copied; the rest still points into
+   // base, which the plan has to keep alive.
+   char** ExecutionPlan::convert_to_c_env( char* const* base, const std::vector< std::string >& assignments ) noexcept
+   {
+      size_t count = assignments.size() + 1, at = 0;
+      char** c_env;
+
+      for ( char* const* entry = base; *entry; ++entry )
+         ++count;
+      c_env = static_cast< char** >( arena.allocate( count * sizeof( char* ), alignof( char* ) ) );
+
+      for ( char* const* entry = base; *entry; ++entry ) {
+         std::string_view name( *entry, strcspn( *entry, "=" ) + 1 );
+         if ( std::none_of( assignments.begin(), assignments.end(), [&]( const std::string& a ) { return std::string_view( a ).substr( 0, name.size() ) == name; } ) )
+            c_env[ at++ ] = *entry;
+      }
+      for ( const std::string& assignment : assignments )
+         c_env[ at++ ] = const_cast< char* >( copy( assignment ) );
+      c_env[ at ] = NULL;
+
+      return c_env;
+   }
+}
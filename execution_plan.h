@@ -0,0 +1,71 @@
+#ifndef EXECUTION_PLAN_H
+#define EXECUTION_PLAN_H
+
+#include <sys/types.h>
+
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace shell
+{
+   struct builtin;
+   struct environment_block;
+
+   // Where one of a stage's standard fds comes from.
+   struct redirect
+   {
+      enum class source { inherit, pipe, file, text };
+      source from = source::inherit;
+      const char* path = nullptr;                          // For files, points into the plan. For text, the text itself.
+      int flags = 0;
+      size_t size = 0;                                     // Of the text, see here_document.h.
+   };
+
+   struct stage_plan
+   {
+      enum class kind
+      {
+         process,                                          // Exec path with argv.
+         transfer,                                         // A pass-through `cat` the shell serves itself.
+         builtin,                                          // One of builtins.h, on a thread or in the shell itself.
+         missing                                           // Known not to exist, nothing to start.
+      };
+      kind how = kind::missing;
+      const char* path = nullptr;                          // Resolved executable, points into the plan.
+      const struct builtin* tool = nullptr;                // For builtins, which still get a path to fall back on.
+      char** argv = nullptr;                               // NULL-terminated, points into the plan.
+      char** envp = nullptr;                               // With NAME=value prefixes, otherwise the shell's environment.
+      redirect input, output;
+      unsigned first_substitution = 0, substitutions = 0;  // The ExecutionPlan::substituted_fds its argv refers to.
+   };
+
+   // A RunCommandsAction lowered to everything a child needs, built once in the parent and kept for the
+   // next run of the same line. Stages, argv blocks and paths all live in the plan's own arena, so after
+   // fork the child only has to dup2 the fds it is handed and exec.
+   class ExecutionPlan
+   {
+   private:
+      std::pmr::monotonic_buffer_resource arena;
+   public:
+      std::pmr::vector< stage_plan > stages;
+      std::shared_ptr< const environment_block > environment;  // What the stages' envp blocks point into, kept alive.
+      std::vector< int > substituted_fds;                  // The shell's ends of the <(...) and >(...) pipes, as /dev/fd/N.
+      std::vector< pid_t > substituted_pids;               // What those pipelines started, waited for with the stages.
+      unsigned generation = 0;                             // CommandHash generation the paths were resolved in.
+      bool reusable = true;                                // False when a path depended on the current directory.
+      bool zero_copy = true;
+      bool builtins = true;
+      ExecutionPlan() noexcept;
+      ExecutionPlan( const ExecutionPlan& ) = delete;
+      ExecutionPlan& operator=( const ExecutionPlan& ) = delete;
+      const char* copy( std::string_view text ) noexcept;
+      bool is_current( bool zero_copy, bool builtins ) const noexcept;
+      static char** convert_to_c_args( const std::pmr::vector< std::pmr::string >& args, std::pmr::memory_resource* arena ) noexcept;
+      char** convert_to_c_args( const std::pmr::vector< std::pmr::string >& args ) noexcept;
+      char** convert_to_c_env( char* const* base, const std::vector< std::string >& assignments ) noexcept;
+   };
+}
+#endif
@@ -0,0 +1,93 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "globbing.h"
+
+using namespace shell;
+
+namespace {
+   // A directory of n files, half *.c and half *.h, made once and left for the next run.
+   std::string populate( int n ) {
+      std::string directory = "/tmp/shellbench-glob-" + std::to_string( n );
+      std::string done = directory + "/.complete";
+      char name[ 32 ];
+      int fd;
+
+      if ( access( done.c_str(), F_OK ) == 0 )
+         return directory;
+      mkdir( directory.c_str(), 0755 );
+      if ( ( fd = open( directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ) < 0 )
+         return directory;
+      for ( int i = 0; i < n; ++i ) {
+         snprintf( name, sizeof( name ), "file%07d.%c", i / 2, i % 2 ? 'h' : 'c' );
+         close( openat( fd, name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644 ) );
+      }
+      close( openat( fd, ".complete", O_WRONLY | O_CREAT | O_CLOEXEC, 0644 ) );
+      close( fd );
+      return directory;
+   }
+
+   // Arg: entries in the directory. Each pattern matches 1 in 200 of them.
+   void glob_expand( benchmark::State& st ) {
+      std::string pattern = populate( st.range( 0 ) ) + "/*99.c";
+
+      for ( auto _ : st ) {
+         std::vector< std::string > matches;
+         Glob glob;                                         // A new one per line, as the shell has it.
+         glob.expand( pattern, matches );
+         benchmark::DoNotOptimize( matches.data() );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   void glob_libc( benchmark::State& st ) {
+      std::string pattern = populate( st.range( 0 ) ) + "/*99.c";
+      glob_t found;
+
+      for ( auto _ : st ) {
+         glob( pattern.c_str(), 0, NULL, &found );
+         benchmark::DoNotOptimize( found.gl_pathv );
+         globfree( &found );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   // `ls *99.c *99.h`: two patterns on one line, where the second finds the directory already read.
+   void glob_expand_two_patterns( benchmark::State& st ) {
+      std::string directory = populate( st.range( 0 ) );
+
+      for ( auto _ : st ) {
+         std::vector< std::string > matches;
+         Glob glob;
+         glob.expand( directory + "/*99.c", matches );
+         glob.expand( directory + "/*99.h", matches );
+         benchmark::DoNotOptimize( matches.data() );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   void glob_libc_two_patterns( benchmark::State& st ) {
+      std::string directory = populate( st.range( 0 ) );
+      glob_t found;
+
+      for ( auto _ : st ) {
+         glob( ( directory + "/*99.c" ).c_str(), 0, NULL, &found );
+         glob( ( directory + "/*99.h" ).c_str(), GLOB_APPEND, NULL, &found );
+         benchmark::DoNotOptimize( found.gl_pathv );
+         globfree( &found );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   BENCHMARK( glob_expand )->RangeMultiplier( 10 )->Range( 1000, 1000000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( glob_libc )->RangeMultiplier( 10 )->Range( 1000, 1000000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( glob_expand_two_patterns )->RangeMultiplier( 10 )->Range( 1000, 1000000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( glob_libc_two_patterns )->RangeMultiplier( 10 )->Range( 1000, 1000000 )->Unit( benchmark::kMillisecond );
+}
@@ -0,0 +1,223 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "globbing.h"
+#include "read_directory.h"
+
+namespace shell
+{
+   // Matches c against the [...] starting at pattern[at]; end is left just past the ']'. An unclosed '[' is
+   // an ordinary character, which is reported as end == at.
+   static bool match_class( std::string_view pattern, size_t at, char c, size_t& end ) noexcept
+   {
+      size_t i = at + 1;
+      bool negate = false, matched = false;
+
+      if ( i < pattern.size() && ( pattern[i] == '!' || pattern[i] == '^' ) ) {
+         negate = true;
+         ++i;
+      }
+      for ( size_t first = i; i < pattern.size() && ( pattern[i] != ']' || i == first ); ++i ) {
+         if ( i + 2 < pattern.size() && pattern[ i + 1 ] == '-' && pattern[ i + 2 ] != ']' ) {
+            matched |= (unsigned char)pattern[i] <= (unsigned char)c && (unsigned char)c <= (unsigned char)pattern[ i + 2 ];
+            i += 2;
+         }
+         else {
+            matched |= pattern[i] == c;
+         }
+      }
+
+      if ( i >= pattern.size() ) {
+         end = at;
+         return false;
+      }
+      end = i + 1;
+      return matched != negate;
+   }
+
+   bool Glob::is_pattern( std::string_view word ) noexcept
+   {
+      return word.find_first_of( "*?[" ) != std::string_view::npos;
+   }
+
+   // One component against one name, backtracking to the last '*' on a mismatch.
+   bool Glob::match( std::string_view pattern, std::string_view name ) noexcept
+   {
+      size_t p = 0, n = 0, star = std::string_view::npos, resume = 0, end;
+
+      while ( n < name.size() ) {
+         if ( p < pattern.size() ) {
+            switch ( pattern[p] ) {
+               case '*':
+                  star = ++p;
+                  resume = n;
+                  continue;
+               case '?':
+                  ++p;
+                  ++n;
+                  continue;
+               case '[':
+                  if ( match_class( pattern, p, name[n], end ) ) {
+                     p = end;
+                     ++n;
+                     continue;
+                  }
+                  if ( end == p && name[n] == '[' ) {       // Not a class after all.
+                     ++p;
+                     ++n;
+                     continue;
+                  }
+                  break;
+               default:
+                  if ( pattern[p] == name[n] ) {
+                     ++p;
+                     ++n;
+                     continue;
+                  }
+            }
+         }
+         if ( star == std::string_view::npos )
+            return false;
+         p = star;                                          // Let the last '*' take one more character.
+         n = ++resume;
+      }
+
+      while ( p < pattern.size() && pattern[p] == '*' )
+         ++p;
+      return p == pattern.size();
+   }
+
+   bool Glob::expand( std::string_view word, std::vector< std::string >& matches ) noexcept
+   {
+      std::string prefix;
+      size_t first = matches.size();
+
+      if ( !is_pattern( word ) )
+         return false;
+
+      expand_from( prefix, word, matches );
+      std::sort( matches.begin() + first, matches.end() );
+      return matches.size() > first;
+   }
+
+   // Appends the matches, or the word itself when there are none.
+   bool Glob::expand( std::string_view word, std::pmr::vector< std::pmr::string >& words ) noexcept
+   {
+      std::vector< std::string > matches;
+
+      if ( !expand( word, matches ) ) {
+         words.emplace_back( word );
+         return false;
+      }
+
+      for ( const std::string& match : matches )
+         words.emplace_back( match );
+      return true;
+   }
+
+   // prefix is what is matched so far, empty or ending in '/', and is left as it was found.
+   void Glob::expand_from( std::string& prefix, std::string_view rest, std::vector< std::string >& matches ) noexcept
+   {
+      size_t slash = rest.find( '/' ), length = prefix.size();
+      std::string_view component = rest.substr( 0, slash );
+      std::string_view remaining = slash == std::string_view::npos ? std::string_view() : rest.substr( slash + 1 );
+      bool more = slash != std::string_view::npos;
+      struct stat st;
+
+      if ( rest.empty() ) {                                 // A pattern that ended in '/', which only directories match.
+         if ( !prefix.empty() )
+            matches.push_back( prefix );
+         return;
+      }
+
+      if ( !is_pattern( component ) ) {
+         prefix.append( component );
+         if ( !more ) {
+            if ( fstatat( AT_FDCWD, prefix.c_str(), &st, AT_SYMLINK_NOFOLLOW ) == 0 )
+               matches.push_back( prefix );
+         }
+         else if ( !remaining.empty() || ( stat( prefix.c_str(), &st ) == 0 && S_ISDIR( st.st_mode ) ) ) {
+            prefix += '/';
+            expand_from( prefix, remaining, matches );
+         }
+         prefix.resize( length );
+         return;
+      }
+
+      const listing& here = list( prefix );
+
+      if ( component == "**" ) {                            // This directory, and every one below it that isn't hidden.
+         if ( more )
+            expand_from( prefix, remaining, matches );
+         for ( const entry& e : here.entries ) {
+            std::string_view name( here.names.data() + e.offset, e.length );
+            if ( name[0] == '.' )
+               continue;
+            if ( !more )
+               matches.push_back( prefix + std::string( name ) );
+            if ( is_directory( prefix, name, e.type, false ) ) {
+               prefix.append( name ) += '/';
+               expand_from( prefix, rest, matches );
+               prefix.resize( length );
+            }
+         }
+         return;
+      }
+
+      for ( const entry& e : here.entries ) {
+         std::string_view name( here.names.data() + e.offset, e.length );
+         if ( ( name[0] == '.' && component[0] != '.' ) || !match( component, name ) )
+            continue;
+         if ( !more ) {
+            matches.push_back( prefix + std::string( name ) );
+         }
+         else if ( is_directory( prefix, name, e.type, true ) ) {
+            prefix.append( name ) += '/';
+            expand_from( prefix, remaining, matches );
+            prefix.resize( length );
+         }
+      }
+   }
+
+   // Read once per Glob. A directory that can't be read has no entries.
+   const Glob::listing& Glob::list( const std::string& directory ) noexcept
+   {
+      std::unordered_map< std::string, listing >::iterator found = listings.find( directory );
+      int fd;
+
+      if ( found != listings.end() )
+         return found->second;
+
+      listing& fresh = listings[ directory ];
+      if ( ( fd = open( directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ) < 0 )
+         return fresh;
+
+      read_directory( fd, [&]( const char* name, unsigned char type ) {
+         size_t length = strlen( name );
+         fresh.entries.push_back( { (uint32_t)fresh.names.size(), (uint16_t)length, type } );
+         fresh.names.insert( fresh.names.end(), name, name + length + 1 );
+      } );
+      close( fd );
+
+      return fresh;
+   }
+
+   // d_type mostly says; only symlinks, which ** doesn't follow, and filesystems without d_type need a stat(2).
+   bool Glob::is_directory( const std::string& directory, std::string_view name, unsigned char type, bool follow ) noexcept
+   {
+      std::string path;
+      struct stat st;
+
+      if ( type == DT_DIR )
+         return true;
+      if ( ( type == DT_LNK && !follow ) || ( type != DT_LNK && type != DT_UNKNOWN ) )
+         return false;
+
+      path.reserve( directory.size() + name.size() );
+      path.append( directory ).append( name );
+      return fstatat( AT_FDCWD, path.c_str(), &st, follow ? 0 : AT_SYMLINK_NOFOLLOW ) == 0 && S_ISDIR( st.st_mode );
+   }
+}
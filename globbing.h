@@ -0,0 +1,47 @@
+#ifndef GLOBBING_H
+#define GLOBBING_H
+
+#include <stdint.h>
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace shell
+{
+   // Pathname expansion for command arguments: *, ?, [...] (with ! or ^ to negate, and ranges), and ** as a
+   // whole component for any number of directories. Names starting with '.' only match a pattern that does
+   // too. A word that matches nothing is left as it is, and the matches of one that does are sorted.
+   //
+   // Directories are read with getdents64(2) and d_type tells what is a directory, so matching a pattern
+   // costs no stat(2) per entry. Listings are kept for the life of the Glob, which the shell makes one of
+   // per command line: `ls *.c *.h` reads the directory once.
+   class Glob
+   {
+   private:
+      struct entry
+      {
+         uint32_t offset;                                  // Into listing::names, NUL terminated.
+         uint16_t length;
+         unsigned char type;                               // d_type
+      };
+      struct listing
+      {
+         std::vector< char > names;
+         std::vector< entry > entries;
+      };
+      std::unordered_map< std::string, listing > listings;
+      const listing& list( const std::string& directory ) noexcept;
+      bool is_directory( const std::string& directory, std::string_view name, unsigned char type, bool follow ) noexcept;
+      void expand_from( std::string& prefix, std::string_view rest, std::vector< std::string >& matches ) noexcept;
+   public:
+      static bool is_pattern( std::string_view word ) noexcept;
+      static bool match( std::string_view pattern, std::string_view name ) noexcept;
+      bool expand( std::string_view word, std::vector< std::string >& matches ) noexcept;
+      bool expand( std::string_view word, std::pmr::vector< std::pmr::string >& words ) noexcept;
+      size_t directories_read() const noexcept { return listings.size(); }
+   };
+}
+#endif
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "globbing.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* tree = "/tmp/shelltest-glob";
+
+   class GlobTest : public testing::Test {
+   protected:
+      char saved[ 4096 ];
+
+      void SetUp() override {
+         system( "rm -rf /tmp/shelltest-glob" );
+         for ( const char* dir : { "", "/src", "/src/net", "/src/net/deep", "/doc", "/.hidden" } )
+            mkdir( ( std::string( tree ) + dir ).c_str(), 0755 );
+         for ( const char* file : { "/a.c", "/b.c", "/c.h", "/.dot.c", "/[x]", "/src/main.c", "/src/net/socket.c",
+                                    "/src/net/deep/wire.c", "/doc/readme", "/.hidden/secret.c" } )
+            close( open( ( std::string( tree ) + file ).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644 ) );
+         symlink( "src", ( std::string( tree ) + "/link" ).c_str() );
+         ASSERT_NE( nullptr, getcwd( saved, sizeof( saved ) ) );
+         ASSERT_EQ( 0, chdir( tree ) );
+      }
+
+      void TearDown() override {
+         ASSERT_EQ( 0, chdir( saved ) );
+         system( "rm -rf /tmp/shelltest-glob" );
+      }
+
+      std::vector< std::string > expand( std::string_view word ) {
+         std::vector< std::string > matches;
+         Glob glob;
+         glob.expand( word, matches );
+         return matches;
+      }
+   };
+
+   TEST( Glob, Match ) {
+      EXPECT_TRUE( Glob::match( "*.c", "main.c" ) );
+      EXPECT_FALSE( Glob::match( "*.c", "main.h" ) );
+      EXPECT_TRUE( Glob::match( "*", "" ) );
+      EXPECT_TRUE( Glob::match( "a*b*c", "aXbYbZc" ) );
+      EXPECT_FALSE( Glob::match( "a*b*c", "aXbYbZ" ) );
+      EXPECT_TRUE( Glob::match( "?.?", "a.c" ) );
+      EXPECT_FALSE( Glob::match( "?", "" ) );
+      EXPECT_TRUE( Glob::match( "[a-c]x", "bx" ) );
+      EXPECT_FALSE( Glob::match( "[!a-c]x", "bx" ) );
+      EXPECT_TRUE( Glob::match( "[^a-c]x", "dx" ) );
+      EXPECT_TRUE( Glob::match( "[]]", "]" ) );               // A ']' first is one of the class.
+      EXPECT_TRUE( Glob::match( "[a-]", "-" ) );
+      EXPECT_TRUE( Glob::match( "[x", "[x" ) );              // Unclosed, so just a '['.
+      EXPECT_TRUE( Glob::match( "*[x", "ab[x" ) );
+   }
+
+   TEST( Glob, IsPattern ) {
+      EXPECT_TRUE( Glob::is_pattern( "*.c" ) );
+      EXPECT_TRUE( Glob::is_pattern( "a?" ) );
+      EXPECT_TRUE( Glob::is_pattern( "[ab]" ) );
+      EXPECT_FALSE( Glob::is_pattern( "src/main.c" ) );
+   }
+
+   TEST_F( GlobTest, ExpandsInTheCurrentDirectory ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "a.c", "b.c" } ), expand( "*.c" ) );      // Sorted, without .dot.c.
+      EXPECT_EQ( ( std::vector< std::string >{ ".dot.c" } ), expand( ".*.c" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "a.c", "b.c", "c.h" } ), expand( "?.?" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "[x]" } ), expand( "[[]x]" ) );
+      EXPECT_TRUE( expand( "*.nothing" ).empty() );
+   }
+
+   TEST_F( GlobTest, ExpandsAcrossDirectories ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "link/main.c", "src/main.c" } ), expand( "*/main.c" ) );  // Follows the link.
+      EXPECT_EQ( ( std::vector< std::string >{ "doc/", "link/", "src/" } ), expand( "*/" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "src/net/socket.c" } ), expand( "src/*/*.c" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ std::string( tree ) + "/doc/readme" } ), expand( std::string( tree ) + "/d*/*" ) );
+   }
+
+   TEST_F( GlobTest, DoubleStarMatchesAnyNumberOfDirectories ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "a.c", "b.c", "src/main.c", "src/net/deep/wire.c", "src/net/socket.c" } ), expand( "**/*.c" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "src/main.c", "src/net/deep/wire.c", "src/net/socket.c" } ), expand( "src/**/*.c" ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "src/", "src/net/", "src/net/deep/" } ), expand( "src/**/" ) );  // No directories at all, too.
+      EXPECT_EQ( ( std::vector< std::string >{ "src/main.c", "src/net", "src/net/deep", "src/net/deep/wire.c", "src/net/socket.c" } ), expand( "src/**" ) );
+   }
+
+   TEST_F( GlobTest, ReadsEachDirectoryOncePerLine ) {
+      std::vector< std::string > matches;
+      Glob glob;
+
+      glob.expand( "*.c", matches );
+      glob.expand( "*.h", matches );
+      glob.expand( "src/*.c", matches );
+      EXPECT_EQ( 2u, glob.directories_read() );
+      EXPECT_EQ( ( std::vector< std::string >{ "a.c", "b.c", "c.h", "src/main.c" } ), matches );
+   }
+}
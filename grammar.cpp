@@ -19,7 +19,7 @@ namespace grammar
       {
          static void apply0( shell::shell_state& state ) 
          {
-            state.action = new NopAction();
+            state.action = state.make< NopAction >();
          }
       };
 
@@ -28,7 +28,7 @@ namespace grammar
       {
          static void apply0( shell::shell_state& state )
          {
-            state.action = new ExitAction();
+            state.action = state.make< ExitAction >();
          };
       };
 
@@ -38,10 +38,312 @@ namespace grammar
          template< typename Input >
             static void apply( const Input& in, shell::shell_state& state )
             {
-               state.action = new ChangeDirectoryAction( in.string() );
+               state.action = state.make< ChangeDirectoryAction >( std::string_view( in.begin(), in.size() ), &state.arena );
             }
       };
 
+   template<>
+      struct action< hash_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< HashAction >( &state.arena );
+         };
+      };
+
+   template<>
+      struct action< hash_arg >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               HashAction * hash;
+
+               hash = static_cast< HashAction* >( state.action );
+               if ( std::string_view( in.begin(), in.size() ) == "-r" ) {
+                  hash->rehash = true;
+               }
+               else {
+                  hash->names.emplace_back( in.begin(), in.end() );
+               }
+            };
+      };
+
+   template<>
+      struct action< jobs_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< JobControlAction >( JobControlAction::builtin::jobs );
+         };
+      };
+
+   template<>
+      struct action< fg_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< JobControlAction >( JobControlAction::builtin::foreground );
+         };
+      };
+
+   template<>
+      struct action< bg_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< JobControlAction >( JobControlAction::builtin::background );
+         };
+      };
+
+   template<>
+      struct action< wait_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< JobControlAction >( JobControlAction::builtin::wait );
+         };
+      };
+
+   template<>
+      struct action< job_number >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< JobControlAction* >( state.action )->job = std::stoi( in.string() );
+            };
+      };
+
+   template<>
+      struct action< job_pid >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               JobControlAction * job_control;
+
+               job_control = static_cast< JobControlAction* >( state.action );
+               if ( job_control->which == JobControlAction::builtin::wait ) {
+                  job_control->pid = std::stoi( in.string() );   // wait takes pids, fg and bg take job numbers.
+               }
+               else {
+                  job_control->job = std::stoi( in.string() );
+               }
+            };
+      };
+
+   template<>
+      struct action< set_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< SetOptionAction >( &state.arena );
+         };
+      };
+
+   template<>
+      struct action< option_disable >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            static_cast< SetOptionAction* >( state.action )->enable = false;
+         };
+      };
+
+   template<>
+      struct action< option_name >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< SetOptionAction* >( state.action )->name.assign( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< history_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< HistoryAction >();
+         };
+      };
+
+   template<>
+      struct action< history_count >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< HistoryAction* >( state.action )->count = std::stoul( in.string() );
+            };
+      };
+
+   template<>
+      struct action< export_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< VariablesAction >( VariablesAction::builtin::exports, &state.arena );
+         };
+      };
+
+   template<>
+      struct action< unset_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< VariablesAction >( VariablesAction::builtin::unset, &state.arena );
+         };
+      };
+
+   template<>
+      struct action< export_word >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< VariablesAction* >( state.action )->words.emplace_back( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< unset_word >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< VariablesAction* >( state.action )->words.emplace_back( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< set_variables >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               VariablesAction * assign;
+               std::string_view text( in.begin(), in.size() );
+               size_t start, end = 0;
+
+               state.action = assign = state.make< VariablesAction >( VariablesAction::builtin::assign, &state.arena );
+               while ( ( start = text.find_first_not_of( " \t", end ) ) != std::string_view::npos ) {
+                  end = std::min( text.find_first_of( " \t", start ), text.size() );
+                  assign->words.emplace_back( text.substr( start, end - start ) );
+               }
+            };
+      };
+
+   template<>
+      struct action< parallel_keyword >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            state.action = state.make< ParallelAction >( &state.arena );
+         };
+      };
+
+   template<>
+      struct action< parallel_slots >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< ParallelAction* >( state.action )->slots = std::stoi( in.string() );
+            };
+      };
+
+   template<>
+      struct action< parallel_arg >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< ParallelAction* >( state.action )->command.emplace_back( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< parallel_separator >
+      {
+         static void apply0( shell::shell_state& state )
+         {
+            static_cast< ParallelAction* >( state.action )->has_inputs = true;
+         };
+      };
+
+   template<>
+      struct action< parallel_input >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< ParallelAction* >( state.action )->inputs.emplace_back( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< parallel_input_file >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< ParallelAction* >( state.action )->input_file.assign( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< option_value >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               static_cast< SetOptionAction* >( state.action )->value.assign( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< time_prefix >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               RunCommandsAction * cmdl;
+               std::string_view prefix( in.begin(), in.size() );
+
+               state.action = cmdl = state.make< RunCommandsAction >( &state.arena );
+               cmdl->timed = true;
+               if ( prefix.find( "-p" ) != std::string_view::npos ) {
+                  cmdl->time_with = time_format::posix;
+               }
+               else if ( prefix.find( "-j" ) != std::string_view::npos ) {
+                  cmdl->time_with = time_format::json;
+               }
+            };
+      };
+
+   template<>
+      struct action< pipe_prefix >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               RunCommandsAction * cmdl;
+               std::string_view prefix( in.begin(), in.size() );
+
+               if ( state.action == 0 ) {                     // After `time`, the action is already there.
+                  state.action = state.make< RunCommandsAction >( &state.arena );
+               }
+               cmdl = static_cast< RunCommandsAction* >( state.action );
+
+               prefix.remove_suffix( prefix.size() - prefix.find_last_not_of( " \t" ) - 1 );
+               cmdl->packet_pipes = prefix.find( " -d" ) != std::string_view::npos || prefix.find( "\t-d" ) != std::string_view::npos;
+               parse_size( prefix.substr( prefix.find_last_of( " \t" ) + 1 ), cmdl->pipe_size );
+            };
+      };
+
    template<>
       struct action< arg >
       {
@@ -51,18 +353,41 @@ namespace grammar
                RunCommandsAction * cmdl;
 
                if ( state.action == 0 ) {
-                  state.action = new RunCommandsAction();
+                  state.action = state.make< RunCommandsAction >( &state.arena );
                }
 
                cmdl = static_cast< RunCommandsAction* >( state.action );
                
                if ( cmdl->numberOfCommands == 0 ) {
-                  shell::command *cmd = new shell::command;
+                  shell::command *cmd = state.make< shell::command >( &state.arena );
                   cmdl->commands.push_back( cmd );
                   cmdl->numberOfCommands++;
                }
 
-               cmdl->commands.back()->args.push_back( in.string() );
+               cmdl->commands.back()->args.emplace_back( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< command_assignment >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               RunCommandsAction * cmdl;
+
+               if ( state.action == 0 ) {
+                  state.action = state.make< RunCommandsAction >( &state.arena );
+               }
+
+               cmdl = static_cast< RunCommandsAction* >( state.action );
+
+               if ( cmdl->numberOfCommands == 0 ) {
+                  cmdl->commands.push_back( state.make< shell::command >( &state.arena ) );
+                  cmdl->numberOfCommands++;
+               }
+
+               cmdl->commands.back()->assignments.emplace_back( in.begin(), in.end() );
             };
       };
 
@@ -87,7 +412,33 @@ namespace grammar
                RunCommandsAction * cmdl;
 
                cmdl = static_cast< RunCommandsAction* >( state.action );
-               cmdl->commands.back()->input_file = in.string();
+               cmdl->commands.back()->input_file.assign( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< here_string_word >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               RunCommandsAction * cmdl;
+
+               cmdl = static_cast< RunCommandsAction* >( state.action );
+               cmdl->commands.back()->here_string.assign( in.begin(), in.end() );
+            };
+      };
+
+   template<>
+      struct action< here_delimiter >
+      {
+         template< typename Input >
+            static void apply( const Input& in, shell::shell_state& state )
+            {
+               RunCommandsAction * cmdl;
+
+               cmdl = static_cast< RunCommandsAction* >( state.action );
+               cmdl->commands.back()->here_delimiter.assign( in.begin(), in.end() );
             };
       };
 
@@ -100,7 +451,7 @@ namespace grammar
                RunCommandsAction * cmdl;
 
                cmdl = static_cast< RunCommandsAction* >( state.action );
-               cmdl->commands.back()->output_file = in.string();
+               cmdl->commands.back()->output_file.assign( in.begin(), in.end() );
             };
       };
 
@@ -112,7 +463,7 @@ namespace grammar
             RunCommandsAction * cmdl;
 
             cmdl = static_cast< RunCommandsAction* >( state.action );
-            cmdl->commands.push_back( new shell::command );
+            cmdl->commands.push_back( state.make< shell::command >( &state.arena ) );
             cmdl->numberOfCommands++;
          };
       };
@@ -23,11 +23,40 @@ namespace grammar {
    {
    };
 
+   // A part that may also be a pathname pattern (see globbing.h) and refer to variables (see variables.h).
+   struct pattern
+      : plus< sor < alnum, one< '_' >, one< '-' >, one< '/' >, one< '.' >, one< '*', '?', '[', ']', '!', '^' >, one< '$', '{', '}' > > >
+   {
+   };
+
+   struct variable_name
+      : seq< sor< alpha, one< '_' > >, star< sor< alnum, one< '_' > > > >
+   {
+   };
+
+   struct assignment_value
+      : star< sor< alnum, one< '_' >, one< '-' >, one< '/' >, one< '.' >, one< ':', ',', '@', '%', '+', '=', '~' >, one< '*', '?', '[', ']', '!', '^' >, one< '$', '{', '}' > > >
+   {
+   };
+
+   struct assignment
+      : seq< variable_name, one< '=' >, assignment_value >
+   {
+   };
+
    struct nop
       : optional_whitespace
    {
    };
 
+   // A builtin's name only when the word ends there, so `hash-files` or `jobs.sh` on $PATH is still a command.
+   // keyword<> alone would match the front of them, and the builtin's action would already have been created.
+   template< char... Name >
+   struct builtin_keyword
+      : seq< keyword< Name... >, at< sor< blank, eolf > > >
+   {
+   };
+
    struct exit_keyword
       : keyword< 'e', 'x', 'i', 't' >
    {
@@ -38,12 +67,161 @@ namespace grammar {
    {
    };
 
+   struct hash_keyword
+      : builtin_keyword< 'h', 'a', 's', 'h' >
+   {
+   };
+
+   struct jobs_keyword
+      : builtin_keyword< 'j', 'o', 'b', 's' >
+   {
+   };
+
+   struct fg_keyword
+      : builtin_keyword< 'f', 'g' >
+   {
+   };
+
+   struct bg_keyword
+      : builtin_keyword< 'b', 'g' >
+   {
+   };
+
+   struct wait_keyword
+      : builtin_keyword< 'w', 'a', 'i', 't' >
+   {
+   };
+
+   struct set_keyword
+      : builtin_keyword< 's', 'e', 't' >
+   {
+   };
+
+   struct history_keyword
+      : builtin_keyword< 'h', 'i', 's', 't', 'o', 'r', 'y' >
+   {
+   };
+
+   struct time_keyword
+      : keyword< 't', 'i', 'm', 'e' >
+   {
+   };
+
+   struct pipesize_keyword
+      : keyword< 'p', 'i', 'p', 'e', 's', 'i', 'z', 'e' >
+   {
+   };
+
+   struct export_keyword
+      : builtin_keyword< 'e', 'x', 'p', 'o', 'r', 't' >
+   {
+   };
+
+   struct unset_keyword
+      : builtin_keyword< 'u', 'n', 's', 'e', 't' >
+   {
+   };
+
+   struct parallel_keyword
+      : builtin_keyword< 'p', 'a', 'r', 'a', 'l', 'l', 'e', 'l' >
+   {
+   };
+
    struct directory
       : part
    {
    };
 
+   // The pipeline inside <( ) or >( ), parsed again when it runs. Parentheses nest.
+   struct substituted_pipeline
+      : star< sor< seq< one< '(' >, substituted_pipeline, one< ')' > >, not_one< '(', ')', '\n' > > >
+   {
+   };
+
+   struct process_substitution
+      : seq< one< '<', '>' >, one< '(' >, substituted_pipeline, one< ')' > >
+   {
+   };
+
    struct arg
+      : sor< process_substitution, pattern >
+   {
+   };
+
+   struct hash_arg
+      : part
+   {
+   };
+
+   struct job_number
+      : plus< digit >
+   {
+   };
+
+   struct job_pid
+      : plus< digit >
+   {
+   };
+
+   struct job_spec
+      : sor<
+           seq< one< '%' >, job_number >,
+           job_pid
+        >
+   {
+   };
+
+   struct option_enable
+      : one< '-' >
+   {
+   };
+
+   struct option_disable
+      : one< '+' >
+   {
+   };
+
+   struct option_name
+      : part
+   {
+   };
+
+   struct size
+      : seq< plus< digit >, opt< one< 'K', 'k', 'M', 'm' > > >
+   {
+   };
+
+   struct option_value
+      : size
+   {
+   };
+
+   struct history_count
+      : plus< digit >
+   {
+   };
+
+   struct parallel_slots
+      : plus< digit >
+   {
+   };
+
+   struct parallel_arg
+      : plus< sor < alnum, one< '_' >, one< '-' >, one< '/' >, one< '.' >, one< '{' >, one< '}' > > >
+   {
+   };
+
+   struct parallel_separator
+      : string< ':', ':', ':' >
+   {
+   };
+
+   struct parallel_input
+      : part
+   {
+   };
+
+   struct parallel_input_file
       : part
    {
    };
@@ -58,6 +236,16 @@ namespace grammar {
    {
    };
 
+   struct here_string_word
+      : plus< sor< alnum, one< '_' >, one< '-' >, one< '/' >, one< '.' >, one< ':', ',', '@', '%', '+', '=', '~' >, one< '*', '?', '[', ']', '!', '^' >, one< '$', '{', '}' > > >
+   {
+   };
+
+   struct here_delimiter
+      : plus< sor< alnum, one< '_' >, one< '-' > > >
+   {
+   };
+
    struct pipe
       : one< '|' >
    {
@@ -68,8 +256,15 @@ namespace grammar {
    {
    };
 
+   // NAME=value before a command, for that command's environment only.
+   struct command_assignment
+      : assignment
+   {
+   };
+
    struct command
       : seq<
+           star< seq< command_assignment, whitespace > >,
            arg,
            star< seq< whitespace, arg > >
         >
@@ -85,6 +280,26 @@ namespace grammar {
    {
    };
 
+   // <<< word, the word and a newline as stdin.
+   struct here_string
+      : seq<
+           string< '<', '<', '<' >,
+           optional_whitespace,
+           here_string_word
+        >
+   {
+   };
+
+   // << WORD, the lines after this one up to WORD as stdin.
+   struct here_document
+      : seq<
+           string< '<', '<' >,
+           optional_whitespace,
+           here_delimiter
+        >
+   {
+   };
+
    struct redir_stdout
       : seq<
            one< '>' >,
@@ -94,12 +309,39 @@ namespace grammar {
    {
    };
 
+   struct time_option
+      : seq< one< '-' >, sor< one< 'p' >, one< 'j' > > >
+   {
+   };
+
+   struct time_prefix
+      : seq<
+           time_keyword,
+           whitespace,
+           opt< seq< time_option, whitespace > >
+        >
+   {
+   };
+
+   struct pipe_prefix
+      : seq<
+           pipesize_keyword,
+           whitespace,
+           opt< seq< string< '-', 'd' >, whitespace > >,
+           size,
+           whitespace
+        >
+   {
+   };
+
    struct run_commands
       : seq<
            optional_whitespace,
+           opt< time_prefix >,
+           opt< pipe_prefix >,
            command,
            optional_whitespace,
-           opt< redir_stdin >,
+           opt< sor< here_string, here_document, redir_stdin > >,
            optional_whitespace,
            star< seq< pipe, optional_whitespace, command, optional_whitespace > >,
            opt< redir_stdout >,
@@ -130,11 +372,122 @@ namespace grammar {
    {
    };
 
+   struct hash
+      : seq<
+           optional_whitespace,
+           hash_keyword,
+           star< seq< whitespace, hash_arg > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   struct job_control
+      : seq<
+           optional_whitespace,
+           sor< jobs_keyword, fg_keyword, bg_keyword, wait_keyword >,
+           opt< seq< whitespace, job_spec > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   struct set_option
+      : seq<
+           optional_whitespace,
+           set_keyword,
+           opt< seq< whitespace, sor< option_enable, option_disable >, one< 'o' > > >,
+           opt< seq< whitespace, option_name > >,
+           opt< seq< whitespace, option_value > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   struct history
+      : seq<
+           optional_whitespace,
+           history_keyword,
+           opt< seq< whitespace, history_count > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   struct export_word
+      : sor< assignment, variable_name >
+   {
+   };
+
+   struct unset_word
+      : variable_name
+   {
+   };
+
+   struct export_variables
+      : seq<
+           optional_whitespace,
+           export_keyword,
+           star< seq< whitespace, export_word > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   struct unset_variables
+      : seq<
+           optional_whitespace,
+           unset_keyword,
+           star< seq< whitespace, unset_word > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   // A line of nothing but NAME=value. The action is on the whole rule, since `NAME=value command` gets as far
+   // as the command before it fails here and is left to run_commands.
+   struct set_variables
+      : seq<
+           optional_whitespace,
+           assignment,
+           star< seq< whitespace, assignment > >,
+           optional_whitespace,
+           at< eolf >
+        >
+   {
+   };
+
+   // Everything after the keyword is optional, so once it matched the line is parallel's: anything the rule can't
+   // take fails the line instead of falling back to run_commands with a ParallelAction in the state.
+   struct parallel
+      : seq<
+           optional_whitespace,
+           parallel_keyword,
+           opt< seq< whitespace, string< '-', 'j' >, optional_whitespace, parallel_slots > >,
+           star< seq< whitespace, parallel_arg > >,
+           opt< seq< whitespace, parallel_separator, star< seq< whitespace, parallel_input > > > >,
+           optional_whitespace,
+           opt< seq< one< '<' >, optional_whitespace, parallel_input_file > >,
+           optional_whitespace
+        >
+   {
+   };
+
+   // The builtins that work on the shell's own state (cd, hash, the job builtins, set, history, export, unset)
+   // are whole lines: `history | grep x` doesn't parse, since a stage may be a process that sees none of it.
    struct shell_action
       : seq<
            sor< 
               exit, 
               change_directory, 
+              hash,
+              job_control,
+              set_option,
+              history,
+              export_variables,
+              unset_variables,
+              set_variables,
+              parallel,
               run_commands,
               nop
            >
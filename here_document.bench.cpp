@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "here_document.h"
+
+using namespace shell;
+
+namespace {
+   // What shells without memfds do: write the document to a file in $TMPDIR, reopen it, remove it.
+   int open_temporary_file( const std::string& text ) {
+      const char* directory = getenv( "TMPDIR" );
+      std::string path = std::string( directory ? directory : "/tmp" ) + "/shellbench-XXXXXX";
+      int fd, reader;
+
+      if ( ( fd = mkstemp( path.data() ) ) < 0 )
+         return -1;
+      if ( write( fd, text.data(), text.size() ) != (ssize_t)text.size() ) {
+         close( fd );
+         unlink( path.c_str() );
+         return -1;
+      }
+      close( fd );
+      reader = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+      unlink( path.c_str() );
+      return reader;
+   }
+
+   // Args: the document's size in MiB, and whether it goes through a temporary file instead of a sealed memfd.
+   // Each iteration writes the document and reads it all back, as the command on the other end would.
+   void feed_document( benchmark::State& st ) {
+      std::string text( st.range( 0 ) << 20, 'x' );
+      std::vector< char > buffer( 64 * 1024 );
+      bool temporary = st.range( 1 );
+      ssize_t n;
+      int fd;
+
+      for ( auto _ : st ) {
+         if ( ( fd = temporary ? open_temporary_file( text ) : open_document( text ) ) < 0 ) {
+            st.SkipWithError( "couldn't open the document" );
+            break;
+         }
+         while ( ( n = read( fd, buffer.data(), buffer.size() ) ) > 0 )
+            ;
+         close( fd );
+      }
+      st.SetBytesProcessed( st.iterations() * text.size() );
+   }
+}
+
+BENCHMARK( feed_document )->ArgsProduct( { { 1, 4, 16 }, { 0, 1 } } )->Unit( benchmark::kMicrosecond );
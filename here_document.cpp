@@ -0,0 +1,72 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "here_document.h"
+
+namespace shell
+{
+   namespace
+   {
+      bool write_all( int fd, std::string_view text ) noexcept
+      {
+         ssize_t n;
+
+         while ( !text.empty() ) {
+            if ( ( n = write( fd, text.data(), text.size() ) ) < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               return false;
+            }
+            text.remove_prefix( n );
+         }
+         return true;
+      }
+
+      int close_with_error( int fd ) noexcept
+      {
+         int error = errno;
+
+         close( fd );
+         errno = error;
+         return -1;
+      }
+
+      // PIPE_BUF always fits in an empty pipe, so the write can't block with no reader on the other end yet.
+      int open_pipe_document( std::string_view text ) noexcept
+      {
+         int fds[2];
+
+         if ( pipe2( fds, O_CLOEXEC ) < 0 )
+            return -1;
+         if ( !write_all( fds[1], text ) ) {
+            close( fds[0] );
+            return close_with_error( fds[1] );
+         }
+         close( fds[1] );
+         return fds[0];
+      }
+
+      int open_memory_document( std::string_view text ) noexcept
+      {
+         int fd;
+
+         if ( ( fd = memfd_create( "here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING ) ) < 0 )
+            return -1;
+         if ( ( !text.empty() && ftruncate( fd, text.size() ) < 0 ) || !write_all( fd, text )
+              || fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL ) < 0
+              || lseek( fd, 0, SEEK_SET ) < 0 )
+            return close_with_error( fd );
+         return fd;
+      }
+   }
+
+   int open_document( std::string_view text ) noexcept
+   {
+      if ( text.size() <= PIPE_BUF )
+         return open_pipe_document( text );
+      return open_memory_document( text );
+   }
+}
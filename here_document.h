@@ -0,0 +1,15 @@
+#ifndef HERE_DOCUMENT_H
+#define HERE_DOCUMENT_H
+
+#include <string_view>
+
+namespace shell
+{
+   // An fd to read text from, for << documents and <<< strings, without a temporary file to write and remove.
+   //
+   // Text that fits in a pipe in one atomic write goes into one. Anything larger goes into a memfd, sealed once
+   // it is written, so the reader gets an ordinary seekable, mappable file that nobody can change underneath it.
+   // -1 with errno set on failure.
+   int open_document( std::string_view text ) noexcept;
+}
+#endif
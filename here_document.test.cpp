@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "here_document.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   std::string read_all( int fd ) {
+      std::string text;
+      char buffer[ 4096 ];
+      ssize_t n;
+
+      while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+         text.append( buffer, n );
+      return text;
+   }
+
+   TEST( HereDocument, SmallTextComesFromAPipe ) {
+      int fd = open_document( "one\ntwo\n" );
+      struct stat info;
+
+      ASSERT_GE( fd, 0 );
+      ASSERT_EQ( 0, fstat( fd, &info ) );
+      EXPECT_TRUE( S_ISFIFO( info.st_mode ) );
+      EXPECT_EQ( "one\ntwo\n", read_all( fd ) );
+      close( fd );
+   }
+
+   TEST( HereDocument, LargeTextComesFromASealedMemoryFile ) {
+      std::string text( 4 * 1024 * 1024, 'x' );
+      int fd = open_document( text );
+      struct stat info;
+
+      ASSERT_GE( fd, 0 );
+      ASSERT_EQ( 0, fstat( fd, &info ) );
+      EXPECT_TRUE( S_ISREG( info.st_mode ) );
+      EXPECT_EQ( (off_t)text.size(), info.st_size );
+      EXPECT_EQ( F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL, fcntl( fd, F_GET_SEALS ) );
+      EXPECT_EQ( text, read_all( fd ) );
+      EXPECT_EQ( -1, ftruncate( fd, 0 ) );               // Nobody gets to change it.
+      close( fd );
+   }
+
+   TEST( HereDocument, TextAtTheLimitOfAPipe ) {
+      std::string small( PIPE_BUF, 'a' ), large( PIPE_BUF + 1, 'b' );
+      int small_fd = open_document( small ), large_fd = open_document( large );
+
+      ASSERT_GE( small_fd, 0 );
+      ASSERT_GE( large_fd, 0 );
+      EXPECT_EQ( small, read_all( small_fd ) );
+      EXPECT_EQ( large, read_all( large_fd ) );
+      close( small_fd );
+      close( large_fd );
+   }
+
+   TEST( HereDocument, EmptyText ) {
+      int fd = open_document( "" );
+
+      ASSERT_GE( fd, 0 );
+      EXPECT_EQ( "", read_all( fd ) );
+      close( fd );
+   }
+
+   TEST( HereDocument, ClosedOnExec ) {
+      int fd = open_document( std::string( 100000, 'c' ) );
+
+      ASSERT_GE( fd, 0 );
+      EXPECT_TRUE( fcntl( fd, F_GETFD ) & FD_CLOEXEC );
+      close( fd );
+   }
+}
@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "history.h"
+
+using namespace shell;
+
+namespace {
+   const char* history_file = "/tmp/shellbench-history";
+
+   void generate_history( int entries ) {
+      std::ofstream out( history_file );
+
+      for ( int i = 0; i < entries; ++i )
+         out << "git commit -m 'change number " << i << "' && make -j8 test\n";
+   }
+
+   // What a new shell pays before its first prompt, and for the first up arrow. Should not grow with the file.
+   void open_history( benchmark::State& st ) {
+      std::string_view newest;
+
+      generate_history( st.range( 0 ) );
+      for ( auto _ : st ) {
+         History entries;
+         entries.open( history_file );
+         entries.entry( 0, newest );
+         benchmark::DoNotOptimize( newest );
+      }
+      unlink( history_file );
+   }
+
+   // Ctrl-R for something that isn't there: every entry is indexed and looked at.
+   void search_history( benchmark::State& st ) {
+      History entries;
+      size_t age;
+
+      generate_history( st.range( 0 ) );
+      entries.open( history_file );
+      for ( auto _ : st ) {
+         age = 0;
+         benchmark::DoNotOptimize( entries.search( "not in there", true, age ) );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+      unlink( history_file );
+   }
+
+   BENCHMARK( open_history )->Arg( 1000 )->Arg( 100000 )->Arg( 1000000 )->Unit( benchmark::kMicrosecond );
+   BENCHMARK( search_history )->Arg( 1000 )->Arg( 100000 )->Unit( benchmark::kMicrosecond );
+}
@@ -0,0 +1,230 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "history.h"
+
+namespace shell
+{
+   History& history() noexcept
+   {
+      static History entries;
+      return entries;
+   }
+
+   History::~History() noexcept
+   {
+      close();
+   }
+
+   // $HISTFILE, or ~/.shell_history.
+   const char* History::default_path() noexcept
+   {
+      static const std::string path = [] {
+         const char* file = getenv( "HISTFILE" );
+         const char* home = getenv( "HOME" );
+
+         if ( file && *file )
+            return std::string( file );
+         return std::string( home ? home : "." ) + "/.shell_history";
+      }();
+
+      return path.c_str();
+   }
+
+   bool History::open( const char* path ) noexcept
+   {
+      close();
+      if ( ( fd = ::open( path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR ) ) < 0 )
+         return false;
+
+      refresh();
+      return true;
+   }
+
+   void History::close() noexcept
+   {
+      if ( map )
+         munmap( const_cast< char* >( map ), mapped );
+      if ( fd >= 0 )
+         ::close( fd );
+
+      fd = -1;
+      map = nullptr;
+      mapped = map_size = unindexed = 0;
+      starts.clear();
+   }
+
+   // One write(2) per entry: O_APPEND then puts it after whatever other shells appended, in one piece.
+   void History::add( std::string_view line ) noexcept
+   {
+      std::string_view newest;
+      std::string text;
+
+      if ( fd < 0 || line.empty() || line.find( '\n' ) != std::string_view::npos )
+         return;
+
+      refresh();
+      if ( entry( 0, newest ) && newest == line )
+         return;                                            // Running the same line again adds nothing.
+
+      text.reserve( line.size() + 1 );
+      text.append( line );
+      text += '\n';
+      if ( write( fd, text.data(), text.size() ) == (ssize_t)text.size() )
+         refresh();
+   }
+
+   // Maps what was appended since the last refresh. Entries that other shells added go on the newest end of the
+   // index; only what was indexed already is indexed again, the rest waits for index_older().
+   void History::refresh() noexcept
+   {
+      struct stat st;
+      void* grown;
+      const char* last;
+      size_t end;
+
+      if ( fd < 0 || fstat( fd, &st ) != 0 )
+         return;
+
+      if ( (size_t)st.st_size < mapped ) {                  // Someone rewrote the file, start over.
+         munmap( const_cast< char* >( map ), mapped );
+         map = nullptr;
+         mapped = map_size = unindexed = 0;
+         starts.clear();
+      }
+      if ( (size_t)st.st_size == mapped )
+         return;
+
+      grown = map
+         ? mremap( const_cast< char* >( map ), mapped, st.st_size, MREMAP_MAYMOVE )
+         : mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+      if ( grown == MAP_FAILED )
+         return;
+      map = static_cast< const char* >( grown );
+      mapped = st.st_size;
+
+      last = static_cast< const char* >( memrchr( map + map_size, '\n', mapped - map_size ) );
+      if ( last == NULL )
+         return;                                            // Only part of an entry so far.
+      end = last - map + 1;
+
+      if ( starts.empty() ) {
+         unindexed = end;                                   // Nothing looked at yet, so nothing to index yet either.
+      }
+      else {
+         for ( size_t at = map_size; at < end; at = static_cast< const char* >( memchr( map + at, '\n', end - at ) ) - map + 1 )
+            starts.push_front( at );
+      }
+      map_size = end;
+   }
+
+   // Extends the index back in time until it reaches the entry of the given age, or the start of the file.
+   bool History::index_older( size_t age ) noexcept
+   {
+      const char* newline;
+
+      while ( starts.size() <= age && unindexed > 0 ) {
+         newline = unindexed > 1
+            ? static_cast< const char* >( memrchr( map, '\n', unindexed - 1 ) )
+            : NULL;
+         unindexed = newline ? newline - map + 1 : 0;
+         starts.push_back( unindexed );
+      }
+
+      return starts.size() > age;
+   }
+
+   std::string_view History::text_of( size_t age ) const noexcept
+   {
+      size_t end = ( age == 0 ? map_size : starts[ age - 1 ] ) - 1;
+
+      return std::string_view( map + starts[ age ], end - starts[ age ] );
+   }
+
+   // Counting what isn't indexed yet is cheaper than indexing it.
+   size_t History::size() noexcept
+   {
+      size_t count = starts.size();
+      const char* at = map;
+      const char* end = map + unindexed;
+
+      while ( at < end && ( at = static_cast< const char* >( memchr( at, '\n', end - at ) ) ) != NULL ) {
+         count++;
+         at++;
+      }
+
+      return count;
+   }
+
+   bool History::entry( size_t age, std::string_view& text ) noexcept
+   {
+      if ( !index_older( age ) )
+         return false;
+
+      text = text_of( age );
+      return true;
+   }
+
+   // Finds the first entry from age on, going back in time or forward, that starts with the text or contains it
+   // anywhere. Ctrl-R and the up arrow on a partly typed line.
+   bool History::search( std::string_view text, bool anywhere, size_t& age, bool older ) noexcept
+   {
+      std::string_view candidate;
+
+      if ( anywhere && older && !text.empty() && text.find( '\n' ) == std::string_view::npos )
+         return search_back( text, age );
+
+      for ( size_t at = age; entry( at, candidate ); at = older ? at + 1 : at - 1 ) {
+         if ( anywhere
+              ? candidate.find( text ) != std::string_view::npos
+              : candidate.substr( 0, text.size() ) == text ) {
+            age = at;
+            return true;
+         }
+         if ( !older && at == 0 )
+            break;
+      }
+
+      return false;
+   }
+
+   // Ctrl-R mostly finds something recent, or nothing at all. So instead of going entry by entry, memmem(3) goes
+   // over the bytes themselves, a window at a time from the newest end back, and only the entry that holds the
+   // match gets indexed. Without a newline in the text a match can't run from one entry into the next.
+   bool History::search_back( std::string_view text, size_t& age ) noexcept
+   {
+      const char* end;
+      const char* from;
+      const char* found = NULL;
+      std::string_view newest;
+
+      if ( !entry( age, newest ) )
+         return false;
+
+      end = newest.data() + newest.size();
+      for ( const char* stop = end; found == NULL && stop > map; stop = from ) {
+         from = (size_t)( stop - map ) > search_window ? stop - search_window : map;
+         for ( const char* at = from; at < stop; ++at ) {  // The last match that starts in the window.
+            at = static_cast< const char* >( memmem( at, std::min< size_t >( stop - at + text.size() - 1, end - at ), text.data(), text.size() ) );
+            if ( at == NULL )
+               break;
+            found = at;
+         }
+      }
+      if ( found == NULL )
+         return false;
+
+      while ( unindexed > (size_t)( found - map ) && index_older( starts.size() ) )
+         ;
+      age = std::lower_bound( starts.begin(), starts.end(), (size_t)( found - map ), std::greater< size_t >() ) - starts.begin();
+      return true;
+   }
+}
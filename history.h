@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <deque>
+#include <string_view>
+
+namespace shell
+{
+   // Command history kept in a plain append-only file, one entry per line, shared by every shell that opens it.
+   //
+   // The file is mapped, not read: opening it costs the same at ten entries as at a million. The index of where
+   // entries start is built from the newest end on demand, so the prompt only ever pays for as far back as
+   // someone actually looks. Every entry is appended with a single O_APPEND write, which keeps the entries of
+   // concurrent shells whole; refresh() maps and indexes what they added since.
+   //
+   // Entries are numbered by age: 0 is the newest. Lookups don't refresh, so ages hold still while someone
+   // pages through them. Views handed out point into the mapping and are good until the next add() or refresh().
+   class History
+   {
+   private:
+      int fd = -1;
+      const char* map = nullptr;
+      size_t mapped = 0;                                   // The whole file, as of the last refresh.
+      size_t map_size = 0;                                 // Up to and including the newline of the newest entry.
+      std::deque< size_t > starts;                         // Offsets of the indexed entries, newest first.
+      size_t unindexed = 0;                                // The entries before this offset aren't in starts yet.
+      bool index_older( size_t age ) noexcept;
+      bool search_back( std::string_view text, size_t& age ) noexcept;
+      std::string_view text_of( size_t age ) const noexcept;
+   public:
+      static const size_t search_window = 64 * 1024;
+      History() noexcept = default;
+      ~History() noexcept;
+      History( const History& ) = delete;
+      History& operator=( const History& ) = delete;
+      static const char* default_path() noexcept;
+      bool open( const char* path ) noexcept;
+      void close() noexcept;
+      bool is_open() const noexcept { return fd >= 0; }
+      void add( std::string_view line ) noexcept;
+      void refresh() noexcept;
+      size_t size() noexcept;
+      bool entry( size_t age, std::string_view& text ) noexcept;
+      bool search( std::string_view text, bool anywhere, size_t& age, bool older = true ) noexcept;
+   };
+
+   History& history() noexcept;
+}
+#endif
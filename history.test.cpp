@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "history.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* history_file = "/tmp/shelltest-history";
+
+   std::string entry_of( History& entries, size_t age );
+   void write_file( const char* path, const std::string& text );
+
+   TEST( History, KeepsEntriesAcrossSessions ) {
+      unlink( history_file );
+      {
+         History entries;
+         ASSERT_TRUE( entries.open( history_file ) );
+         entries.add( "ls -la" );
+         entries.add( "cat a | wc -l" );
+         entries.add( "cat a | wc -l" );                    // Not twice in a row.
+         entries.add( "" );
+         EXPECT_EQ( 2u, entries.size() );
+      }
+
+      History entries;
+      ASSERT_TRUE( entries.open( history_file ) );
+      EXPECT_EQ( 2u, entries.size() );
+      EXPECT_EQ( "cat a | wc -l", entry_of( entries, 0 ) );
+      EXPECT_EQ( "ls -la", entry_of( entries, 1 ) );
+      std::string_view text;
+      EXPECT_FALSE( entries.entry( 2, text ) );
+      unlink( history_file );
+   }
+
+   TEST( History, SharedBetweenShells ) {
+      History first, second;
+
+      unlink( history_file );
+      ASSERT_TRUE( first.open( history_file ) );
+      ASSERT_TRUE( second.open( history_file ) );
+      first.add( "one" );
+      second.add( "two" );
+      first.add( "three" );
+
+      EXPECT_EQ( "three", entry_of( first, 0 ) );
+      EXPECT_EQ( "two", entry_of( first, 1 ) );
+      EXPECT_EQ( "two", entry_of( second, 0 ) );         // Until it looks again.
+      second.refresh();
+      EXPECT_EQ( "three", entry_of( second, 0 ) );
+      EXPECT_EQ( "one", entry_of( second, 2 ) );
+      EXPECT_EQ( 3u, second.size() );
+      unlink( history_file );
+   }
+
+   TEST( History, IgnoresAHalfWrittenEntry ) {
+      History entries;
+
+      write_file( history_file, "one\ntwo\nthr" );
+      ASSERT_TRUE( entries.open( history_file ) );
+      EXPECT_EQ( 2u, entries.size() );
+      EXPECT_EQ( "two", entry_of( entries, 0 ) );
+
+      int fd = open( history_file, O_WRONLY | O_APPEND );
+      write( fd, "ee\n", 3 );
+      close( fd );
+      entries.refresh();
+      EXPECT_EQ( "three", entry_of( entries, 0 ) );
+      EXPECT_EQ( 3u, entries.size() );
+      unlink( history_file );
+   }
+
+   TEST( History, StartsOverWhenTheFileIsRewritten ) {
+      History entries;
+
+      write_file( history_file, "one\ntwo\nthree\n" );
+      ASSERT_TRUE( entries.open( history_file ) );
+      EXPECT_EQ( "three", entry_of( entries, 0 ) );
+      write_file( history_file, "four\n" );
+      entries.refresh();
+      EXPECT_EQ( "four", entry_of( entries, 0 ) );
+      EXPECT_EQ( 1u, entries.size() );
+      unlink( history_file );
+   }
+
+   TEST( History, Search ) {
+      History entries;
+      size_t age;
+
+      write_file( history_file, "make -j8\ngit status\nmake test\ngit diff\nls\n" );
+      ASSERT_TRUE( entries.open( history_file ) );
+
+      age = 0;
+      EXPECT_TRUE( entries.search( "make", false, age ) );
+      EXPECT_EQ( 2u, age );
+      age++;
+      EXPECT_TRUE( entries.search( "make", false, age ) );
+      EXPECT_EQ( 4u, age );
+      age++;
+      EXPECT_FALSE( entries.search( "make", false, age ) );
+
+      age = 0;
+      EXPECT_TRUE( entries.search( "stat", true, age ) );
+      EXPECT_EQ( 3u, age );
+      EXPECT_FALSE( entries.search( "stat", false, age ) );
+
+      age = 4;
+      EXPECT_TRUE( entries.search( "git", false, age, false ) );
+      EXPECT_EQ( 3u, age );
+      age = 2;
+      EXPECT_TRUE( entries.search( "git", false, age, false ) );
+      EXPECT_EQ( 1u, age );
+      age = 0;
+      EXPECT_FALSE( entries.search( "git", false, age, false ) );
+      unlink( history_file );
+   }
+
+   TEST( History, OpensLargeFilesLazily ) {
+      History entries;
+      std::string text;
+
+      for ( int i = 0; i < 200000; ++i )
+         text += "echo " + std::to_string( i ) + "\n";
+      write_file( history_file, text );
+
+      ASSERT_TRUE( entries.open( history_file ) );
+      EXPECT_EQ( "echo 199999", entry_of( entries, 0 ) );
+      EXPECT_EQ( "echo 0", entry_of( entries, 199999 ) );
+      EXPECT_EQ( 200000u, entries.size() );
+
+      size_t age = 0;
+      EXPECT_TRUE( entries.search( "99997", true, age ) );
+      EXPECT_EQ( 2u, age );
+      age = 0;
+      EXPECT_TRUE( entries.search( "echo 7", true, age ) );
+      EXPECT_EQ( "echo 79999", entry_of( entries, age ) );
+      age = 0;
+      EXPECT_TRUE( entries.search( "echo 0", true, age ) );   // Many search windows back.
+      EXPECT_EQ( 199999u, age );
+      age = 0;
+      EXPECT_TRUE( entries.search( "o 12345", true, age ) );
+      EXPECT_EQ( "echo 123459", entry_of( entries, age ) );
+      age = 0;
+      EXPECT_FALSE( entries.search( "echo x", true, age ) );
+
+      entries.add( "echo done" );
+      EXPECT_EQ( "echo done", entry_of( entries, 0 ) );
+      EXPECT_EQ( "echo 0", entry_of( entries, 200000 ) );
+      unlink( history_file );
+   }
+
+   //////////////// HELPERS
+
+   std::string entry_of( History& entries, size_t age ) {
+      std::string_view text;
+
+      if ( !entries.entry( age, text ) )
+         return "<none>";
+      return std::string( text );
+   }
+
+   void write_file( const char* path, const std::string& text ) {
+      int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+
+      write( fd, text.data(), text.size() );
+      close( fd );
+   }
+}
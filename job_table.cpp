@@ -0,0 +1,412 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+
+#include "job_table.h"
+#include "trace.h"
+
+namespace shell
+{
+   JobTable& job_table() noexcept
+   {
+      static JobTable table;
+      return table;
+   }
+
+   JobTable::JobTable() noexcept
+   {
+      sigset_t child;
+
+      sigemptyset( &ignored );
+      sigemptyset( &child );
+      sigaddset( &child, SIGCHLD );
+      pthread_sigmask( SIG_BLOCK, &child, &child_mask );   // Threads started after this inherit the blocked SIGCHLD.
+      child_signals = signalfd( -1, &child, SFD_NONBLOCK | SFD_CLOEXEC );
+   }
+
+   JobTable::~JobTable() noexcept
+   {
+      if ( child_signals >= 0 )
+         close( child_signals );
+   }
+
+   // Puts the shell in its own process group in the foreground of the terminal, and leaves the job control
+   // signals to the children.
+   bool JobTable::enable_job_control( int tty ) noexcept
+   {
+      static const int signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+
+      if ( !isatty( tty ) )
+         return false;
+
+      while ( tcgetpgrp( tty ) != ( shell_pgid = getpgrp() ) )
+         kill( -shell_pgid, SIGTTIN );                      // Started in the background, wait until we are brought forward.
+
+      for ( int sig : signals ) {
+         signal( sig, SIG_IGN );
+         sigaddset( &ignored, sig );
+      }
+
+      setpgid( 0, 0 );                                      // Fails harmlessly for a session leader.
+      shell_pgid = getpgrp();
+      tcsetpgrp( tty, shell_pgid );
+      terminal = tty;
+
+      return true;
+   }
+
+   // A pgid of -1 leaves the child in the shell's process group, 0 makes it the leader of a new one.
+   void JobTable::prepare_spawn( posix_spawnattr_t* attributes, posix_spawn_file_actions_t* actions, pid_t pgid, bool foreground ) const noexcept
+   {
+      short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+
+      posix_spawnattr_setsigmask( attributes, &child_mask );
+      posix_spawnattr_setsigdefault( attributes, &ignored );
+
+      if ( pgid >= 0 ) {
+         flags |= POSIX_SPAWN_SETPGROUP;
+         posix_spawnattr_setpgroup( attributes, pgid );
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ( 2, 35 )
+         if ( foreground && pgid == 0 && terminal >= 0 )     // Before exec, so the leader never gets SIGTTIN for reading too early.
+            posix_spawn_file_actions_addtcsetpgrp_np( actions, terminal );
+#endif
+#endif
+      }
+
+      posix_spawnattr_setflags( attributes, flags );
+   }
+
+   // The fork(2) equivalent of prepare_spawn(), called in the child, so only async-signal-safe calls.
+   void JobTable::prepare_child( pid_t pgid, bool foreground ) const noexcept
+   {
+      if ( pgid >= 0 ) {
+         setpgid( 0, pgid );
+         if ( foreground && terminal >= 0 )
+            tcsetpgrp( terminal, pgid ? pgid : getpid() );
+      }
+
+      for ( int sig = 1; sig < NSIG; ++sig ) {
+         if ( sigismember( &ignored, sig ) == 1 )
+            signal( sig, SIG_DFL );
+      }
+      sigprocmask( SIG_SETMASK, &child_mask, NULL );
+   }
+
+   void JobTable::give_terminal_to( pid_t pgid ) const noexcept
+   {
+      if ( terminal >= 0 && pgid > 0 )
+         tcsetpgrp( terminal, pgid );
+   }
+
+   void JobTable::take_terminal_back() const noexcept
+   {
+      if ( terminal >= 0 )
+         tcsetpgrp( terminal, shell_pgid );
+   }
+
+   // Takes the pids in pipeline order. Stages that could not be started are passed as -1.
+   int JobTable::add( const std::vector< pid_t >& pids, pid_t pgid, std::string text, bool stopped ) noexcept
+   {
+      job_iterator j;
+
+      if ( std::none_of( pids.begin(), pids.end(), []( pid_t pid ) { return pid > 0; } ) )
+         return 0;
+
+      j = jobs.emplace( jobs.end() );
+      j->id = j == jobs.begin() ? 1 : std::prev( j )->id + 1;
+      j->pgid = pgid > 0 ? pgid : 0;
+      j->last = pids.back();
+      j->status = pids.back() < 0                           // A last stage that could not be started, or one the shell ran itself.
+         ? W_EXITCODE( 127, 0 )
+         : 0;
+      j->now = stopped ? job::state::stopped : job::state::running;
+      j->text = std::move( text );
+
+      for ( pid_t pid : pids ) {
+         if ( pid <= 0 )
+            continue;
+         j->pids.push_back( pid );
+         owners[ pid ] = j;
+      }
+
+      return j->id;
+   }
+
+   void JobTable::update( job_iterator j, pid_t pid, int status ) noexcept
+   {
+      if ( WIFSTOPPED( status ) ) {
+         j->now = job::state::stopped;
+         return;
+      }
+      if ( WIFCONTINUED( status ) ) {
+         j->now = job::state::running;
+         return;
+      }
+
+      if ( tracer().enabled() )
+         tracer().process_ended( pid, status );
+      if ( pid == j->last )
+         j->status = status;
+      j->exited.emplace_back( pid, status );
+      j->pids.erase( std::find( j->pids.begin(), j->pids.end(), pid ) );
+      owners.erase( pid );
+
+      if ( j->pids.empty() ) {
+         j->now = job::state::done;
+         finished++;
+      }
+   }
+
+   // Never blocks. Peeks at which child is ready first, so children that aren't ours are left for their owner.
+   void JobTable::reap() noexcept
+   {
+      struct signalfd_siginfo pending[ 16 ];
+      siginfo_t ready;
+      int status;
+
+      while ( read( child_signals, pending, sizeof( pending ) ) > 0 )
+         ;                                                  // Only a wake-up call, pending SIGCHLDs are merged anyway.
+
+      while ( !owners.empty() ) {
+         ready.si_pid = 0;
+         if ( waitid( P_ALL, 0, &ready, WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT ) != 0 || ready.si_pid == 0 )
+            return;
+
+         auto owner = owners.find( ready.si_pid );
+         if ( owner == owners.end() ) {
+            sweep();                                        // Someone else's child is in the way, ask for ours one by one.
+            return;
+         }
+
+         if ( waitpid( ready.si_pid, &status, WNOHANG | WUNTRACED | WCONTINUED ) > 0 )
+            update( owner->second, ready.si_pid, status );
+      }
+   }
+
+   void JobTable::sweep() noexcept
+   {
+      std::vector< std::pair< pid_t, job_iterator > > candidates( owners.begin(), owners.end() );
+      int status;
+
+      for ( auto& candidate : candidates ) {
+         if ( waitpid( candidate.first, &status, WNOHANG | WUNTRACED | WCONTINUED ) > 0 )
+            update( candidate.second, candidate.first, status );
+      }
+   }
+
+   JobTable::job_iterator JobTable::find( int id ) noexcept
+   {
+      if ( id == 0 ) {                                      // The current job: the most recent one that is still around.
+         for ( auto j = jobs.rbegin(); j != jobs.rend(); ++j ) {
+            if ( j->now != job::state::done )
+               return std::prev( j.base() );
+         }
+         return jobs.end();
+      }
+
+      return std::find_if( jobs.begin(), jobs.end(), [id]( const job& j ) { return j.id == id; } );
+   }
+
+   // Blocks until every stage has exited or one of them stops.
+   int JobTable::wait_for( job_iterator j ) noexcept
+   {
+      pid_t pid;
+      int status;
+
+      while ( !j->pids.empty() ) {
+         pid = j->pids.back();
+         if ( waitpid( pid, &status, WUNTRACED ) < 0 ) {
+            if ( errno == EINTR )
+               continue;
+            status = W_EXITCODE( 127, 0 );                  // Reaped behind our back, nothing left to learn about it.
+         }
+         update( j, pid, status );
+         if ( j->now == job::state::stopped )
+            return status;
+      }
+
+      return j->status;
+   }
+
+   void JobTable::forget( job_iterator j ) noexcept
+   {
+      for ( pid_t pid : j->pids )
+         owners.erase( pid );
+      if ( j->now == job::state::done )
+         finished--;
+      jobs.erase( j );
+   }
+
+   void JobTable::describe( std::ostream& out, const job& j ) const noexcept
+   {
+      out << "[" << j.id << "]  ";
+
+      if ( j.now == job::state::running )
+         out << "Running";
+      else if ( j.now == job::state::stopped )
+         out << "Stopped";
+      else if ( WIFSIGNALED( j.status ) )
+         out << strsignal( WTERMSIG( j.status ) );
+      else if ( WEXITSTATUS( j.status ) != 0 )
+         out << "Exit " << WEXITSTATUS( j.status );
+      else
+         out << "Done";
+
+      out << "\t\t" << j.text << "\n";
+   }
+
+   // Reports finished jobs and forgets them. Without anyone to tell, they are kept for `wait` up to a limit.
+   void JobTable::notify( std::ostream& out, bool verbose ) noexcept
+   {
+      if ( finished == 0 || ( !verbose && finished <= remembered_limit ) )
+         return;
+
+      for ( job_iterator j = jobs.begin(); j != jobs.end() && ( verbose || finished > remembered_limit ); ) {
+         if ( j->now != job::state::done ) {
+            ++j;
+            continue;
+         }
+         if ( verbose )
+            describe( out, *j );
+         forget( j++ );
+      }
+   }
+
+   void JobTable::print( std::ostream& out ) noexcept
+   {
+      for ( job_iterator j = jobs.begin(); j != jobs.end(); ) {
+         describe( out, *j );
+         if ( j->now == job::state::done )
+            forget( j++ );
+         else
+            ++j;
+      }
+   }
+
+   int JobTable::foreground( int id ) noexcept
+   {
+      job_iterator j = find( id );
+      int status;
+
+      if ( !job_control() ) {
+         std::cerr << "fg: no job control\n";
+         return W_EXITCODE( 1, 0 );
+      }
+      if ( j == jobs.end() || j->now == job::state::done ) {
+         std::cerr << "fg: " << ( id ? "%" + std::to_string( id ) : "current" ) << ": no such job\n";
+         return W_EXITCODE( 1, 0 );
+      }
+
+      std::cout << j->text << std::endl;
+      give_terminal_to( j->pgid );
+      if ( j->now == job::state::stopped ) {
+         kill( -j->pgid, SIGCONT );
+         j->now = job::state::running;
+      }
+
+      status = wait_for( j );
+      take_terminal_back();
+
+      if ( j->now == job::state::stopped ) {
+         std::cerr << "\n";
+         describe( std::cerr, *j );
+      }
+      else {
+         forget( j );
+      }
+
+      return status;
+   }
+
+   int JobTable::background( int id ) noexcept
+   {
+      job_iterator j = find( id );
+
+      if ( !job_control() ) {
+         std::cerr << "bg: no job control\n";
+         return W_EXITCODE( 1, 0 );
+      }
+      if ( j == jobs.end() || j->now == job::state::done ) {
+         std::cerr << "bg: " << ( id ? "%" + std::to_string( id ) : "current" ) << ": no such job\n";
+         return W_EXITCODE( 1, 0 );
+      }
+
+      if ( j->now == job::state::stopped ) {
+         kill( -j->pgid, SIGCONT );
+         j->now = job::state::running;
+      }
+      std::cout << "[" << j->id << "]  " << j->text << std::endl;
+
+      return 0;
+   }
+
+   // Waits for one job, or for every running job when id is 0, like `wait` and `wait %n`.
+   int JobTable::wait( int id ) noexcept
+   {
+      job_iterator j;
+      int status;
+
+      if ( id != 0 ) {
+         if ( ( j = find( id ) ) == jobs.end() ) {
+            std::cerr << "wait: %" << id << ": no such job\n";
+            return W_EXITCODE( 127, 0 );
+         }
+         status = wait_for( j );
+         if ( j->now == job::state::done )
+            forget( j );
+         return status;
+      }
+
+      for ( j = jobs.begin(); j != jobs.end(); ) {
+         if ( j->now == job::state::running )
+            wait_for( j );
+         if ( j->now == job::state::done )
+            forget( j++ );
+         else
+            ++j;
+      }
+
+      return 0;
+   }
+
+   // A stage reap() already collected still answers with how it ended, as long as its job is remembered.
+   int JobTable::wait_pid( pid_t pid ) noexcept
+   {
+      auto owner = owners.find( pid );
+      auto reaped = [pid]( const std::pair< pid_t, int >& stage ) { return stage.first == pid; };
+      job_iterator j;
+      int status;
+
+      if ( owner == owners.end() ) {
+         for ( j = jobs.begin(); j != jobs.end(); ++j ) {
+            auto stage = std::find_if( j->exited.begin(), j->exited.end(), reaped );
+            if ( stage == j->exited.end() )
+               continue;
+            status = stage->second;
+            if ( j->now == job::state::done )
+               forget( j );
+            return status;
+         }
+         std::cerr << "wait: pid " << pid << " is not a child of this shell\n";
+         return W_EXITCODE( 127, 0 );
+      }
+
+      j = owner->second;
+      while ( waitpid( pid, &status, 0 ) < 0 ) {
+         if ( errno != EINTR ) {
+            status = W_EXITCODE( 127, 0 );
+            break;
+         }
+      }
+      update( j, pid, status );
+      if ( j->now == job::state::done )
+         forget( j );
+
+      return status;
+   }
+}
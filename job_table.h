@@ -0,0 +1,79 @@
+#ifndef JOB_TABLE_H
+#define JOB_TABLE_H
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace shell
+{
+   struct job
+   {
+      enum class state { running, stopped, done };
+      int id = 0;
+      pid_t pgid = 0;                                      // 0 when the job shares the shell's process group.
+      std::vector< pid_t > pids;                           // Stages that haven't been reaped yet.
+      std::vector< std::pair< pid_t, int > > exited;       // Stages reaped so far and how they ended, for `wait pid`.
+      pid_t last = 0;                                      // The last stage, its status is the job's status.
+      int status = 0;
+      state now = state::running;
+      std::string text;
+   };
+
+   // Pipelines that run in the background or were stopped, like bash's job table.
+   //
+   // SIGCHLD stays blocked and is read from a signalfd, so children are reaped by the shell itself, between
+   // lines and while it sits at the prompt, never from a signal handler. Only children that belong to a job
+   // are reaped; foreground pipelines are still waited for by whoever started them.
+   class JobTable
+   {
+   private:
+      typedef std::list< job >::iterator job_iterator;
+      std::list< job > jobs;
+      std::unordered_map< pid_t, job_iterator > owners;    // Every unreaped pid, and the job it belongs to.
+      size_t finished = 0;                                 // Jobs that are done but not yet reported or waited for.
+      sigset_t child_mask;                                 // The mask the shell started with, which children get back.
+      sigset_t ignored;                                    // Signals the shell ignores but children shouldn't.
+      int child_signals = -1;                              // signalfd for SIGCHLD.
+      int terminal = -1;                                   // Only set when job control is on.
+      pid_t shell_pgid = 0;
+      void update( job_iterator j, pid_t pid, int status ) noexcept;
+      void sweep() noexcept;
+      job_iterator find( int id ) noexcept;
+      int wait_for( job_iterator j ) noexcept;
+      void forget( job_iterator j ) noexcept;
+      void describe( std::ostream& out, const job& j ) const noexcept;
+   public:
+      static const size_t remembered_limit = 1024;         // Finished jobs kept around for `wait` when nobody reports them.
+      JobTable() noexcept;
+      ~JobTable() noexcept;
+      JobTable( const JobTable& ) = delete;
+      JobTable& operator=( const JobTable& ) = delete;
+      bool enable_job_control( int tty ) noexcept;
+      bool job_control() const noexcept { return terminal >= 0; }
+      int signal_fd() const noexcept { return child_signals; }
+      void prepare_spawn( posix_spawnattr_t* attributes, posix_spawn_file_actions_t* actions, pid_t pgid, bool foreground ) const noexcept;
+      void prepare_child( pid_t pgid, bool foreground ) const noexcept;
+      void give_terminal_to( pid_t pgid ) const noexcept;
+      void take_terminal_back() const noexcept;
+      int add( const std::vector< pid_t >& pids, pid_t pgid, std::string text, bool stopped ) noexcept;
+      void reap() noexcept;
+      void notify( std::ostream& out, bool verbose ) noexcept;
+      void print( std::ostream& out ) noexcept;
+      int foreground( int id ) noexcept;
+      int background( int id ) noexcept;
+      int wait( int id ) noexcept;
+      int wait_pid( pid_t pid ) noexcept;
+      size_t size() const noexcept { return jobs.size(); }
+   };
+
+   JobTable& job_table() noexcept;
+}
+#endif
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+
+#include <sstream>
+
+#include "job_table.h"
+#include "shell.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   bool has_zombies();
+
+   TEST( JobTable, WaitReturnsTheStatusOfTheLastStage ) {
+      shell_state state;
+
+      parse_command( "true | false &", state );
+      state.action->execute();
+
+      EXPECT_EQ( W_EXITCODE( 1, 0 ), job_table().wait( job_table().size() ) );
+      EXPECT_FALSE( has_zombies() );
+   }
+
+   TEST( JobTable, WaitForAReapedPidReturnsItsStatus ) {
+      pid_t child;
+
+      if ( ( child = fork() ) == 0 )
+         _exit( 3 );
+
+      job_table().add( { child }, 0, "exit 3 &", false );
+      usleep( 100000 );
+      job_table().reap();
+
+      EXPECT_EQ( W_EXITCODE( 3, 0 ), job_table().wait_pid( child ) );
+      EXPECT_EQ( W_EXITCODE( 127, 0 ), job_table().wait_pid( child ) );   // Forgotten once it has been waited for.
+   }
+
+   TEST( JobTable, ThousandsOfBackgroundPipelinesAreReaped ) {
+      shell_state state;
+      size_t most = 0;
+
+      parse_command( "true | true &", state );
+      for ( int i = 0; i < 2000; ++i ) {
+         state.action->execute();
+         job_table().reap();
+         job_table().notify( std::cerr, false );
+         most = std::max( most, job_table().size() );
+      }
+
+      EXPECT_GT( 2000u, most );                            // Some must have been collected along the way.
+      EXPECT_EQ( 0, job_table().wait( 0 ) );
+      EXPECT_EQ( 0u, job_table().size() );
+      EXPECT_FALSE( has_zombies() );
+   }
+
+   TEST( JobTable, OtherChildrenAreLeftAlone ) {
+      shell_state state;
+      int status = 0;
+      pid_t other;
+
+      if ( ( other = fork() ) == 0 )
+         _exit( 3 );
+
+      parse_command( "sleep 0.1 &", state );
+      state.action->execute();
+      usleep( 300000 );
+      job_table().reap();
+
+      std::ostringstream out;
+      job_table().print( out );
+      EXPECT_EQ( "[1]  Done\t\tsleep 0.1 &\n", out.str() );
+      EXPECT_EQ( other, waitpid( other, &status, 0 ) );
+      EXPECT_EQ( W_EXITCODE( 3, 0 ), status );
+   }
+
+   bool has_zombies() {
+      siginfo_t ready;
+
+      ready.si_pid = 0;
+      return waitid( P_ALL, 0, &ready, WEXITED | WNOHANG | WNOWAIT ) == 0 && ready.si_pid != 0;
+   }
+}
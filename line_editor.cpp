@@ -0,0 +1,401 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "line_editor.h"
+#include "history.h"
+#include "completion.h"
+
+#include <vector>
+
+namespace shell
+{
+   static void write_all( int fd, std::string_view text ) noexcept
+   {
+      ssize_t n;
+
+      while ( !text.empty() ) {
+         if ( ( n = write( fd, text.data(), text.size() ) ) < 0 ) {
+            if ( errno == EINTR )
+               continue;
+            return;
+         }
+         text.remove_prefix( n );
+      }
+   }
+
+   static bool is_continuation( char c ) noexcept
+   {
+      return ( static_cast< unsigned char >( c ) & 0xc0 ) == 0x80;  // The cursor steps over whole UTF-8 characters.
+   }
+
+   LineEditor::LineEditor( int in, int out, History& entries ) noexcept
+      : in( in ), out( out ), entries( entries )
+   {
+      is_terminal = tcgetattr( in, &cooked ) == 0;
+   }
+
+   // Lets something else get done while the shell would otherwise sit in read(2), like reaping children at the prompt.
+   void LineEditor::watch( int fd, void (*on_ready)() ) noexcept
+   {
+      watched = fd;
+      on_watched_ready = on_ready;
+   }
+
+   // False at the end of the input, or on Ctrl-D at an empty line.
+   bool LineEditor::read_line( std::string_view prompt, std::string& result ) noexcept
+   {
+      struct termios raw;
+      std::string draft;                                   // What was typed before the arrows went into the history.
+      size_t age = 0;
+      bool browsing = false, done = false, more = true, tabbed = false, again;
+      char c;
+
+      entries.refresh();                                   // Whatever the other shells added in the meantime.
+      line.clear();
+      cursor = 0;
+      if ( is_terminal && tcgetattr( in, &cooked ) == 0 ) {
+         raw = cooked;
+         raw.c_iflag &= ~( ICRNL | INLCR | IXON );
+         raw.c_lflag &= ~( ICANON | ECHO | ISIG | IEXTEN );
+         raw.c_cc[ VMIN ] = 1;
+         raw.c_cc[ VTIME ] = 0;
+         tcsetattr( in, TCSADRAIN, &raw );
+      }
+
+      while ( !done ) {
+         redraw( prompt );
+         if ( !next_byte( c ) ) {
+            more = !line.empty();                            // The last line without a newline.
+            break;
+         }
+         if ( c == 0x12 && !search_history( c ) )          // Ctrl-R hands back the key that ended the search.
+            continue;
+         again = tabbed && c == '\t';
+         tabbed = c == '\t';
+         if ( c == 0x1b ) {                                 // The keys we know send escape sequences, mapped onto control keys.
+            char kind, final = 0, parameter = 0;
+            if ( !next_byte( kind ) )
+               continue;
+            if ( kind == '[' || kind == 'O' ) {
+               while ( next_byte( final ) && final >= '0' && final <= '9' )
+                  parameter = final;
+            }
+            switch ( final ) {
+               case 'A': c = 0x10; break;
+               case 'B': c = 0x0e; break;
+               case 'C': c = 0x06; break;
+               case 'D': c = 0x02; break;
+               case 'H': c = 0x01; break;
+               case 'F': c = 0x05; break;
+               case '~':
+                  c = parameter == '3' ? 0x7e                // Del
+                    : parameter == '1' || parameter == '7' ? 0x01
+                    : parameter == '4' || parameter == '8' ? 0x05
+                    : 0;
+                  break;
+               default: c = 0; break;
+            }
+            if ( c == 0x7e ) {
+               if ( cursor < line.size() ) {
+                  size_t from = cursor;
+                  move_right();
+                  line.erase( from, cursor - from );
+                  cursor = from;
+               }
+               browsing = false;
+               continue;
+            }
+         }
+
+         switch ( c ) {
+            case '\r':
+            case '\n':
+               done = true;
+               break;
+            case 0x01:                                      // Ctrl-A
+               cursor = 0;
+               break;
+            case 0x05:                                      // Ctrl-E
+               cursor = line.size();
+               break;
+            case 0x02:                                      // Ctrl-B
+               move_left();
+               break;
+            case 0x06:                                      // Ctrl-F
+               move_right();
+               break;
+            case 0x10:                                      // Ctrl-P, up
+            case 0x0e:                                      // Ctrl-N, down
+               if ( !browsing )
+                  draft = line;
+               step_through_history( draft, age, browsing, c == 0x10 );
+               break;
+            case 0x7f:
+            case 0x08: {                                    // Backspace
+               size_t to = cursor;
+               move_left();
+               line.erase( cursor, to - cursor );
+               browsing = false;
+               break;
+            }
+            case 0x04:                                      // Ctrl-D
+               if ( line.empty() ) {
+                  more = false;
+                  done = true;
+               }
+               else if ( cursor < line.size() ) {
+                  size_t from = cursor;
+                  move_right();
+                  line.erase( from, cursor - from );
+                  cursor = from;
+                  browsing = false;
+               }
+               break;
+            case 0x0b:                                      // Ctrl-K
+               line.erase( cursor );
+               browsing = false;
+               break;
+            case 0x15:                                      // Ctrl-U
+               line.erase( 0, cursor );
+               cursor = 0;
+               browsing = false;
+               break;
+            case 0x17: {                                    // Ctrl-W, back to the start of the word.
+               size_t to = cursor;
+               while ( cursor > 0 && line[ cursor - 1 ] == ' ' )
+                  cursor--;
+               while ( cursor > 0 && line[ cursor - 1 ] != ' ' )
+                  cursor--;
+               line.erase( cursor, to - cursor );
+               browsing = false;
+               break;
+            }
+            case '\t':
+               complete( again );
+               browsing = false;
+               break;
+            case 0x0c:                                      // Ctrl-L
+               write_all( out, "\x1b[H\x1b[2J" );
+               break;
+            case 0x03:                                      // Ctrl-C, a fresh line.
+               write_all( out, "^C\r\n" );
+               line.clear();
+               cursor = 0;
+               browsing = false;
+               break;
+            default:
+               if ( static_cast< unsigned char >( c ) >= 0x20 ) {
+                  line.insert( cursor++, 1, c );
+                  browsing = false;
+               }
+               break;
+         }
+      }
+
+      if ( is_terminal )
+         tcsetattr( in, TCSADRAIN, &cooked );
+      write_all( out, "\n" );
+
+      result = line;
+      return more;
+   }
+
+   bool LineEditor::next_byte( char& c ) noexcept
+   {
+      struct pollfd fds[2] = { { in, POLLIN, 0 }, { watched, POLLIN, 0 } };
+      char buffer[ 256 ];
+      ssize_t n;
+
+      while ( pending.empty() ) {
+         if ( watched >= 0 ) {
+            if ( poll( fds, 2, -1 ) < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               return false;
+            }
+            if ( fds[1].revents & POLLIN )
+               on_watched_ready();
+            if ( !fds[0].revents )
+               continue;
+         }
+         if ( ( n = read( in, buffer, sizeof( buffer ) ) ) < 0 && errno == EINTR )
+            continue;
+         if ( n <= 0 )
+            return false;
+         pending.assign( buffer, n );                       // A paste arrives in one read, not one per key.
+      }
+
+      c = pending.front();
+      pending.erase( 0, 1 );
+      return true;
+   }
+
+   // Rewrites the line in place: back to the start, prompt and line, clear the rest, then the cursor back to
+   // where it belongs. That way the width of the prompt, escape codes and all, never has to be known.
+   void LineEditor::redraw( std::string_view prompt ) noexcept
+   {
+      std::string screen;
+      size_t back = 0;
+
+      for ( size_t at = cursor; at < line.size(); ++at )
+         back += !is_continuation( line[ at ] );
+
+      screen.reserve( prompt.size() + line.size() + 16 );
+      screen += '\r';
+      screen += prompt;
+      screen += line;
+      screen += "\x1b[K";
+      if ( back > 0 )
+         screen += "\x1b[" + std::to_string( back ) + "D";
+
+      write_all( out, screen );
+   }
+
+   void LineEditor::show( std::string_view text ) noexcept
+   {
+      line.assign( text );
+      cursor = line.size();
+   }
+
+   void LineEditor::move_left() noexcept
+   {
+      while ( cursor > 0 && is_continuation( line[ --cursor ] ) )
+         ;
+   }
+
+   void LineEditor::move_right() noexcept
+   {
+      if ( cursor < line.size() )
+         cursor++;
+      while ( cursor < line.size() && is_continuation( line[ cursor ] ) )
+         cursor++;
+   }
+
+   // The next entry, older or newer, that starts with what was typed and isn't what is shown already. Newer than
+   // the newest is what was typed.
+   bool LineEditor::step_through_history( std::string_view prefix, size_t& age, bool& browsing, bool older ) noexcept
+   {
+      std::string_view found;
+      size_t at;
+
+      if ( !older && !browsing )
+         return false;
+      if ( !older && age == 0 ) {
+         show( prefix );
+         browsing = false;
+         return true;
+      }
+
+      at = !browsing ? 0 : older ? age + 1 : age - 1;
+      while ( entries.search( prefix, false, at, older ) ) {
+         entries.entry( at, found );
+         if ( found != line ) {
+            show( found );
+            age = at;
+            browsing = true;
+            return true;
+         }
+         if ( !older && at == 0 )
+            break;
+         at = older ? at + 1 : at - 1;
+      }
+
+      if ( !older ) {
+         show( prefix );
+         browsing = false;
+         return true;
+      }
+      return false;
+   }
+
+   // Takes the word before the cursor as far as every candidate agrees, with a space after a lone command or
+   // file. When that adds nothing, the second Tab lists the candidates under the line.
+   void LineEditor::complete( bool list ) noexcept
+   {
+      std::vector< std::string > candidates;
+      std::string common, listing;
+      size_t start, name_at;
+
+      if ( !completions || !completions->complete( line, cursor, start, candidates ) )
+         return;
+
+      common = candidates.front();
+      for ( const std::string& candidate : candidates ) {
+         size_t same = 0;
+         while ( same < common.size() && same < candidate.size() && common[ same ] == candidate[ same ] )
+            same++;
+         common.resize( same );
+      }
+      if ( candidates.size() == 1 && common.back() != '/' )
+         common += ' ';
+
+      if ( common.size() > cursor - start ) {
+         line.replace( start, cursor - start, common );
+         cursor = start + common.size();
+         return;
+      }
+      if ( !list || candidates.size() == 1 )
+         return;
+
+      name_at = line.rfind( '/', cursor - 1 );                // Paths are listed by their names only.
+      name_at = name_at == std::string::npos || name_at < start ? 0 : name_at + 1 - start;
+      listing = "\r\n";
+      for ( const std::string& candidate : candidates ) {
+         listing += candidate.substr( name_at );
+         listing += "  ";
+      }
+      listing += "\r\n";
+      write_all( out, listing );
+   }
+
+   // Ctrl-R: every key typed narrows the search, Ctrl-R again goes on to the next older match. Ctrl-G or Ctrl-C
+   // put the line back as it was; any other key keeps the match and is handled as usual. Returns whether there
+   // is such a key left in key.
+   bool LineEditor::search_history( char& key ) noexcept
+   {
+      std::string query, original = line, screen;
+      std::string_view match;
+      size_t age = 0, at;
+      bool found = true;
+
+      for ( ;; ) {
+         screen = found ? "\r(reverse-i-search)'" : "\r(failed reverse-i-search)'";
+         screen += query;
+         screen += "': ";
+         screen += line;
+         screen += "\x1b[K";
+         write_all( out, screen );
+
+         if ( !next_byte( key ) )
+            return false;
+
+         if ( key == 0x12 ) {
+            at = found ? age + 1 : age;
+         }
+         else if ( key == 0x7f || key == 0x08 ) {
+            if ( !query.empty() )
+               query.pop_back();
+            at = 0;
+         }
+         else if ( key == 0x07 || key == 0x03 ) {
+            show( original );
+            return false;
+         }
+         else if ( static_cast< unsigned char >( key ) >= 0x20 ) {
+            query += key;
+            at = age;
+         }
+         else {
+            cursor = line.size();
+            return true;
+         }
+
+         if ( ( found = entries.search( query, true, at ) ) ) {
+            age = at;
+            entries.entry( age, match );
+            show( match );
+         }
+      }
+   }
+}
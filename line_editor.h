@@ -0,0 +1,51 @@
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <termios.h>
+
+#include <string>
+#include <string_view>
+
+namespace shell
+{
+   class History;
+   class Completer;
+
+   // Reads a line from the terminal with the usual emacs-style editing keys, the arrows, and two ways into the
+   // history: the up and down arrows step through the entries that start with what was typed so far, and Ctrl-R
+   // searches them incrementally for what is typed after it. Tab completes the word before the cursor, as far
+   // as the candidates agree; Tab again lists them.
+   //
+   // The terminal is only in raw mode while a line is being read; children always find it as the shell did.
+   // Input that isn't a terminal is edited just the same, without the mode switch, which is what the tests use.
+   class LineEditor
+   {
+   private:
+      int in, out;
+      History& entries;
+      Completer* completions = nullptr;
+      struct termios cooked;
+      bool is_terminal;
+      std::string line;
+      size_t cursor = 0;                                   // Byte offset into line.
+      std::string pending;                                 // Read from the terminal, not handled yet.
+      int watched = -1;                                    // Serviced while we block waiting for input.
+      void (*on_watched_ready)() = nullptr;
+      bool next_byte( char& c ) noexcept;
+      void redraw( std::string_view prompt ) noexcept;
+      void show( std::string_view text ) noexcept;
+      void move_left() noexcept;
+      void move_right() noexcept;
+      bool step_through_history( std::string_view prefix, size_t& age, bool& browsing, bool older ) noexcept;
+      bool search_history( char& key ) noexcept;
+      void complete( bool list ) noexcept;
+   public:
+      LineEditor( int in, int out, History& entries ) noexcept;
+      LineEditor( const LineEditor& ) = delete;
+      LineEditor& operator=( const LineEditor& ) = delete;
+      bool read_line( std::string_view prompt, std::string& result ) noexcept;
+      void watch( int fd, void (*on_ready)() ) noexcept;
+      void complete_with( Completer& completer ) noexcept { completions = &completer; }
+   };
+}
+#endif
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "completion.h"
+#include "history.h"
+#include "line_editor.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* history_file = "/tmp/shelltest-editor-history";
+
+   // Feeds the keys to an editor through a pipe, and returns the lines it reads until the keys run out.
+   std::vector< std::string > edit( const std::string& keys, Completer* completer = nullptr );
+
+   TEST( LineEditor, Editing ) {
+      std::vector< std::string > expected = { "echo hello" };
+      EXPECT_EQ( expected, edit( "echo hello\r" ) );
+
+      expected = { "echo hello" };
+      EXPECT_EQ( expected, edit( "echo helo\x1b[Dl\r" ) );   // Left arrow, then insert.
+
+      expected = { "Xecho" };
+      EXPECT_EQ( expected, edit( "echo\x01X\r" ) );            // Ctrl-A
+
+      expected = { "ech" };
+      EXPECT_EQ( expected, edit( "echo\x7f\r" ) );             // Backspace
+
+      expected = { "cho" };
+      EXPECT_EQ( expected, edit( "echo\x1b[H\x1b[3~\r" ) );    // Home, Del
+
+      expected = { "echo " };
+      EXPECT_EQ( expected, edit( "echo hello\x17\r" ) );      // Ctrl-W
+
+      expected = { "world" };
+      EXPECT_EQ( expected, edit( "hello\x15world\r" ) );       // Ctrl-U
+
+      expected = { "he" };
+      EXPECT_EQ( expected, edit( "hello\x02\x02\x02\x0b\r" ) ); // Ctrl-B, Ctrl-K
+
+      expected = { "\xc3\xa9t\xc3\xa9" };
+      EXPECT_EQ( expected, edit( "\xc3\xa9\xc3\xa9\x02t\r" ) ); // Whole characters.
+
+      expected = { "a", "b" };
+      EXPECT_EQ( expected, edit( "a\rdiscarded\x03" "b\r" ) );    // Ctrl-C
+
+      expected = {};
+      EXPECT_EQ( expected, edit( "\x04" "after the end\r" ) ); // Ctrl-D at an empty line.
+   }
+
+   TEST( LineEditor, UpAndDown ) {
+      std::vector< std::string > expected;
+
+      expected = { "make test" };
+      EXPECT_EQ( expected, edit( "\x1b[A\r" ) );
+
+      expected = { "make -j8" };
+      EXPECT_EQ( expected, edit( "\x1b[A\x1b[A\x1b[A\r" ) );
+
+      expected = { "git status" };
+      EXPECT_EQ( expected, edit( "\x1b[A\x1b[A\x1b[A\x1b[A\x1b[A\x1b[A\x1b[A\r" ) );  // Stays at the oldest.
+
+      expected = { "make -j8" };
+      EXPECT_EQ( expected, edit( "ma\x1b[A\x1b[A\r" ) );      // Only what starts with "ma".
+
+      expected = { "make test" };
+      EXPECT_EQ( expected, edit( "ma\x1b[A\x1b[A\x1b[B\r" ) );
+
+      expected = { "ma" };
+      EXPECT_EQ( expected, edit( "ma\x1b[A\x1b[B\r" ) );      // Back to what was typed.
+
+      expected = { "make test -v" };
+      EXPECT_EQ( expected, edit( "\x10 -v\r" ) );              // Ctrl-P, then edit the entry.
+   }
+
+   TEST( LineEditor, ReverseSearch ) {
+      std::vector< std::string > expected;
+
+      expected = { "git status" };
+      EXPECT_EQ( expected, edit( "\x12stat\r" ) );
+
+      expected = { "make -j8" };
+      EXPECT_EQ( expected, edit( "\x12make\x12\r" ) );         // The next older match.
+
+      expected = { "make test --keep" };
+      EXPECT_EQ( expected, edit( "\x12mak\x05 --keep\r" ) );   // Ctrl-E leaves the search with the match.
+
+      expected = { "typed" };
+      EXPECT_EQ( expected, edit( "typed\x12make\x07\r" ) );    // Ctrl-G puts the line back.
+   }
+
+   TEST( LineEditor, TabCompletion ) {
+      Completer completer;
+      std::vector< std::string > expected;
+
+      expected = { "cat ../test-dir/" };
+      EXPECT_EQ( expected, edit( "cat ../test-d\t\r", &completer ) );
+
+      expected = { "cat ../test-dir/3 " };
+      EXPECT_EQ( expected, edit( "cat ../test-dir/3\t\r", &completer ) );
+
+      expected = { "cat ../test-dir/ | wc" };
+      EXPECT_EQ( expected, edit( "cat ../test-d | wc\x01\x06\x06\x06\x06\x06\x06\x06\x06\x06\x06\x06\x06\x06\t\r", &completer ) );  // In the middle of the line.
+
+      expected = { "cat ../test-dir/" };
+      EXPECT_EQ( expected, edit( "cat ../test-dir/\t\t\r", &completer ) );  // Lists, and leaves the line alone.
+
+      expected = { "cat" };
+      EXPECT_EQ( expected, edit( "cat\t\r" ) );                     // Nothing to complete with.
+   }
+
+   //////////////// HELPERS
+
+   std::vector< std::string > edit( const std::string& keys, Completer* completer ) {
+      std::vector< std::string > lines;
+      std::string line;
+      int fds[2], out = open( "/dev/null", O_WRONLY | O_CLOEXEC ), fd;
+      History entries;
+
+      fd = open( history_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+      write( fd, "git status\nmake -j8\nls\nmake test\n", 33 );
+      close( fd );
+      entries.open( history_file );
+
+      pipe2( fds, O_CLOEXEC );
+      write( fds[1], keys.data(), keys.size() );
+      close( fds[1] );
+
+      LineEditor editor( fds[0], out, entries );
+      if ( completer )
+         editor.complete_with( *completer );
+      while ( editor.read_line( "$ ", line ) )
+         lines.push_back( line );
+
+      close( fds[0] );
+      close( out );
+      unlink( history_file );
+      return lines;
+   }
+}
@@ -0,0 +1,87 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "line_reader.h"
+
+namespace shell {
+   extern int run_script( const char* path );
+}
+
+using namespace shell;
+
+namespace {
+   const char* script = "/tmp/shellbench-script.sh";
+
+   // A generated script of builtins, so running it measures the shell and not the commands.
+   void generate_script( int lines ) {
+      std::ofstream out( script );
+
+      for ( int i = 0; i < lines; ++i )
+         out << ( i % 2 ? "cd ." : "hash -r" ) << "   \n";
+   }
+
+   void read_mapped( benchmark::State& st ) {
+      std::string_view line;
+      size_t bytes = 0;
+
+      generate_script( st.range( 0 ) );
+      for ( auto _ : st ) {
+         LineReader reader( open( script, O_RDONLY | O_CLOEXEC ), true );
+         while ( reader.next_line( line ) )
+            bytes += line.size();
+      }
+      benchmark::DoNotOptimize( bytes );
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   void read_chunked( benchmark::State& st ) {
+      std::string_view line;
+      size_t bytes = 0;
+      int fd;
+
+      generate_script( st.range( 0 ) );
+      for ( auto _ : st ) {
+         fd = open( script, O_RDONLY | O_CLOEXEC );
+         {
+            LineReader reader( fd );
+            while ( reader.next_line( line ) ) {
+               bytes += line.size();
+               reader.release_input();                      // What the shell does before each external command.
+            }
+         }
+         close( fd );
+      }
+      benchmark::DoNotOptimize( bytes );
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   void read_getline( benchmark::State& st ) {
+      std::string line;
+      size_t bytes = 0;
+
+      generate_script( st.range( 0 ) );
+      for ( auto _ : st ) {
+         std::ifstream in( script );
+         while ( std::getline( in, line ) )
+            bytes += line.size();
+      }
+      benchmark::DoNotOptimize( bytes );
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   void run_generated_script( benchmark::State& st ) {
+      generate_script( st.range( 0 ) );
+      for ( auto _ : st )
+         run_script( script );
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   BENCHMARK( read_mapped )->Arg( 100000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( read_chunked )->Arg( 100000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( read_getline )->Arg( 100000 )->Unit( benchmark::kMillisecond );
+   BENCHMARK( run_generated_script )->Arg( 100000 )->Unit( benchmark::kMillisecond );
+}
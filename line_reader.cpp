@@ -0,0 +1,198 @@
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "line_reader.h"
+
+namespace shell
+{
+   LineReader::LineReader( int fd, bool owns_fd ) noexcept
+      : fd( fd ), owns_fd( owns_fd )
+   {
+      struct stat st;
+      void* mapped;
+
+      if ( owns_fd && fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+         mapped = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+         if ( mapped != MAP_FAILED ) {
+            madvise( mapped, st.st_size, MADV_SEQUENTIAL );
+            map = static_cast< const char* >( mapped );
+            map_size = st.st_size;
+            how = mode::mapped;
+            return;
+         }
+      }
+
+      if ( ( buffer_end_offset = lseek( fd, 0, SEEK_CUR ) ) >= 0 || isatty( fd ) ) {
+         buffer.resize( chunk_size );                       // A terminal hands out at most one line per read anyway.
+         how = mode::chunked;
+      }
+      else {
+         how = mode::unbuffered;
+      }
+   }
+
+   LineReader::~LineReader() noexcept
+   {
+      if ( map )
+         munmap( const_cast< char* >( map ), map_size );
+      if ( owns_fd )
+         close( fd );
+   }
+
+   bool LineReader::next_line( std::string_view& result ) noexcept
+   {
+      switch ( how ) {
+         case mode::mapped:
+            return next_mapped_line( result );
+         case mode::chunked:
+            return next_chunked_line( result );
+         default:
+            return next_unbuffered_line( result );
+      }
+   }
+
+   // Puts the fd where the next unconsumed line starts, so a child reading it carries on where we stopped.
+   void LineReader::release_input() noexcept
+   {
+      if ( how != mode::chunked || buffer_end_offset < 0 || released )
+         return;
+
+      lseek( fd, buffer_end_offset - ( buffer_end - buffer_begin ), SEEK_SET );
+      released = true;
+   }
+
+   // Lets something else get done while the shell would otherwise sit in read(2), like reaping children at the prompt.
+   void LineReader::watch( int fd, void (*on_ready)() ) noexcept
+   {
+      watched = fd;
+      on_watched_ready = on_ready;
+   }
+
+   void LineReader::wait_for_input() noexcept
+   {
+      struct pollfd fds[2] = { { fd, POLLIN, 0 }, { watched, POLLIN, 0 } };
+
+      if ( watched < 0 )
+         return;
+
+      for ( ;; ) {
+         if ( poll( fds, 2, -1 ) < 0 ) {
+            if ( errno == EINTR )
+               continue;
+            return;
+         }
+         if ( fds[1].revents & POLLIN )
+            on_watched_ready();
+         if ( fds[0].revents )
+            return;                                         // Input, or an error or hangup that read(2) will report.
+      }
+   }
+
+   bool LineReader::next_mapped_line( std::string_view& result ) noexcept
+   {
+      const char* newline;
+
+      if ( map_position >= map_size )
+         return false;
+
+      newline = static_cast< const char* >( memchr( map + map_position, '\n', map_size - map_position ) );
+      if ( newline == NULL )
+         newline = map + map_size;
+
+      result = std::string_view( map + map_position, newline - ( map + map_position ) );
+      map_position = newline - map + 1;
+
+      return true;
+   }
+
+   bool LineReader::fill() noexcept
+   {
+      ssize_t n;
+
+      if ( buffer_begin > 0 ) {                             // Keep the partial line, drop what was handed out already.
+         memmove( buffer.data(), buffer.data() + buffer_begin, buffer_end - buffer_begin );
+         buffer_end -= buffer_begin;
+         buffer_begin = 0;
+      }
+      if ( buffer_end == buffer.size() )
+         buffer.resize( buffer.size() * 2 );                 // A line longer than the buffer.
+
+      wait_for_input();
+      do {
+         n = read( fd, buffer.data() + buffer_end, buffer.size() - buffer_end );
+      } while ( n < 0 && errno == EINTR );
+
+      if ( n <= 0 )
+         return false;
+
+      buffer_end += n;
+      if ( buffer_end_offset >= 0 )
+         buffer_end_offset += n;
+
+      return true;
+   }
+
+   bool LineReader::next_chunked_line( std::string_view& result ) noexcept
+   {
+      size_t scanned = buffer_begin;
+      const char* newline;
+      off_t now;
+
+      if ( released ) {
+         released = false;
+         now = lseek( fd, 0, SEEK_CUR );
+         if ( now == buffer_end_offset - (off_t)( buffer_end - buffer_begin ) ) {
+            lseek( fd, buffer_end_offset, SEEK_SET );        // Nobody read from it, the buffer is still good.
+         }
+         else {
+            buffer_begin = buffer_end = scanned = 0;
+            buffer_end_offset = now;
+         }
+      }
+
+      for ( ;; ) {
+         newline = static_cast< const char* >( memchr( buffer.data() + scanned, '\n', buffer_end - scanned ) );
+         if ( newline ) {
+            result = std::string_view( buffer.data() + buffer_begin, newline - ( buffer.data() + buffer_begin ) );
+            buffer_begin = newline - buffer.data() + 1;
+            return true;
+         }
+
+         scanned = buffer_end - buffer_begin;                // Offsets shift to 0 when fill() compacts the buffer.
+         if ( !fill() ) {
+            if ( buffer_begin == buffer_end )
+               return false;
+            result = std::string_view( buffer.data() + buffer_begin, buffer_end - buffer_begin );
+            buffer_begin = buffer_end;                       // Last line without a newline.
+            return true;
+         }
+      }
+   }
+
+   bool LineReader::next_unbuffered_line( std::string_view& result ) noexcept
+   {
+      char c;
+      ssize_t n;
+
+      line.clear();
+      for ( ;; ) {
+         wait_for_input();
+         n = read( fd, &c, 1 );
+         if ( n < 0 && errno == EINTR )
+            continue;
+         if ( n <= 0 ) {
+            result = line;
+            return !line.empty();
+         }
+         if ( c == '\n' ) {
+            result = line;
+            return true;
+         }
+         line.push_back( c );
+      }
+   }
+}
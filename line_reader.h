@@ -0,0 +1,49 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <sys/types.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace shell
+{
+   // Splits an fd into lines without going through iostreams.
+   //
+   // Script files are mapped in one go. Other seekable input is read in large chunks, and release_input()
+   // seeks the fd back to the first unconsumed byte before a child gets to share it. Pipes can't be
+   // seeked back, so they are read a byte at a time: whatever we don't use stays for the child.
+   class LineReader
+   {
+   private:
+      enum class mode { mapped, chunked, unbuffered };
+      int fd;
+      bool owns_fd;
+      mode how;
+      const char* map = nullptr;                           // Mapped scripts.
+      size_t map_size = 0, map_position = 0;
+      std::vector< char > buffer;                          // Chunked input.
+      size_t buffer_begin = 0, buffer_end = 0;
+      off_t buffer_end_offset = 0;                         // File offset just past buffer_end.
+      bool released = false;
+      std::string line;                                    // Unbuffered input.
+      int watched = -1;                                    // Serviced while we block waiting for input.
+      void (*on_watched_ready)() = nullptr;
+      void wait_for_input() noexcept;
+      bool fill() noexcept;
+      bool next_mapped_line( std::string_view& result ) noexcept;
+      bool next_chunked_line( std::string_view& result ) noexcept;
+      bool next_unbuffered_line( std::string_view& result ) noexcept;
+   public:
+      static const size_t chunk_size = 64 * 1024;
+      LineReader( int fd, bool owns_fd = false ) noexcept;
+      ~LineReader() noexcept;
+      LineReader( const LineReader& ) = delete;
+      LineReader& operator=( const LineReader& ) = delete;
+      bool next_line( std::string_view& result ) noexcept;
+      void release_input() noexcept;
+      void watch( int fd, void (*on_ready)() ) noexcept;
+   };
+}
+#endif
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "line_reader.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   int scratch_file( std::string content );
+   std::vector< std::string > read_lines( LineReader& reader );
+
+   TEST( LineReader, MappedScript ) {
+      LineReader reader( scratch_file( "ls\n\ncat < 1\nexit" ), true );
+      std::vector< std::string > expected_lines = { "ls", "", "cat < 1", "exit" };
+
+      EXPECT_EQ( expected_lines, read_lines( reader ) );
+   }
+
+   TEST( LineReader, ChunkedLinesLongerThanAChunk ) {
+      std::string long_line( 3 * LineReader::chunk_size + 5, 'x' );
+      int fd = scratch_file( "first\n" + long_line + "\nlast\n" );
+      LineReader reader( fd );
+      std::vector< std::string > expected_lines = { "first", long_line, "last" };
+
+      EXPECT_EQ( expected_lines, read_lines( reader ) );
+      close( fd );
+   }
+
+   TEST( LineReader, ReleaseInputRewindsToTheNextLine ) {
+      int fd = scratch_file( "one\ntwo\nthree\n" );
+      LineReader reader( fd );
+      std::string_view line;
+      char c;
+
+      ASSERT_TRUE( reader.next_line( line ) );
+      EXPECT_EQ( "one", line );
+
+      reader.release_input();
+      ASSERT_EQ( 1, read( fd, &c, 1 ) );                     // A child consumes a byte of "two".
+      EXPECT_EQ( 't', c );
+
+      ASSERT_TRUE( reader.next_line( line ) );
+      EXPECT_EQ( "wo", line );
+
+      reader.release_input();                               // Nobody reads this time, the buffer is reused.
+      ASSERT_TRUE( reader.next_line( line ) );
+      EXPECT_EQ( "three", line );
+      EXPECT_FALSE( reader.next_line( line ) );
+      close( fd );
+   }
+
+   TEST( LineReader, PipesAreNotReadAhead ) {
+      int fds[2];
+      std::string_view line;
+      char rest[16] = {};
+
+      ASSERT_EQ( 0, pipe( fds ) );
+      write( fds[1], "one\ntwo\n", 8 );
+      close( fds[1] );
+
+      LineReader reader( fds[0] );
+      ASSERT_TRUE( reader.next_line( line ) );
+      EXPECT_EQ( "one", line );
+      EXPECT_EQ( 4, read( fds[0], rest, sizeof( rest ) ) );  // "two\n" is still in the pipe.
+      close( fds[0] );
+   }
+
+
+   //////////////// HELPERS
+
+   int scratch_file( std::string content ) {
+      char name[] = "/tmp/line-reader-XXXXXX";
+      int fd = mkstemp( name );
+      unlink( name );
+      write( fd, content.data(), content.size() );
+      lseek( fd, 0, SEEK_SET );
+      return fd;
+   }
+
+   std::vector< std::string > read_lines( LineReader& reader ) {
+      std::vector< std::string > lines;
+      std::string_view line;
+
+      while ( reader.next_line( line ) )
+         lines.emplace_back( line );
+      return lines;
+   }
+}
@@ -1,9 +1,20 @@
+#include <string.h>
+#include <unistd.h>
+
 namespace shell { 
    extern int run_shell( bool prompt ); 
+   extern int run_script( const char* path ); 
+   extern int serve( const char* path ) noexcept;
 }
 
 int main( int argc, char** argv ) {
-    bool show_prompt = argc == 1;
+    bool show_prompt = argc == 1 && isatty( STDIN_FILENO );
+
+    if ( argc > 2 && strcmp( argv[1], "--serve" ) == 0 )   // shell --serve /path/to/socket
+        return shell::serve( argv[2] );
+
+    if ( argc > 1 && strcmp( argv[1], "-t" ) != 0 )         // shell script.sh
+        return shell::run_script( argv[1] );
 
     return shell::run_shell( show_prompt );
 }
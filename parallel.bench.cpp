@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace shell;
+
+namespace {
+   // A few milliseconds of CPU per job, so the pool has something to spread over the cores.
+   const char* busy_loop = "i=0; while [ $i -lt {} ]; do i=$((i+1)); done; echo $i";
+
+   // Args: slots (0 for one per CPU), number of jobs. One slot is the serial baseline.
+   void parallel_jobs( benchmark::State& st ) {
+      unsigned slots = st.range( 0 ) ? st.range( 0 ) : ParallelRunner::default_slots();
+      std::vector< std::string_view > inputs( st.range( 1 ), "20000" );
+      std::vector< int > statuses;
+      int null = open( "/dev/null", O_WRONLY | O_CLOEXEC );
+
+      for ( auto _ : st ) {
+         ParallelRunner runner( { "sh", "-c", busy_loop }, slots, null );
+         runner.run( inputs, statuses );
+      }
+
+      close( null );
+      st.counters[ "slots" ] = slots;
+      st.counters[ "per_job" ] = benchmark::Counter( st.iterations() * inputs.size(), benchmark::Counter::kIsRate | benchmark::Counter::kInvert );
+   }
+
+   BENCHMARK( parallel_jobs )
+      ->ArgsProduct( { { 1, 0 }, { 32 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMillisecond );
+}
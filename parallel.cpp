@@ -0,0 +1,198 @@
+#include <errno.h>
+#include <sched.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "parallel.h"
+#include "command_hash.h"
+#include "job_table.h"
+#include "process_waiter.h"
+#include "trace.h"
+#include "transfer.h"
+
+namespace shell
+{
+   // The CPUs we may actually run on, which can be fewer than the machine has.
+   unsigned ParallelRunner::default_slots() noexcept
+   {
+      cpu_set_t cpus;
+
+      if ( sched_getaffinity( 0, sizeof( cpus ), &cpus ) == 0 && CPU_COUNT( &cpus ) > 0 )
+         return CPU_COUNT( &cpus );
+
+      return std::max( 1u, std::thread::hardware_concurrency() );
+   }
+
+   ParallelRunner::ParallelRunner( std::vector< std::string > command, unsigned slots, int out_fd ) noexcept
+      : command( std::move( command ) ), slots( std::max( 1u, slots ) ), out_fd( out_fd )
+   {
+      const char* resolved = this->command.empty() ? nullptr : command_hash().lookup( this->command.front() );
+
+      if ( resolved )
+         path = resolved;                                   // lookup() may hand out a buffer it reuses.
+      poller = epoll_create1( EPOLL_CLOEXEC );
+      in_order = poller < 0;
+   }
+
+   ParallelRunner::~ParallelRunner() noexcept
+   {
+      if ( poller >= 0 )
+         close( poller );
+   }
+
+   // Returns how many jobs failed, with the wait status of every job in statuses.
+   size_t ParallelRunner::run( const std::vector< std::string_view >& inputs, std::vector< int >& statuses ) noexcept
+   {
+      size_t next = 0, written = 0, failed = 0;
+
+      jobs.assign( inputs.size(), job() );
+      statuses.assign( inputs.size(), W_EXITCODE( 127, 0 ) );
+
+      if ( path.empty() ) {
+         if ( !command.empty() )
+            std::cerr << "parallel: " << command.front() << ": command not found\n";
+         return inputs.size();
+      }
+
+      while ( written < jobs.size() ) {
+         for ( ; running < slots && next < jobs.size(); ++next )
+            start( next, inputs[ next ] );
+         for ( ; written < next && jobs[ written ].done; ++written )
+            flush( written );                               // Output only leaves in input order.
+         if ( written < jobs.size() && running > 0 )
+            wait_for_any();
+      }
+
+      for ( size_t i = 0; i < jobs.size(); ++i ) {
+         statuses[i] = jobs[i].status;
+         if ( jobs[i].status != 0 )
+            failed++;
+      }
+
+      return failed;
+   }
+
+   void ParallelRunner::start( size_t index, std::string_view input ) noexcept
+   {
+      std::vector< std::string > args( command );
+      std::vector< char* > argv;
+      posix_spawn_file_actions_t actions;
+      posix_spawnattr_t attributes;
+      struct epoll_event event = {};
+      job& j = jobs[ index ];
+      bool placed = false;
+      size_t at;
+      int rc;
+
+      for ( std::string& arg : args ) {
+         for ( at = arg.find( "{}" ); at != std::string::npos; at = arg.find( "{}", at + input.size() ) ) {
+            arg.replace( at, 2, input );
+            placed = true;
+         }
+      }
+      if ( !placed )
+         args.emplace_back( input );
+      for ( std::string& arg : args )
+         argv.push_back( arg.data() );
+      argv.push_back( nullptr );
+
+      if ( ( j.output = memfd_create( "parallel", MFD_CLOEXEC ) ) < 0 ) {
+         std::cerr << "parallel: " << strerror( errno ) << "\n";
+         finish( index, W_EXITCODE( 127, 0 ) );
+         return;
+      }
+
+      posix_spawn_file_actions_init( &actions );
+      posix_spawnattr_init( &attributes );
+      posix_spawn_file_actions_adddup2( &actions, j.output, STDOUT_FILENO );
+      job_table().prepare_spawn( &attributes, &actions, -1, false );
+      rc = posix_spawn( &j.pid, path.c_str(), &actions, &attributes, argv.data(), environ );
+      posix_spawnattr_destroy( &attributes );
+      posix_spawn_file_actions_destroy( &actions );
+
+      if ( rc != 0 ) {
+         std::cerr << "parallel: " << command.front() << ": " << strerror( rc ) << "\n";
+         j.pid = -1;
+         finish( index, W_EXITCODE( 127, 0 ) );
+         return;
+      }
+      running++;
+      if ( tracer().enabled() )
+         tracer().process_started( j.pid, command.front() );
+
+      if ( in_order )
+         return;
+      if ( ( j.pidfd = open_pidfd( j.pid ) ) < 0 ) {
+         in_order = true;                                   // The jobs that do have one are reaped in order too.
+         return;
+      }
+      event.events = EPOLLIN;
+      event.data.u64 = index;
+      epoll_ctl( poller, EPOLL_CTL_ADD, j.pidfd, &event );
+   }
+
+   void ParallelRunner::finish( size_t index, int status ) noexcept
+   {
+      job& j = jobs[ index ];
+
+      if ( j.pidfd >= 0 ) {
+         close( j.pidfd );                                  // epoll forgets it with the last close.
+         j.pidfd = -1;
+      }
+      if ( j.pid > 0 ) {
+         running--;
+         if ( tracer().enabled() )
+            tracer().process_ended( j.pid, status );
+      }
+      j.status = status;
+      j.done = true;
+   }
+
+   void ParallelRunner::wait_for_any() noexcept
+   {
+      struct epoll_event events[ 16 ];
+      int n, status;
+
+      if ( in_order ) {
+         auto oldest = std::find_if( jobs.begin(), jobs.end(), []( const job& j ) { return j.pid > 0 && !j.done; } );
+         while ( waitpid( oldest->pid, &status, 0 ) < 0 ) {
+            if ( errno != EINTR ) {
+               status = W_EXITCODE( 127, 0 );
+               break;
+            }
+         }
+         finish( oldest - jobs.begin(), status );
+         return;
+      }
+
+      if ( ( n = epoll_wait( poller, events, 16, -1 ) ) < 0 )
+         return;                                            // EINTR, the caller comes straight back.
+
+      for ( int ready = 0; ready < n; ++ready ) {
+         size_t index = events[ ready ].data.u64;
+         if ( waitpid( jobs[ index ].pid, &status, WNOHANG ) > 0 )
+            finish( index, status );
+      }
+   }
+
+   void ParallelRunner::flush( size_t index ) noexcept
+   {
+      job& j = jobs[ index ];
+
+      if ( j.output < 0 )
+         return;
+
+      lseek( j.output, 0, SEEK_SET );                       // The job left the shared offset at the end.
+      transfer( j.output, out_fd );
+      close( j.output );
+      j.output = -1;
+   }
+}
@@ -0,0 +1,50 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <sys/types.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace shell
+{
+   // Runs one command per input, like `parallel cmd ::: inputs...`. Each input replaces the `{}` arguments of
+   // the command, or is appended when there are none. At most `slots` commands run at once.
+   //
+   // Every job writes its stdout to a memfd of its own, which is copied out in input order as soon as the
+   // jobs before it are done, so the output is the same as running them one after the other. Exits are
+   // picked up through pidfds in an epoll set; kernels without pidfd_open(2) wait for the oldest job instead.
+   class ParallelRunner
+   {
+   private:
+      struct job
+      {
+         pid_t pid = -1;
+         int pidfd = -1;
+         int output = -1;                                  // memfd
+         int status = 0;
+         bool done = false;
+      };
+      std::string path;                                    // Resolved once for all jobs.
+      std::vector< std::string > command;
+      unsigned slots;
+      int out_fd;
+      int poller = -1;                                     // epoll
+      std::vector< job > jobs;
+      size_t running = 0;
+      bool in_order = false;                               // No pidfds.
+      void start( size_t index, std::string_view input ) noexcept;
+      void finish( size_t index, int status ) noexcept;
+      void wait_for_any() noexcept;
+      void flush( size_t index ) noexcept;
+   public:
+      static unsigned default_slots() noexcept;
+      ParallelRunner( std::vector< std::string > command, unsigned slots, int out_fd ) noexcept;
+      ~ParallelRunner() noexcept;
+      ParallelRunner( const ParallelRunner& ) = delete;
+      ParallelRunner& operator=( const ParallelRunner& ) = delete;
+      size_t run( const std::vector< std::string_view >& inputs, std::vector< int >& statuses ) noexcept;
+   };
+}
+#endif
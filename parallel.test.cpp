@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <chrono>
+
+#include "parallel.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   std::string read_all( int fd );
+
+   TEST( Parallel, KeepsTheOutputInInputOrder ) {
+      std::vector< int > statuses;
+      int out[2];
+
+      ASSERT_EQ( 0, pipe( out ) );
+      ParallelRunner runner( { "sh", "-c", "sleep 0.{}; echo {}" }, 3, out[1] );
+      auto started = chrono::steady_clock::now();
+      EXPECT_EQ( 0u, runner.run( { "3", "1", "2" }, statuses ) );
+      auto took = chrono::steady_clock::now() - started;
+      close( out[1] );
+
+      EXPECT_EQ( "3\n1\n2\n", read_all( out[0] ) );
+      EXPECT_GT( chrono::milliseconds( 550 ), took );       // Together, not one after the other.
+      close( out[0] );
+   }
+
+   TEST( Parallel, AppendsTheInputWithoutAPlaceholder ) {
+      std::vector< int > statuses;
+      int out[2];
+
+      ASSERT_EQ( 0, pipe( out ) );
+      ParallelRunner runner( { "echo", "x" }, 2, out[1] );
+      EXPECT_EQ( 0u, runner.run( { "a", "b" }, statuses ) );
+      close( out[1] );
+
+      EXPECT_EQ( "x a\nx b\n", read_all( out[0] ) );
+      close( out[0] );
+   }
+
+   TEST( Parallel, CountsFailures ) {
+      ParallelRunner runner( { "sh", "-c", "exit {}" }, 2, STDOUT_FILENO );
+      std::vector< int > statuses;
+
+      EXPECT_EQ( 2u, runner.run( { "0", "1", "2" }, statuses ) );
+      EXPECT_EQ( std::vector< int >( { W_EXITCODE( 0, 0 ), W_EXITCODE( 1, 0 ), W_EXITCODE( 2, 0 ) } ), statuses );
+   }
+
+   TEST( Parallel, NeverRunsMoreThanItsSlots ) {
+      ParallelRunner runner( { "sleep" }, 2, STDOUT_FILENO );
+      std::vector< int > statuses;
+
+      auto started = chrono::steady_clock::now();
+      EXPECT_EQ( 0u, runner.run( { "0.2", "0.2", "0.2", "0.2" }, statuses ) );
+      EXPECT_LE( chrono::milliseconds( 400 ), chrono::steady_clock::now() - started );
+   }
+
+   TEST( Parallel, MissingCommand ) {
+      ParallelRunner runner( { "program-that-doesnt-exist" }, 2, STDOUT_FILENO );
+      std::vector< int > statuses;
+
+      EXPECT_EQ( 2u, runner.run( { "a", "b" }, statuses ) );
+      EXPECT_EQ( std::vector< int >( 2, W_EXITCODE( 127, 0 ) ), statuses );
+   }
+
+   //////////////// HELPERS
+
+   std::string read_all( int fd ) {
+      std::string text;
+      char buffer[ 4096 ];
+      ssize_t n;
+
+      while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+         text.append( buffer, n );
+
+      return text;
+   }
+}
@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+
+#include <memory_resource>
+#include <new>
+#include <string>
+
+#include "shell.h"
+
+using namespace shell;
+
+namespace {
+   thread_local size_t allocations = 0;                   // Heap allocations made by this thread, see operator new below.
+
+   // Arg: number of pipeline stages, each a command with a few arguments. One stage is a typical short line.
+   std::string line_of( int stages ) {
+      std::string line = "cat < input.txt";
+
+      for ( int i = 1; i < stages; ++i )
+         line += " | grep -v -i -e pattern-" + std::to_string( i );
+      return line + " > output.txt";
+   }
+
+   void parse_line( benchmark::State& st ) {
+      std::string line = line_of( st.range( 0 ) );
+      size_t before = allocations;
+
+      for ( auto _ : st ) {
+         shell_state state;
+         parse_command( line, state );
+         benchmark::DoNotOptimize( state.action );
+      }
+
+      st.SetBytesProcessed( st.iterations() * line.size() );
+      st.counters[ "line_length" ] = line.size();
+      st.counters[ "allocations" ] = benchmark::Counter( allocations - before, benchmark::Counter::kAvgIterations );
+   }
+
+   BENCHMARK( parse_line )->Arg( 1 )->Arg( 8 )->Arg( 64 );
+
+   // Arg: number of arguments. Packs argv the way a plan does, from an arena like the plan's.
+   void convert_to_c_args( benchmark::State& st ) {
+      std::pmr::vector< std::pmr::string > args;
+
+      for ( int i = 0; i < st.range( 0 ); ++i )
+         args.emplace_back( "argument-" + std::to_string( i ) );
+
+      for ( auto _ : st ) {
+         std::pmr::monotonic_buffer_resource arena;
+         benchmark::DoNotOptimize( ExecutionPlan::convert_to_c_args( args, &arena ) );
+      }
+
+      st.SetItemsProcessed( st.iterations() * args.size() );
+   }
+
+   BENCHMARK( convert_to_c_args )->Arg( 1 )->Arg( 16 )->Arg( 256 );
+}
+
+void* operator new( size_t size )
+{
+   void* p;
+
+   ++allocations;
+   if ( ( p = malloc( size ? size : 1 ) ) == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new( size_t size, std::align_val_t alignment )
+{
+   void* p;
+
+   ++allocations;
+   if ( ( p = aligned_alloc( (size_t)alignment, ( size + (size_t)alignment - 1 ) / (size_t)alignment * (size_t)alignment ) ) == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, std::align_val_t ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, size_t, std::align_val_t ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+   free( p );
+}
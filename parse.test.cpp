@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <new>
+#include <string>
+
+#include "shell.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   thread_local bool counting = false;
+   thread_local size_t allocations = 0;
+
+   // Heap allocations made by this thread while it lives.
+   struct allocation_count
+   {
+      allocation_count() { allocations = 0; counting = true; }
+      ~allocation_count() { counting = false; }
+      size_t made() const { return allocations; }
+   };
+
+   std::string line_of( int stages ) {
+      std::string line = "cat < input.txt";
+
+      for ( int i = 1; i < stages; ++i )
+         line += " | grep -v -i -e a-pattern-too-long-for-a-short-string-" + std::to_string( i );
+      return line + " > output.txt";
+   }
+
+   size_t allocations_to_parse( const std::string& line ) {
+      shell_state state;
+      allocation_count count;
+
+      parse_command( line, state );
+      return count.made();
+   }
+
+   TEST( Parse, CountsAllocations ) {
+      allocation_count count;
+
+      delete new std::string( "this one is too long for a short string" );
+      EXPECT_EQ( 2u, count.made() );
+   }
+
+   TEST( Parse, TypicalLinesDontAllocate ) {
+      EXPECT_EQ( 0u, allocations_to_parse( "ls -la" ) );
+      EXPECT_EQ( 0u, allocations_to_parse( line_of( 3 ) ) );
+      EXPECT_EQ( 0u, allocations_to_parse( "time A=1 B=$HOME/somewhere/further/away sort -r -k 2 <<< $A | wc -l > /dev/null &" ) );
+   }
+
+   TEST( Parse, LongLinesDontAllocatePerToken ) {
+      size_t few = allocations_to_parse( line_of( 16 ) ), many = allocations_to_parse( line_of( 256 ) );
+
+      EXPECT_LT( many, 16u );                            // Only the arena growing, geometrically.
+      EXPECT_LE( many - few, 8u );                       // Sixteen times the tokens, a handful more blocks.
+   }
+}
+
+void* operator new( size_t size )
+{
+   void* p;
+
+   if ( counting )
+      ++allocations;
+   if ( ( p = malloc( size ? size : 1 ) ) == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new( size_t size, std::align_val_t alignment )
+{
+   void* p;
+
+   if ( counting )
+      ++allocations;
+   if ( ( p = aligned_alloc( (size_t)alignment, ( size + (size_t)alignment - 1 ) / (size_t)alignment * (size_t)alignment ) ) == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, std::align_val_t ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, size_t, std::align_val_t ) noexcept
+{
+   free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+   free( p );
+}
@@ -0,0 +1,46 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "parse_cache.h"
+
+using namespace shell;
+
+namespace {
+   // A loop body's worth of distinct lines, each seen many times.
+   std::vector< std::string > working_set( int distinct ) {
+      std::vector< std::string > lines;
+
+      for ( int i = 0; i < distinct; ++i )
+         lines.push_back( "cat < input-" + std::to_string( i ) + " | sort -n | uniq -c | head -n 10 > output-" + std::to_string( i ) );
+      return lines;
+   }
+
+   void parse_uncached( benchmark::State& st ) {
+      std::vector< std::string > lines = working_set( st.range( 0 ) );
+      size_t next = 0;
+
+      for ( auto _ : st ) {
+         shell_state state;
+         parse_command( lines[ next++ % lines.size() ], state );
+         benchmark::DoNotOptimize( state.action );
+      }
+      st.SetItemsProcessed( st.iterations() );
+   }
+
+   void parse_cached( benchmark::State& st ) {
+      std::vector< std::string > lines = working_set( st.range( 0 ) );
+      ParseCache cache;
+      size_t next = 0;
+
+      for ( auto _ : st )
+         benchmark::DoNotOptimize( cache.parse( lines[ next++ % lines.size() ] ).get() );
+
+      st.SetItemsProcessed( st.iterations() );
+      st.counters[ "hit_ratio" ] = double( cache.hits() ) / ( cache.hits() + cache.misses() );
+   }
+
+   BENCHMARK( parse_uncached )->Arg( 16 )->Arg( 4096 );
+   BENCHMARK( parse_cached )->Arg( 16 )->Arg( 4096 );
+}
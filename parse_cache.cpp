@@ -0,0 +1,73 @@
+#include "parse_cache.h"
+
+namespace shell
+{
+   ParseCache& parse_cache() noexcept
+   {
+      static ParseCache cache;
+      return cache;
+   }
+
+   ParseCache::ParseCache( size_t limit ) noexcept
+      : limit( limit )
+   {
+   }
+
+   // There is no quoting in the grammar, so runs of blanks can be collapsed without changing what a line means.
+   std::string ParseCache::normalize( std::string_view line )
+   {
+      std::string normalized;
+      bool pending_blank = false;
+
+      normalized.reserve( line.size() );
+      for ( char c : line ) {
+         if ( c == ' ' || c == '\t' ) {
+            pending_blank = !normalized.empty();
+            continue;
+         }
+         if ( pending_blank )
+            normalized.push_back( ' ' );
+         pending_blank = false;
+         normalized.push_back( c );
+      }
+
+      return normalized;
+   }
+
+   // Throws like parse_command() does; lines that don't parse are not cached.
+   std::shared_ptr< ShellAction > ParseCache::parse( std::string_view line )
+   {
+      std::string key = normalize( line );
+      auto found = index.find( key );
+
+      if ( found != index.end() ) {
+         hit_count++;
+         recently_used.splice( recently_used.begin(), recently_used, found->second );
+         return found->second->second;
+      }
+
+      miss_count++;
+
+      std::shared_ptr< shell_state > state = std::make_shared< shell_state >();
+      parse_command( key, *state );
+      std::shared_ptr< ShellAction > action( state, state->action );   // Keeps the whole state, and its arena, alive.
+
+      if ( limit == 0 )
+         return action;
+
+      if ( recently_used.size() >= limit ) {
+         index.erase( recently_used.back().first );
+         recently_used.pop_back();
+      }
+      recently_used.emplace_front( std::move( key ), action );
+      index.emplace( recently_used.front().first, recently_used.begin() );
+
+      return action;
+   }
+
+   void ParseCache::clear() noexcept
+   {
+      index.clear();
+      recently_used.clear();
+   }
+}
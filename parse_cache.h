@@ -0,0 +1,38 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "shell.h"
+
+namespace shell
+{
+   // Least recently used cache of parsed command lines, keyed by the line with its whitespace normalized.
+   // Cached actions are shared between runs of the same line, so ShellAction::execute() must not change them.
+   // Each entry keeps the shell_state (and so the arena) its action was parsed into.
+   class ParseCache
+   {
+   private:
+      typedef std::pair< std::string, std::shared_ptr< ShellAction > > entry;
+      std::list< entry > recently_used;                    // Most recently used first.
+      std::unordered_map< std::string_view, std::list< entry >::iterator > index;   // Keys point into recently_used.
+      size_t limit;
+      size_t hit_count = 0, miss_count = 0;
+   public:
+      static const size_t default_limit = 1024;
+      ParseCache( size_t limit = default_limit ) noexcept;
+      static std::string normalize( std::string_view line );
+      std::shared_ptr< ShellAction > parse( std::string_view line );
+      void clear() noexcept;
+      size_t size() const noexcept { return recently_used.size(); }
+      size_t hits() const noexcept { return hit_count; }
+      size_t misses() const noexcept { return miss_count; }
+   };
+
+   ParseCache& parse_cache() noexcept;
+}
+#endif
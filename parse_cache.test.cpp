@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "parse_cache.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   TEST( ParseCache, Normalize ) {
+      EXPECT_EQ( "ls -la | sort", ParseCache::normalize( "  ls \t -la   |  sort  " ) );
+      EXPECT_EQ( "ls -la|sort", ParseCache::normalize( "ls -la|sort" ) );
+      EXPECT_EQ( "", ParseCache::normalize( " \t " ) );
+   }
+
+   TEST( ParseCache, RepeatedLinesShareOneParse ) {
+      ParseCache cache;
+      std::shared_ptr< ShellAction > first, second;
+
+      first = cache.parse( "ls -la | sort" );
+      second = cache.parse( "   ls  -la |   sort " );
+
+      EXPECT_EQ( first, second );
+      EXPECT_EQ( 1, cache.misses() );
+      EXPECT_EQ( 1, cache.hits() );
+      EXPECT_EQ( 1, cache.size() );
+      EXPECT_EQ( 2, static_cast< RunCommandsAction* >( first.get() )->numberOfCommands );
+   }
+
+   TEST( ParseCache, EvictsLeastRecentlyUsed ) {
+      ParseCache cache( 2 );
+
+      cache.parse( "a" );
+      cache.parse( "b" );
+      cache.parse( "a" );                                   // "b" is now the least recently used.
+      cache.parse( "c" );
+
+      EXPECT_EQ( 2, cache.size() );
+      cache.parse( "a" );
+      EXPECT_EQ( 2, cache.hits() );
+      cache.parse( "b" );
+      EXPECT_EQ( 4, cache.misses() );
+   }
+
+   TEST( ParseCache, ParseErrorsAreNotCached ) {
+      ParseCache cache;
+
+      EXPECT_ANY_THROW( cache.parse( "|" ) );
+      EXPECT_ANY_THROW( cache.parse( "|" ) );
+      EXPECT_EQ( 0, cache.size() );
+      EXPECT_EQ( 2, cache.misses() );
+   }
+
+   TEST( ParseCache, ZeroLimitDisablesCaching ) {
+      ParseCache cache( 0 );
+
+      EXPECT_NE( cache.parse( "ls" ), cache.parse( "ls" ) );
+      EXPECT_EQ( 0, cache.size() );
+   }
+}
@@ -0,0 +1,126 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shell.h"
+
+using namespace shell;
+
+namespace {
+   const char* big_file = "/tmp/shellbench-pipeline-input";
+
+   void make_big_file( size_t megabytes ) {
+      std::vector< char > block( 1 << 20 );
+      int fd = open( big_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+
+      for ( size_t i = 0; i < block.size(); ++i )
+         block[i] = 'a' + i % 26;
+      for ( size_t i = 0; i < megabytes; ++i )
+         write( fd, block.data(), block.size() );
+      close( fd );
+   }
+
+   // Args: MiB pushed through, number of `cat` stages between the file and /dev/null. Every stage is a real
+   // process, so this is the pipes and the scheduler, not the shell moving bytes itself.
+   void pipe_throughput( benchmark::State& st ) {
+      size_t megabytes = st.range( 0 );
+      std::string line = std::string( "cat < " ) + big_file;
+      shell_state state;
+
+      for ( int i = 1; i < st.range( 1 ); ++i )
+         line += " | cat";
+      line += " > /dev/null";
+
+      make_big_file( megabytes );
+      parse_command( line, state );
+      RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+      run_commands->zero_copy = false;
+      run_commands->builtins = false;
+
+      for ( auto _ : st )
+         run_commands->execute();
+
+      st.SetBytesProcessed( st.iterations() * ( megabytes << 20 ) );
+      unlink( big_file );
+   }
+
+   BENCHMARK( pipe_throughput )
+      ->ArgsProduct( { { 256 }, { 1, 2, 4 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMillisecond );
+
+   // Args: pipe capacity in KiB (0 for the kernel's default), 1 for packet mode. `cat | cat | cat` over the
+   // same file, to see how much larger pipes save in wakeups and context switches.
+   void pipe_size_throughput( benchmark::State& st ) {
+      size_t megabytes = 256;
+      std::string line = std::string( "cat < " ) + big_file + " | cat | cat > /dev/null";
+      shell_state state;
+
+      make_big_file( megabytes );
+      parse_command( line, state );
+      RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+      run_commands->zero_copy = false;
+      run_commands->builtins = false;
+      run_commands->pipe_size = st.range( 0 ) * 1024;
+      run_commands->packet_pipes = st.range( 1 );
+
+      for ( auto _ : st )
+         run_commands->execute();
+
+      st.SetBytesProcessed( st.iterations() * ( megabytes << 20 ) );
+      unlink( big_file );
+   }
+
+   BENCHMARK( pipe_size_throughput )
+      ->ArgsProduct( { { 0, 256, 1024 }, { 0 } } )
+      ->Args( { 64, 1 } )
+      ->Args( { 1024, 1 } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMillisecond );
+
+   // Arg: 1 to write both sides to files first and compare those, 0 for `cmp <(...) <(...)`. The file is
+   // read twice either way; substitution streams it through pipes instead of writing it back out twice.
+   void compare_outputs( benchmark::State& st ) {
+      size_t megabytes = 64;
+      bool through_files = st.range( 0 );
+      std::vector< std::string > lines;
+      std::vector< std::unique_ptr< shell_state > > states;
+
+      if ( through_files ) {
+         lines = { std::string( "cat < " ) + big_file + " > " + big_file + ".a",
+                   std::string( "cat < " ) + big_file + " > " + big_file + ".b",
+                   std::string( "cmp " ) + big_file + ".a " + big_file + ".b" };
+      }
+      else {
+         lines = { std::string( "cmp <(cat < " ) + big_file + ") <(cat < " + big_file + ")" };
+      }
+
+      make_big_file( megabytes );
+      for ( const std::string& line : lines ) {
+         states.emplace_back( new shell_state );
+         parse_command( line, *states.back() );
+      }
+
+      for ( auto _ : st ) {
+         for ( auto& state : states )
+            state->action->execute();
+         if ( through_files ) {
+            unlink( ( std::string( big_file ) + ".a" ).c_str() );
+            unlink( ( std::string( big_file ) + ".b" ).c_str() );
+         }
+      }
+
+      st.SetBytesProcessed( st.iterations() * ( megabytes << 20 ) );
+      unlink( big_file );
+   }
+
+   BENCHMARK( compare_outputs )
+      ->Arg( 0 )
+      ->Arg( 1 )
+      ->UseRealTime()
+      ->Unit( benchmark::kMillisecond );
+}
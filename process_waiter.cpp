@@ -0,0 +1,222 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+
+#include "process_waiter.h"
+#include "trace.h"
+
+namespace shell
+{
+   ProcessWaiter& process_waiter() noexcept
+   {
+      static ProcessWaiter waiter;
+      return waiter;
+   }
+
+   int open_pidfd( pid_t pid ) noexcept
+   {
+#ifdef SYS_pidfd_open
+      return syscall( SYS_pidfd_open, pid, 0 );
+#else
+      errno = ENOSYS;
+      return -1;
+#endif
+   }
+
+   static void trace_exit( pid_t pid, int status ) noexcept
+   {
+      if ( tracer().enabled() )
+         tracer().process_ended( pid, status );
+   }
+
+   static const uint64_t stage_base = uint64_t( 1 ) << 32; // epoll data from here on is a stage, below it a watch.
+
+   ProcessWaiter::ProcessWaiter() noexcept
+   {
+      poller = epoll_create1( EPOLL_CLOEXEC );
+   }
+
+   ProcessWaiter::~ProcessWaiter() noexcept
+   {
+      if ( poller >= 0 )
+         close( poller );
+   }
+
+   // Calls on_ready whenever fd becomes readable during a wait.
+   void ProcessWaiter::watch( int fd, void (*on_ready)( void* context ), void* context ) noexcept
+   {
+      struct epoll_event event = {};
+
+      if ( fd < 0 || std::any_of( watches.begin(), watches.end(), [fd]( const struct watch& w ) { return w.fd == fd; } ) )
+         return;
+
+      event.events = EPOLLIN;
+      event.data.u64 = watches.size();
+      if ( poller >= 0 && epoll_ctl( poller, EPOLL_CTL_ADD, fd, &event ) == 0 )
+         watches.push_back( { fd, on_ready, context } );
+   }
+
+   void ProcessWaiter::unwatch( int fd ) noexcept
+   {
+      struct epoll_event event = {};
+      auto found = std::find_if( watches.begin(), watches.end(), [fd]( const struct watch& w ) { return w.fd == fd; } );
+
+      if ( found == watches.end() )
+         return;
+
+      epoll_ctl( poller, EPOLL_CTL_DEL, fd, NULL );
+      watches.erase( found );
+      for ( size_t i = 0; i < watches.size(); ++i ) {      // Renumber what moved up.
+         event.events = EPOLLIN;
+         event.data.u64 = i;
+         epoll_ctl( poller, EPOLL_CTL_MOD, watches[i].fd, &event );
+      }
+   }
+
+   // Calls hook every `milliseconds` while a wait is going on, -1 turns it off.
+   void ProcessWaiter::set_timeout( int milliseconds, void (*hook)( void* context ), void* context ) noexcept
+   {
+      timeout = milliseconds;
+      on_timeout = hook;
+      timeout_context = context;
+   }
+
+   // Waits until every stage with a pid > 0 has exited, storing its wait status, and its resource usage when
+   // usages is given. Returns count, or the index of a stage that stopped instead, with its status in stop_status.
+   // Stages not reaped by then are left as running.
+   size_t ProcessWaiter::wait( const pid_t* pids, size_t count, int* statuses, int* stop_status, struct rusage* usages ) noexcept
+   {
+      std::vector< int > pidfds( count, -1 );
+      struct epoll_event events[ 16 ], event = {};
+      std::chrono::steady_clock::time_point deadline;
+      size_t left = 0, stopped = count, i;
+      int n, ready, status, remaining;
+      bool woken;
+
+      for ( i = 0; i < count; ++i ) {
+         if ( pids[i] <= 0 )
+            continue;
+         statuses[i] = running;
+         if ( poller < 0 || ( pidfds[i] = open_pidfd( pids[i] ) ) < 0 ) {
+            for ( size_t j = 0; j < i; ++j ) {
+               if ( pidfds[j] >= 0 )
+                  close( pidfds[j] );                       // epoll forgets them with the last close.
+            }
+            return wait_in_order( pids, count, statuses, stop_status, usages );
+         }
+         event.events = EPOLLIN;
+         event.data.u64 = stage_base + i;
+         epoll_ctl( poller, EPOLL_CTL_ADD, pidfds[i], &event );
+         left++;
+      }
+
+      deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+      while ( left > 0 && stopped == count ) {
+         remaining = -1;
+         if ( timeout >= 0 ) {
+            remaining = std::max< long >( 0, std::chrono::duration_cast< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count() );
+         }
+
+         if ( ( n = epoll_wait( poller, events, 16, remaining ) ) < 0 ) {
+            if ( errno == EINTR )
+               continue;
+            break;
+         }
+
+         if ( n == 0 && on_timeout ) {
+            on_timeout( timeout_context );
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
+            woken = true;                                   // A stop would have gone unnoticed if nobody watches SIGCHLD.
+         }
+         else {
+            woken = false;
+         }
+
+         for ( ready = 0; ready < n; ++ready ) {           // Stages first, so watches see as few of our children as possible.
+            if ( events[ ready ].data.u64 < stage_base )
+               continue;
+            i = events[ ready ].data.u64 - stage_base;
+            if ( wait4( pids[i], &status, WNOHANG, usages ? &usages[i] : NULL ) <= 0 )
+               continue;
+            statuses[i] = status;
+            trace_exit( pids[i], status );
+            close( pidfds[i] );
+            pidfds[i] = -1;
+            left--;
+         }
+         for ( ready = 0; ready < n; ++ready ) {
+            if ( events[ ready ].data.u64 >= stage_base )
+               continue;
+            const struct watch& w = watches[ events[ ready ].data.u64 ];
+            w.on_ready( w.context );
+            woken = true;
+         }
+
+         if ( woken && left > 0 )
+            left -= check_stopped( pids, pidfds.data(), count, statuses, stop_status, usages, stopped );
+      }
+
+      for ( i = 0; i < count; ++i ) {
+         if ( pidfds[i] >= 0 )
+            close( pidfds[i] );
+      }
+
+      return stopped;
+   }
+
+   // Pidfds only report exits. When SIGCHLD (or the timeout) says something else happened, look for stops.
+   // Returns how many stages turned out to have exited in the meantime.
+   size_t ProcessWaiter::check_stopped( const pid_t* pids, int* pidfds, size_t count, int* statuses, int* stop_status, struct rusage* usages, size_t& stopped ) noexcept
+   {
+      size_t reaped = 0;
+      int status;
+
+      for ( size_t i = 0; i < count; ++i ) {
+         if ( pidfds[i] < 0 || statuses[i] != running )
+            continue;
+         if ( wait4( pids[i], &status, WUNTRACED | WNOHANG, usages ? &usages[i] : NULL ) <= 0 )
+            continue;
+         if ( WIFSTOPPED( status ) ) {
+            *stop_status = status;
+            stopped = i;
+            continue;
+         }
+         statuses[i] = status;
+         trace_exit( pids[i], status );
+         close( pidfds[i] );
+         pidfds[i] = -1;
+         reaped++;
+      }
+
+      return reaped;
+   }
+
+   size_t ProcessWaiter::wait_in_order( const pid_t* pids, size_t count, int* statuses, int* stop_status, struct rusage* usages ) noexcept
+   {
+      int status;
+
+      for ( size_t i = 0; i < count; ++i ) {
+         if ( pids[i] <= 0 )
+            continue;
+         while ( wait4( pids[i], &status, WUNTRACED, usages ? &usages[i] : NULL ) < 0 ) {
+            if ( errno != EINTR ) {
+               status = W_EXITCODE( 127, 0 );
+               break;
+            }
+         }
+         if ( WIFSTOPPED( status ) ) {
+            *stop_status = status;
+            return i;
+         }
+         statuses[i] = status;
+         trace_exit( pids[i], status );
+      }
+
+      return count;
+   }
+}
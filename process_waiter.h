@@ -0,0 +1,49 @@
+#ifndef PROCESS_WAITER_H
+#define PROCESS_WAITER_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <vector>
+
+namespace shell
+{
+   // Waits for the stages of a pipeline in whatever order they finish, with one pidfd per stage in an epoll
+   // set. Other fds (the SIGCHLD signalfd) and a periodic timeout share the same loop, so work that isn't
+   // about the pipeline still gets done while the shell waits for it.
+   //
+   // Kernels without pidfd_open(2) get a plain wait4(2) per stage, in pipeline order.
+   class ProcessWaiter
+   {
+   private:
+      struct watch
+      {
+         int fd;
+         void (*on_ready)( void* context );
+         void* context;
+      };
+      int poller = -1;                                     // epoll
+      std::vector< watch > watches;
+      int timeout = -1;                                    // Milliseconds, -1 for none.
+      void (*on_timeout)( void* context ) = nullptr;
+      void* timeout_context = nullptr;
+      size_t wait_in_order( const pid_t* pids, size_t count, int* statuses, int* stop_status, struct rusage* usages ) noexcept;
+      size_t check_stopped( const pid_t* pids, int* pidfds, size_t count, int* statuses, int* stop_status, struct rusage* usages, size_t& stopped ) noexcept;
+   public:
+      static constexpr int running = -1;                   // Status of a stage that hasn't been reaped.
+      ProcessWaiter() noexcept;
+      ~ProcessWaiter() noexcept;
+      ProcessWaiter( const ProcessWaiter& ) = delete;
+      ProcessWaiter& operator=( const ProcessWaiter& ) = delete;
+      void watch( int fd, void (*on_ready)( void* context ), void* context ) noexcept;
+      void unwatch( int fd ) noexcept;
+      void set_timeout( int milliseconds, void (*hook)( void* context ), void* context ) noexcept;
+      size_t wait( const pid_t* pids, size_t count, int* statuses, int* stop_status, struct rusage* usages = nullptr ) noexcept;
+   };
+
+   ProcessWaiter& process_waiter() noexcept;
+
+   int open_pidfd( pid_t pid ) noexcept;                   // -1 with errno ENOSYS on kernels without pidfds.
+}
+#endif
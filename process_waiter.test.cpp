@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <chrono>
+
+#include "process_waiter.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   pid_t start( std::vector< const char* > args );
+
+   TEST( ProcessWaiter, CollectsEveryStatus ) {
+      ProcessWaiter waiter;
+      std::vector< pid_t > pids = { start( { "sleep", "0.2" } ), -1, start( { "false" } ), 0 };
+      std::vector< int > statuses = { 42, 42, 42, 42 };
+      int stop_status;
+
+      EXPECT_EQ( 4u, waiter.wait( pids.data(), pids.size(), statuses.data(), &stop_status ) );
+      EXPECT_EQ( W_EXITCODE( 0, 0 ), statuses[0] );
+      EXPECT_EQ( 42, statuses[1] );                         // Stages without a process are left alone.
+      EXPECT_EQ( W_EXITCODE( 1, 0 ), statuses[2] );
+      EXPECT_EQ( 42, statuses[3] );
+   }
+
+   TEST( ProcessWaiter, ReportsAStoppedStage ) {
+      ProcessWaiter waiter;
+      std::vector< pid_t > pids = { start( { "true" } ), start( { "sleep", "5" } ) };
+      std::vector< int > statuses( 2 );
+      int stop_status;
+
+      waiter.set_timeout( 20, []( void* ) { }, nullptr );   // Nobody watches SIGCHLD here, the timeout has to notice.
+      kill( pids[1], SIGSTOP );
+
+      EXPECT_EQ( 1u, waiter.wait( pids.data(), pids.size(), statuses.data(), &stop_status ) );
+      EXPECT_TRUE( WIFSTOPPED( stop_status ) );
+      EXPECT_EQ( ProcessWaiter::running, statuses[1] );
+
+      kill( pids[1], SIGKILL );
+      waitpid( pids[1], NULL, 0 );
+      waitpid( pids[0], NULL, 0 );
+   }
+
+   TEST( ProcessWaiter, TimeoutHookRunsWhileWaiting ) {
+      ProcessWaiter waiter;
+      std::vector< pid_t > pids = { start( { "sleep", "0.3" } ) };
+      std::vector< int > statuses( 1 );
+      int ticks = 0, stop_status;
+
+      waiter.set_timeout( 50, []( void* context ) { ++*static_cast< int* >( context ); }, &ticks );
+      waiter.wait( pids.data(), pids.size(), statuses.data(), &stop_status );
+
+      EXPECT_LE( 3, ticks );
+      EXPECT_GE( 7, ticks );
+   }
+
+   TEST( ProcessWaiter, WatchedFdsAreServiced ) {
+      ProcessWaiter waiter;
+      std::vector< pid_t > pids = { start( { "sleep", "0.2" } ) };
+      std::vector< int > statuses( 1 );
+      int fds[2], stop_status;
+      char c = 'x';
+
+      pipe( fds );
+      waiter.watch( fds[0], []( void* context ) {
+         char c;
+         read( *static_cast< int* >( context ), &c, 1 );
+      }, &fds[0] );
+      write( fds[1], &c, 1 );
+
+      EXPECT_EQ( 1u, waiter.wait( pids.data(), pids.size(), statuses.data(), &stop_status ) );
+      EXPECT_EQ( 0, statuses[0] );
+
+      waiter.unwatch( fds[0] );
+      close( fds[0] );
+      close( fds[1] );
+   }
+
+   pid_t start( std::vector< const char* > args ) {
+      pid_t pid;
+
+      args.push_back( nullptr );
+      posix_spawnp( &pid, args[0], NULL, NULL, const_cast< char** >( args.data() ), environ );
+
+      return pid;
+   }
+}
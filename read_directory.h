@@ -0,0 +1,39 @@
+#ifndef READ_DIRECTORY_H
+#define READ_DIRECTORY_H
+
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+namespace shell
+{
+   struct linux_dirent64
+   {
+      ino64_t d_ino;
+      off64_t d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[];
+   };
+
+   // Straight from getdents64(2), in large batches: no DIR*, and no stat(2) unless d_type leaves it open.
+   // Calls each( name, d_type ) for every entry but . and ..
+   template< typename Each >
+      void read_directory( int fd, Each each ) noexcept
+      {
+         alignas( linux_dirent64 ) char buffer[ 32 * 1024 ];
+         long n;
+
+         while ( ( n = syscall( SYS_getdents64, fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+            for ( long at = 0; at < n; ) {
+               const linux_dirent64* entry = reinterpret_cast< const linux_dirent64* >( buffer + at );
+               at += entry->d_reclen;
+               if ( strcmp( entry->d_name, "." ) != 0 && strcmp( entry->d_name, ".." ) != 0 )
+                  each( entry->d_name, entry->d_type );
+            }
+         }
+      }
+}
+#endif
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+
+#include <string>
+#include <string_view>
+
+#include "parse_cache.h"
+#include "script_cache.h"
+
+using namespace shell;
+
+namespace {
+   const char* cache_directory = "/tmp/shellbench-shc";
+
+   // Arg: lines. A deploy script's mix: mostly pipelines, some cd and export.
+   std::string script_of( int lines ) {
+      std::string script;
+
+      for ( int i = 0; i < lines; ++i ) {
+         switch ( i % 4 ) {
+            case 0:
+               script += "grep -v -e pattern-" + std::to_string( i ) + " < config-" + std::to_string( i ) + ".txt | sort -r | uniq -c > out-" + std::to_string( i ) + ".txt\n";
+               break;
+            case 1:
+               script += "install -m 644 build/app-" + std::to_string( i ) + ".conf /srv/app/conf.d\n";
+               break;
+            case 2:
+               script += "export RELEASE_" + std::to_string( i ) + "=v" + std::to_string( i ) + "\n";
+               break;
+            default:
+               script += "cd /srv/app/releases/" + std::to_string( i ) + "\n";
+         }
+      }
+      return script;
+   }
+
+   // Every line through the parse cache, as a script runs today, without running anything.
+   void script_startup_parsed( benchmark::State& st ) {
+      std::string script = script_of( st.range( 0 ) );
+
+      for ( auto _ : st ) {
+         ParseCache cache;
+         std::string_view rest = script, line;
+         size_t newline;
+
+         while ( !rest.empty() ) {
+            newline = rest.find( '\n' );
+            line = rest.substr( 0, newline );
+            rest.remove_prefix( newline == std::string_view::npos ? rest.size() : newline + 1 );
+            benchmark::DoNotOptimize( cache.parse( line ) );
+         }
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   // Arg: lines, and whether the image is already there. Cold runs compile and write it, warm runs map it; both
+   // then go through every record, rebuilding the pipelines and parsing the rest, without running anything.
+   void script_startup_cached( benchmark::State& st ) {
+      std::string script = script_of( st.range( 0 ) );
+      bool warm = st.range( 1 );
+      std::string_view text;
+
+      system( ( std::string( "rm -rf " ) + cache_directory ).c_str() );
+      for ( auto _ : st ) {
+         uint64_t hash = ScriptImage::hash( script );
+         std::string path = ScriptImage::path( cache_directory, hash ), compiled;
+         ScriptImage image;
+         ParseCache cache;
+
+         if ( !warm )
+            unlink( path.c_str() );
+         if ( !image.open( path.c_str(), hash ) ) {
+            ScriptImage::compile( script, compiled );
+            ScriptImage::write( path, compiled );
+            image.use( compiled, hash );
+         }
+         for ( ;; ) {
+            shell_state state;
+            if ( !image.next( state, text ) )
+               break;
+            if ( state.action == nullptr )
+               benchmark::DoNotOptimize( cache.parse( text ) );
+            benchmark::DoNotOptimize( state.action );
+         }
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+      system( ( std::string( "rm -rf " ) + cache_directory ).c_str() );
+   }
+}
+
+BENCHMARK( script_startup_parsed )->Arg( 50000 )->Unit( benchmark::kMillisecond );
+BENCHMARK( script_startup_cached )->ArgsProduct( { { 50000 }, { 0, 1 } } )->Unit( benchmark::kMillisecond );
@@ -0,0 +1,417 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <exception>
+#include <vector>
+
+#include "script_cache.h"
+
+namespace shell
+{
+   namespace
+   {
+      struct image_header
+      {
+         char magic[4];
+         uint32_t version;
+         uint64_t hash;                                    // Of the script the image was compiled from.
+         uint64_t records;
+      };
+
+      const char magic[4] = { 'S', 'H', 'C', '\0' };
+
+      enum class record : uint8_t { text, pipeline, change_directory, variables };
+
+      enum : uint8_t { background = 1, timed = 2, packet_pipes = 4 };
+
+      void put( std::string& image, const void* value, size_t size )
+      {
+         image.append( static_cast< const char* >( value ), size );
+      }
+
+      template< typename T >
+         void put( std::string& image, T value )
+         {
+            put( image, &value, sizeof( value ) );
+         }
+
+      void put_string( std::string& image, std::string_view text )
+      {
+         put< uint32_t >( image, text.size() );
+         image.append( text );
+      }
+
+      // Reads an image that may have been cut short or tampered with, so every read is checked against the end.
+      struct cursor
+      {
+         const char* at;
+         const char* end;
+
+         template< typename T >
+            bool get( T& value ) noexcept
+            {
+               if ( (size_t)( end - at ) < sizeof( value ) )
+                  return false;
+               memcpy( &value, at, sizeof( value ) );
+               at += sizeof( value );
+               return true;
+            }
+
+         bool get_string( std::string_view& text ) noexcept
+         {
+            uint32_t size;
+
+            if ( !get( size ) || (size_t)( end - at ) < size )
+               return false;
+            text = std::string_view( at, size );
+            at += size;
+            return true;
+         }
+      };
+
+      void put_pipeline( std::string& image, const RunCommandsAction& pipeline )
+      {
+         put( image, record::pipeline );
+         put< uint8_t >( image, ( pipeline.runInBackground ? background : 0 ) | ( pipeline.timed ? timed : 0 ) | ( pipeline.packet_pipes ? packet_pipes : 0 ) );
+         put( image, static_cast< uint8_t >( pipeline.time_with ) );
+         put< uint64_t >( image, pipeline.pipe_size );
+         put< uint32_t >( image, pipeline.commands.size() );
+
+         for ( const command* cmd : pipeline.commands ) {
+            put< uint32_t >( image, cmd->args.size() );
+            put< uint32_t >( image, cmd->assignments.size() );
+            for ( const std::pmr::string& arg : cmd->args )
+               put_string( image, arg );
+            for ( const std::pmr::string& assignment : cmd->assignments )
+               put_string( image, assignment );
+            put_string( image, cmd->input_file );
+            put_string( image, cmd->output_file );
+            put_string( image, cmd->here_string );
+            put_string( image, cmd->here_delimiter );
+         }
+      }
+
+      void put_variables( std::string& image, const VariablesAction& variables )
+      {
+         put( image, record::variables );
+         put( image, static_cast< uint8_t >( variables.which ) );
+         put< uint32_t >( image, variables.words.size() );
+         for ( const std::pmr::string& word : variables.words )
+            put_string( image, word );
+      }
+
+      bool get_words( cursor& in, uint32_t count, std::pmr::vector< std::pmr::string >* words ) noexcept
+      {
+         std::string_view word;
+
+         if ( words )
+            words->reserve( count );
+         for ( uint32_t i = 0; i < count; ++i ) {
+            if ( !in.get_string( word ) )
+               return false;
+            if ( words )
+               words->emplace_back( word );
+         }
+         return true;
+      }
+
+      bool get_word( cursor& in, std::pmr::string* word ) noexcept
+      {
+         std::string_view text;
+
+         if ( !in.get_string( text ) )
+            return false;
+         if ( word )
+            word->assign( text );
+         return true;
+      }
+
+      // Rebuilds the pipeline into state, or with no state only checks that it is all there.
+      bool get_pipeline( cursor& in, shell_state* state ) noexcept
+      {
+         RunCommandsAction* pipeline = nullptr;
+         command* cmd = nullptr;
+         uint8_t flags, format;
+         uint64_t pipe_size;
+         uint32_t commands, argc, assignments;
+
+         if ( !in.get( flags ) || !in.get( format ) || !in.get( pipe_size ) || !in.get( commands )
+              || commands == 0 || format > static_cast< uint8_t >( time_format::json ) )
+            return false;
+
+         if ( state ) {
+            state->action = pipeline = state->make< RunCommandsAction >( &state->arena );
+            pipeline->runInBackground = flags & background;
+            pipeline->timed = flags & timed;
+            pipeline->packet_pipes = flags & packet_pipes;
+            pipeline->time_with = static_cast< time_format >( format );
+            pipeline->pipe_size = pipe_size;
+         }
+
+         for ( uint32_t i = 0; i < commands; ++i ) {
+            if ( !in.get( argc ) || !in.get( assignments ) || argc == 0 )
+               return false;
+            if ( state ) {
+               cmd = state->make< command >( &state->arena );
+               pipeline->commands.push_back( cmd );
+               pipeline->numberOfCommands++;
+            }
+            if ( !get_words( in, argc, cmd ? &cmd->args : nullptr ) || !get_words( in, assignments, cmd ? &cmd->assignments : nullptr )
+                 || !get_word( in, cmd ? &cmd->input_file : nullptr ) || !get_word( in, cmd ? &cmd->output_file : nullptr )
+                 || !get_word( in, cmd ? &cmd->here_string : nullptr ) || !get_word( in, cmd ? &cmd->here_delimiter : nullptr ) )
+               return false;
+         }
+         return true;
+      }
+
+      bool get_variables( cursor& in, shell_state* state ) noexcept
+      {
+         VariablesAction* variables = nullptr;
+         uint8_t which;
+         uint32_t count;
+
+         if ( !in.get( which ) || !in.get( count ) || which > static_cast< uint8_t >( VariablesAction::builtin::unset ) )
+            return false;
+         if ( state )
+            state->action = variables = state->make< VariablesAction >( static_cast< VariablesAction::builtin >( which ), &state->arena );
+         return get_words( in, count, variables ? &variables->words : nullptr );
+      }
+
+      bool get_record( cursor& in, shell_state* state, std::string_view& text ) noexcept
+      {
+         std::string_view directory;
+         record kind;
+
+         if ( !in.get( kind ) )
+            return false;
+         switch ( kind ) {
+            case record::text:
+               return in.get_string( text );
+            case record::pipeline:
+               return get_pipeline( in, state );
+            case record::change_directory:
+               if ( !in.get_string( directory ) )
+                  return false;
+               if ( state )
+                  state->action = state->make< ChangeDirectoryAction >( directory, &state->arena );
+               return true;
+            case record::variables:
+               return get_variables( in, state );
+         }
+         return false;
+      }
+   }
+
+   ScriptImage::ScriptImage() noexcept
+   {
+   }
+
+   ScriptImage::~ScriptImage() noexcept
+   {
+      close();
+   }
+
+   // Eight bytes at a time, it is on the path of every cached run.
+   uint64_t ScriptImage::hash( std::string_view script ) noexcept
+   {
+      uint64_t h = 0x9e3779b97f4a7c15ull ^ script.size(), word;
+      size_t i;
+
+      for ( i = 0; i + sizeof( word ) <= script.size(); i += sizeof( word ) ) {
+         memcpy( &word, script.data() + i, sizeof( word ) );
+         h = ( h ^ word ) * 0xff51afd7ed558ccdull;
+         h ^= h >> 32;
+      }
+      for ( word = 0; i < script.size(); ++i )
+         word = word << 8 | (unsigned char)script[i];
+      h = ( h ^ word ) * 0xff51afd7ed558ccdull;
+
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ull;
+      h ^= h >> 33;
+      return h;
+   }
+
+   std::string ScriptImage::path( const char* directory, uint64_t hash )
+   {
+      char name[ 32 ];
+
+      snprintf( name, sizeof( name ), "/%016llx.shc", (unsigned long long)hash );
+      return directory + std::string( name );
+   }
+
+   // Lines are split the way LineReader splits a mapped script, so the image holds exactly what a parse would see.
+   void ScriptImage::compile( std::string_view script, std::string& image )
+   {
+      std::vector< std::string > delimiters;               // Of the << documents still to come.
+      std::string_view line, delimiter;
+      image_header header = {};
+      size_t at = 0, newline;
+
+      memcpy( header.magic, magic, sizeof( magic ) );
+      header.version = version;
+      header.hash = hash( script );
+      image.assign( sizeof( header ), '\0' );
+
+      while ( at < script.size() ) {
+         if ( ( newline = script.find( '\n', at ) ) == std::string_view::npos )
+            newline = script.size();
+         line = script.substr( at, newline - at );
+         at = newline + 1;
+
+         if ( !delimiters.empty() ) {
+            put( image, record::text );
+            put_string( image, line );
+            header.records++;
+            if ( line == delimiters.front() )
+               delimiters.erase( delimiters.begin() );
+            continue;
+         }
+
+         shell_state state;
+         try {
+            parse_command( line, state );
+         }
+         catch ( std::exception& ) {
+            state.action = nullptr;                        // Left for the run to report, as it would have been.
+         }
+         if ( state.action && dynamic_cast< NopAction* >( state.action ) )
+            continue;
+
+         if ( RunCommandsAction* pipeline = dynamic_cast< RunCommandsAction* >( state.action ) ) {
+            put_pipeline( image, *pipeline );
+            for ( size_t i = 0; pipeline->here_document( i, delimiter ); ++i )
+               delimiters.emplace_back( delimiter );
+         }
+         else if ( ChangeDirectoryAction* change = dynamic_cast< ChangeDirectoryAction* >( state.action ) ) {
+            put( image, record::change_directory );
+            put_string( image, change->new_directory );
+         }
+         else if ( VariablesAction* variables = dynamic_cast< VariablesAction* >( state.action ) ) {
+            put_variables( image, *variables );
+         }
+         else {
+            put( image, record::text );
+            put_string( image, line );
+         }
+         header.records++;
+      }
+
+      memcpy( image.data(), &header, sizeof( header ) );
+   }
+
+   // Written next to where it goes and renamed into place, so a run never sees half an image.
+   bool ScriptImage::write( const std::string& path, const std::string& image ) noexcept
+   {
+      std::string temporary = path + "." + std::to_string( getpid() );
+      size_t slash = path.rfind( '/' ), done = 0;
+      ssize_t n;
+      int fd;
+
+      if ( slash != std::string::npos && slash > 0 )
+         mkdir( path.substr( 0, slash ).c_str(), S_IRWXU ); // The one level of it, if it isn't there yet.
+      if ( ( fd = ::open( temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR ) ) < 0 )
+         return false;
+
+      while ( done < image.size() ) {
+         if ( ( n = ::write( fd, image.data() + done, image.size() - done ) ) < 0 ) {
+            if ( errno == EINTR )
+               continue;
+            break;
+         }
+         done += n;
+      }
+
+      if ( ::close( fd ) < 0 || done < image.size() || rename( temporary.c_str(), path.c_str() ) < 0 ) {
+         unlink( temporary.c_str() );
+         return false;
+      }
+      return true;
+   }
+
+   bool ScriptImage::open( const char* path, uint64_t hash ) noexcept
+   {
+      struct stat st;
+      void* mapped;
+      int fd;
+
+      close();
+      if ( ( fd = ::open( path, O_RDONLY | O_CLOEXEC ) ) < 0 )
+         return false;
+      if ( fstat( fd, &st ) < 0 || !S_ISREG( st.st_mode ) || (size_t)st.st_size < sizeof( image_header )
+           || ( mapped = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ) == MAP_FAILED ) {
+         ::close( fd );
+         return false;
+      }
+      ::close( fd );
+
+      map = static_cast< const char* >( mapped );
+      map_size = st.st_size;
+      if ( load( map, map + map_size, hash ) )
+         return true;
+
+      close();
+      return false;
+   }
+
+   bool ScriptImage::use( const std::string& image, uint64_t hash ) noexcept
+   {
+      close();
+      return load( image.data(), image.data() + image.size(), hash );
+   }
+
+   // Checks every record up front, so next() can't run into a bad one halfway through the script.
+   bool ScriptImage::load( const char* begin, const char* finish, uint64_t hash ) noexcept
+   {
+      image_header header;
+      cursor in = { begin, finish };
+      std::string_view text;
+
+      if ( !in.get( header ) || memcmp( header.magic, magic, sizeof( magic ) ) != 0 || header.version != version || header.hash != hash )
+         return false;
+      for ( uint64_t i = 0; i < header.records; ++i ) {
+         if ( !get_record( in, nullptr, text ) )
+            return false;
+      }
+      if ( in.at != finish )
+         return false;
+
+      position = begin + sizeof( header );
+      end = finish;
+      return true;
+   }
+
+   void ScriptImage::close() noexcept
+   {
+      if ( map )
+         munmap( const_cast< char* >( map ), map_size );
+      map = nullptr;
+      map_size = 0;
+      position = end = nullptr;
+   }
+
+   bool ScriptImage::next( shell_state& state, std::string_view& text ) noexcept
+   {
+      cursor in = { position, end };
+
+      if ( position == end || !get_record( in, &state, text ) )
+         return false;
+      position = in.at;
+      return true;
+   }
+
+   bool ScriptImage::next_line( std::string_view& text ) noexcept
+   {
+      cursor in = { position, end };
+
+      if ( position == end || static_cast< record >( *position ) != record::text || !get_record( in, nullptr, text ) )
+         return false;
+      position = in.at;
+      return true;
+   }
+}
@@ -0,0 +1,48 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "shell.h"
+
+namespace shell
+{
+   // A script compiled ahead of time (.shc), so a script that runs on every deploy is parsed once rather than on
+   // every run.
+   //
+   // The image is a header, then one record per line that does something: a pipeline, its commands' words and
+   // redirects ready to go back into a RunCommandsAction without the grammar, likewise cd and the variable
+   // builtins, or the text of any other line (set, jobs, a line that doesn't parse, the lines of a << document),
+   // which is parsed when it runs.
+   // Images are named after a hash of the script, so an edited script simply misses. One that doesn't check out
+   // when it is opened is ignored, and the script parsed as usual.
+   class ScriptImage
+   {
+   private:
+      const char* map = nullptr;                           // When the image is a mapped file.
+      size_t map_size = 0;
+      const char *position = nullptr, *end = nullptr;
+      bool load( const char* begin, const char* finish, uint64_t hash ) noexcept;
+   public:
+      static const uint32_t version = 1;                   // Bumped whenever the format or what a record holds changes.
+      ScriptImage() noexcept;
+      ~ScriptImage() noexcept;
+      ScriptImage( const ScriptImage& ) = delete;
+      ScriptImage& operator=( const ScriptImage& ) = delete;
+      static uint64_t hash( std::string_view script ) noexcept;
+      static std::string path( const char* directory, uint64_t hash );
+      static void compile( std::string_view script, std::string& image );
+      static bool write( const std::string& path, const std::string& image ) noexcept;
+      bool open( const char* path, uint64_t hash ) noexcept;
+      bool use( const std::string& image, uint64_t hash ) noexcept;   // The image has to outlive this.
+      void close() noexcept;
+      // The next record: an action rebuilt into state, or otherwise a line's text. False at the end.
+      bool next( shell_state& state, std::string_view& text ) noexcept;
+      // The next record if it is a line's text, for the lines of a << document.
+      bool next_line( std::string_view& text ) noexcept;
+   };
+}
+#endif
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "script_cache.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* cache_directory = "/tmp/shelltest-shc";
+
+   std::vector< std::string > words( const std::pmr::vector< std::pmr::string >& texts ) {
+      return std::vector< std::string >( texts.begin(), texts.end() );
+   }
+
+   // What the records of a script's image come back as: a pipeline's description, "cd: " and the directory,
+   // "variables: " and the words, or "text: " and the line.
+   std::vector< std::string > records_of( const std::string& script ) {
+      std::vector< std::string > records;
+      std::string compiled;
+      std::string_view text;
+      ScriptImage image;
+
+      ScriptImage::compile( script, compiled );
+      EXPECT_TRUE( image.use( compiled, ScriptImage::hash( script ) ) );
+      for ( ;; ) {
+         shell_state state;
+         if ( !image.next( state, text ) )
+            break;
+         if ( RunCommandsAction* pipeline = dynamic_cast< RunCommandsAction* >( state.action ) ) {
+            records.push_back( pipeline->describe() );
+         }
+         else if ( ChangeDirectoryAction* change = dynamic_cast< ChangeDirectoryAction* >( state.action ) ) {
+            records.push_back( "cd: " + std::string( change->new_directory ) );
+         }
+         else if ( VariablesAction* variables = dynamic_cast< VariablesAction* >( state.action ) ) {
+            records.push_back( "variables:" );
+            for ( const std::pmr::string& word : variables->words )
+               records.back().append( " " ).append( word );
+         }
+         else {
+            EXPECT_EQ( nullptr, state.action );
+            records.push_back( "text: " + std::string( text ) );
+         }
+      }
+      return records;
+   }
+
+   TEST( ScriptImage, PipelinesComeBackWithoutParsing ) {
+      std::string script = "time -p pipesize -d 64K A=1 sort -r < in | uniq -c > out &";
+      std::string compiled;
+      std::string_view text;
+      ScriptImage image;
+      shell_state state;
+
+      ScriptImage::compile( script, compiled );
+      ASSERT_TRUE( image.use( compiled, ScriptImage::hash( script ) ) );
+      ASSERT_TRUE( image.next( state, text ) );
+
+      RunCommandsAction* pipeline = static_cast< RunCommandsAction* >( state.action );
+      ASSERT_NE( nullptr, pipeline );
+      EXPECT_EQ( 2, pipeline->numberOfCommands );
+      EXPECT_TRUE( pipeline->runInBackground );
+      EXPECT_TRUE( pipeline->timed );
+      EXPECT_EQ( time_format::posix, pipeline->time_with );
+      EXPECT_EQ( 64u * 1024, pipeline->pipe_size );
+      EXPECT_TRUE( pipeline->packet_pipes );
+      EXPECT_EQ( ( std::vector< std::string >{ "A=1" } ), words( pipeline->commands.front()->assignments ) );
+      EXPECT_EQ( ( std::vector< std::string >{ "sort", "-r" } ), words( pipeline->commands.front()->args ) );
+      EXPECT_EQ( "in", pipeline->commands.front()->input_file );
+      EXPECT_EQ( "out", pipeline->commands.back()->output_file );
+
+      shell_state after;
+      EXPECT_FALSE( image.next( after, text ) );
+   }
+
+   TEST( ScriptImage, BuiltinsComeBackToo ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "cd: /tmp", "ls -l", "variables: A=1 B", "variables: C=$A" } ),
+                 records_of( "cd /tmp\nls -l\n\n   \nexport A=1 B\nC=$A" ) );
+   }
+
+   TEST( ScriptImage, OtherLinesStayText ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "text: set -o pipefail", "text: |", "wc -l < a", "text: jobs" } ),
+                 records_of( "set -o pipefail\n|\nwc -l < a\njobs" ) );
+   }
+
+   TEST( ScriptImage, HereDocumentsStayText ) {
+      EXPECT_EQ( ( std::vector< std::string >{ "cat << END", "text: ls", "text: ", "text: END", "cat <<< word", "ls" } ),
+                 records_of( "cat <<END\nls\n\nEND\ncat <<< word\nls\n" ) );
+   }
+
+   TEST( ScriptImage, OnlyForTheScriptItWasCompiledFrom ) {
+      std::string compiled;
+      ScriptImage image;
+
+      ScriptImage::compile( "ls\n", compiled );
+      EXPECT_TRUE( image.use( compiled, ScriptImage::hash( "ls\n" ) ) );
+      EXPECT_FALSE( image.use( compiled, ScriptImage::hash( "ls" ) ) );
+      EXPECT_NE( ScriptImage::hash( "ls -l | wc -l > a" ), ScriptImage::hash( "ls -l | wc -l > b" ) );
+   }
+
+   TEST( ScriptImage, DamagedImagesAreIgnored ) {
+      std::string script = "ls -l | wc -l\ncd /\n", compiled, damaged;
+      uint64_t hash = ScriptImage::hash( script );
+      ScriptImage image;
+
+      ScriptImage::compile( script, compiled );
+      for ( size_t size = 0; size < compiled.size(); ++size )
+         EXPECT_FALSE( image.use( damaged = compiled.substr( 0, size ), hash ) ) << size;
+      EXPECT_FALSE( image.use( damaged = compiled + "x", hash ) );
+      damaged = compiled;
+      damaged[ damaged.size() - 6 ] = 100;                   // The length of the last line's text.
+      EXPECT_FALSE( image.use( damaged, hash ) );
+   }
+
+   TEST( ScriptImage, WrittenAndMapped ) {
+      std::string script = "ls -1 | head -n 2\n", compiled;
+      uint64_t hash = ScriptImage::hash( script );
+      std::string path = ScriptImage::path( cache_directory, hash );
+      std::string_view text;
+      ScriptImage image;
+      shell_state state;
+
+      system( ( std::string( "rm -rf " ) + cache_directory ).c_str() );
+      EXPECT_FALSE( image.open( path.c_str(), hash ) );
+      ScriptImage::compile( script, compiled );
+      ASSERT_TRUE( ScriptImage::write( path, compiled ) );
+      ASSERT_TRUE( image.open( path.c_str(), hash ) );
+      ASSERT_TRUE( image.next( state, text ) );
+      EXPECT_EQ( "ls -1 | head -n 2", static_cast< RunCommandsAction* >( state.action )->describe() );
+      image.close();
+      system( ( std::string( "rm -rf " ) + cache_directory ).c_str() );
+   }
+}
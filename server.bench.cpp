@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "server.h"
+
+using namespace shell;
+
+namespace {
+   const char* socket_path = "/tmp/shellbench-server.sock";
+
+   // shell and shellc are built next to shellbench.
+   std::string sibling( const char* name ) {
+      char self[ PATH_MAX ];
+      ssize_t n = readlink( "/proc/self/exe", self, sizeof( self ) - 1 );
+      std::string path( self, n > 0 ? n : 0 );
+
+      return path.substr( 0, path.rfind( '/' ) + 1 ) + name;
+   }
+
+   pid_t run( const std::vector< std::string >& args, int in_fd ) {
+      std::vector< char* > argv;
+      posix_spawn_file_actions_t actions;
+      pid_t pid = -1;
+
+      for ( const std::string& arg : args )
+         argv.push_back( const_cast< char* >( arg.c_str() ) );
+      argv.push_back( nullptr );
+
+      posix_spawn_file_actions_init( &actions );
+      if ( in_fd >= 0 )
+         posix_spawn_file_actions_adddup2( &actions, in_fd, STDIN_FILENO );
+      posix_spawn_file_actions_addopen( &actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0 );
+      posix_spawn( &pid, argv[0], &actions, NULL, argv.data(), environ );
+      posix_spawn_file_actions_destroy( &actions );
+
+      return pid;
+   }
+
+   pid_t start_server() {
+      pid_t server = run( { sibling( "shell" ), "--serve", socket_path }, -1 );
+      int status;
+
+      for ( int tries = 0; tries < 200 && !request( socket_path, "", status ); ++tries )
+         usleep( 10000 );
+      return server;
+   }
+
+   void stop_server( pid_t server ) {
+      kill( server, SIGTERM );
+      waitpid( server, NULL, 0 );
+      unlink( socket_path );
+   }
+
+   // The baseline: a fresh shell for every command, reading it from stdin.
+   void fork_exec_shell( benchmark::State& st ) {
+      std::string shell = sibling( "shell" );
+      int input = memfd_create( "input", MFD_CLOEXEC );
+
+      write( input, "true\n", 5 );
+      for ( auto _ : st ) {
+         lseek( input, 0, SEEK_SET );
+         waitpid( run( { shell, "-t" }, input ), NULL, 0 );
+      }
+      close( input );
+   }
+
+   // The same command through shellc, which is what a script would do.
+   void shellc_request( benchmark::State& st ) {
+      std::string client = sibling( "shellc" );
+      pid_t server = start_server();
+
+      for ( auto _ : st )
+         waitpid( run( { client, socket_path, "true" }, -1 ), NULL, 0 );
+      stop_server( server );
+   }
+
+   // Straight from a process that talks to the socket itself, which is what an orchestrator can do.
+   void server_request( benchmark::State& st ) {
+      pid_t server = start_server();
+      int status;
+
+      for ( auto _ : st )
+         request( socket_path, "true", status );
+      stop_server( server );
+   }
+
+   BENCHMARK( fork_exec_shell )->UseRealTime()->Unit( benchmark::kMicrosecond );
+   BENCHMARK( shellc_request )->UseRealTime()->Unit( benchmark::kMicrosecond );
+   BENCHMARK( server_request )->UseRealTime()->Unit( benchmark::kMicrosecond );
+}
@@ -0,0 +1,150 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <iostream>
+#include <string>
+
+#include "server.h"
+#include "shell.h"
+#include "command_hash.h"
+
+namespace shell
+{
+   extern int run_script( int fd );
+
+   static int answer_fd = -1;
+
+   // Runs at exit, so `exit` on one of the lines still gets its answer to the client; after the output, which
+   // the client may well be waiting to read once it has its answer.
+   static void answer() noexcept
+   {
+      int status = session().status;
+
+      std::cout.flush();
+      std::cerr.flush();
+      write( answer_fd, &status, sizeof( status ) );
+   }
+
+   // The fds arrive with the first bytes, the rest is read until the client shuts down its side.
+   static bool receive_request( int connection, int fds[3], std::string& text ) noexcept
+   {
+      char control[ CMSG_SPACE( 3 * sizeof( int ) ) ];
+      char buffer[ 64 * 1024 ];
+      struct iovec data = { buffer, sizeof( buffer ) };
+      struct msghdr message = {};
+      struct cmsghdr* header;
+      ssize_t n;
+
+      message.msg_iov = &data;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof( control );
+      while ( ( n = recvmsg( connection, &message, MSG_CMSG_CLOEXEC ) ) < 0 && errno == EINTR )
+         ;
+      header = n > 0 ? CMSG_FIRSTHDR( &message ) : NULL;
+      if ( header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN( 3 * sizeof( int ) ) )
+         return false;
+      memcpy( fds, CMSG_DATA( header ), 3 * sizeof( int ) );
+
+      do {
+         if ( n < 0 ) {
+            if ( errno != EINTR )
+               return false;
+            continue;
+         }
+         text.append( buffer, n );
+         if ( text.size() > request_limit )
+            return false;
+      } while ( ( n = read( connection, buffer, sizeof( buffer ) ) ) != 0 );
+
+      return true;
+   }
+
+   // In the child that serves one connection; never returns.
+   static void run_request( int listener, int connection ) noexcept
+   {
+      std::string text;
+      std::string_view lines;
+      size_t split;
+      int fds[3], script;
+
+      close( listener );
+      signal( SIGCHLD, SIG_DFL );                           // This one does wait for its children.
+      if ( !receive_request( connection, fds, text ) || ( split = text.find( '\0' ) ) == std::string::npos )
+         _exit( 2 );
+
+      for ( int i = 0; i < 3; ++i ) {
+         dup2( fds[i], i );
+         close( fds[i] );
+      }
+      answer_fd = connection;
+      atexit( answer );
+
+      if ( chdir( text.c_str() ) < 0 ) {
+         std::cerr << "shell: " << text.c_str() << ": " << strerror( errno ) << "\n";
+         session().status = 1;
+         exit( 1 );
+      }
+
+      lines = std::string_view( text ).substr( split + 1 );
+      script = memfd_create( "request", MFD_CLOEXEC );
+      if ( script < 0 || write( script, lines.data(), lines.size() ) != (ssize_t)lines.size() ) {
+         std::cerr << "shell: " << strerror( errno ) << "\n";
+         session().status = 1;
+         exit( 1 );
+      }
+      lseek( script, 0, SEEK_SET );
+
+      run_script( script );
+      exit( session().status );
+   }
+
+   int serve( const char* path ) noexcept
+   {
+      struct sockaddr_un address = {};
+      struct stat existing;
+      int listener, connection;
+
+      if ( strlen( path ) >= sizeof( address.sun_path ) ) {
+         std::cerr << "shell: " << path << ": " << strerror( ENAMETOOLONG ) << "\n";
+         return 1;
+      }
+      address.sun_family = AF_UNIX;
+      strcpy( address.sun_path, path );
+
+      if ( lstat( path, &existing ) == 0 ) {
+         if ( !S_ISSOCK( existing.st_mode ) ) {             // Only ever replace a socket, never someone's file.
+            std::cerr << "shell: " << path << ": " << strerror( EEXIST ) << "\n";
+            return 1;
+         }
+         unlink( path );                                    // A socket left behind by an earlier server.
+      }
+      if ( ( listener = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) < 0
+           || bind( listener, reinterpret_cast< struct sockaddr* >( &address ), sizeof( address ) ) < 0
+           || listen( listener, SOMAXCONN ) < 0 ) {
+         std::cerr << "shell: " << path << ": " << strerror( errno ) << "\n";
+         return 1;
+      }
+
+      signal( SIGCHLD, SIG_IGN );                           // Nobody waits for the children that serve connections.
+      command_hash().validate();                            // What they all inherit, instead of each finding out.
+
+      for ( ;; ) {
+         if ( ( connection = accept4( listener, NULL, NULL, SOCK_CLOEXEC ) ) < 0 ) {
+            if ( errno == EBADF || errno == EINVAL || errno == ENOTSOCK )
+               return 1;
+            continue;                                       // EINTR, a connection reset before we got to it, out of fds.
+         }
+         if ( fork() == 0 )
+            run_request( listener, connection );
+         close( connection );                               // Without a child, the client sees the connection close.
+      }
+   }
+}
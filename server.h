@@ -0,0 +1,23 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string_view>
+
+namespace shell
+{
+   // `shell --serve SOCKET`: one long-lived shell runs command lines for clients on a Unix socket, so that each
+   // of them costs a fork(2) of a shell that is up and running already, rather than starting one from scratch.
+   //
+   // A request is a single connection. The client sends its stdin, stdout and stderr along as SCM_RIGHTS with
+   // the first bytes, which are its working directory, a NUL, and the command lines. Then it shuts down its
+   // side for writing. The lines run in a child of the server, in that directory, on the client's own fds, so
+   // output streams straight to wherever the client's goes and connections never wait for each other. The
+   // answer is the exit status of the last line, as one int, once the lines are done.
+   static const size_t request_limit = 1024 * 1024;        // Working directory and command lines.
+
+   int serve( const char* path ) noexcept;
+
+   // The client's side, for shellc: runs the lines as if in a `shell` started in the current directory.
+   bool request( const char* path, std::string_view lines, int& status ) noexcept;
+}
+#endif
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "server.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* socket_path = "/tmp/shelltest-server.sock";
+
+   std::string read_file( const char* path );
+
+   class ServerTest : public testing::Test {
+   protected:
+      pid_t server = -1;
+
+      void SetUp() override {
+         const char* argv[] = { "../build/shell", "--serve", socket_path, nullptr };
+         int status;
+
+         ASSERT_EQ( 0, posix_spawn( &server, argv[0], NULL, NULL, const_cast< char** >( argv ), environ ) );
+         for ( int tries = 0; tries < 200 && !request( socket_path, "", status ); ++tries )
+            usleep( 10000 );
+      }
+
+      void TearDown() override {
+         kill( server, SIGTERM );
+         waitpid( server, NULL, 0 );
+         unlink( socket_path );
+      }
+   };
+
+   TEST_F( ServerTest, RunsLinesAndAnswersWithTheStatus ) {
+      int status = -1;
+
+      testing::internal::CaptureStdout();
+      EXPECT_TRUE( request( socket_path, "echo one\nls ../test-dir | head -n 2", status ) );
+      EXPECT_EQ( "one\n1\n2\n", testing::internal::GetCapturedStdout() );
+      EXPECT_EQ( 0, status );
+
+      EXPECT_TRUE( request( socket_path, "false", status ) );
+      EXPECT_EQ( 1, status );
+
+      testing::internal::CaptureStderr();
+      EXPECT_TRUE( request( socket_path, "command-that-doesnt-exist", status ) );
+      testing::internal::GetCapturedStderr();
+      EXPECT_EQ( 127, status );
+
+      EXPECT_TRUE( request( socket_path, "true\nexit\necho never", status ) );
+      EXPECT_EQ( 0, status );
+   }
+
+   TEST_F( ServerTest, AnswersWithTheStatusOfBuiltinsAndParseErrors ) {
+      int status = -1;
+
+      testing::internal::CaptureStderr();
+      EXPECT_TRUE( request( socket_path, "cd /nonexistent", status ) );
+      EXPECT_EQ( 1, status );
+
+      EXPECT_TRUE( request( socket_path, "ls |", status ) );
+      EXPECT_EQ( 127, status );
+
+      EXPECT_TRUE( request( socket_path, "false\nexport A=1", status ) );
+      EXPECT_EQ( 0, status );
+      testing::internal::GetCapturedStderr();
+
+      EXPECT_EQ( 1, WEXITSTATUS( system( "../build/shellc /tmp/shelltest-server.sock cd /nonexistent 2> /dev/null" ) ) );
+   }
+
+   TEST_F( ServerTest, EveryConnectionHasItsOwnDirectory ) {
+      char saved[ 4096 ];
+      int status;
+
+      ASSERT_NE( nullptr, getcwd( saved, sizeof( saved ) ) );
+      ASSERT_EQ( 0, chdir( "/tmp" ) );
+      testing::internal::CaptureStdout();
+      EXPECT_TRUE( request( socket_path, "cd /\npwd", status ) );
+      EXPECT_TRUE( request( socket_path, "pwd", status ) );  // The cd above was the other connection's.
+      EXPECT_EQ( "/\n/tmp\n", testing::internal::GetCapturedStdout() );
+      ASSERT_EQ( 0, chdir( saved ) );
+   }
+
+   TEST_F( ServerTest, ConnectionsDontWaitForEachOther ) {
+      std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+      double slow_took = 0, fast_took = 0;
+      int slow_status, fast_status;
+
+      std::thread slow( [&] {
+         request( socket_path, "sleep 0.5", slow_status );
+         slow_took = std::chrono::duration< double >( std::chrono::steady_clock::now() - started ).count();
+      } );
+      usleep( 50000 );
+      request( socket_path, "true", fast_status );
+      fast_took = std::chrono::duration< double >( std::chrono::steady_clock::now() - started ).count();
+      slow.join();
+
+      EXPECT_LT( fast_took, 0.4 );
+      EXPECT_GE( slow_took, 0.5 );
+   }
+
+   TEST_F( ServerTest, Client ) {
+      EXPECT_EQ( 0, system( "cd ../test-dir; ../build/shellc /tmp/shelltest-server.sock cat 1 '|' wc -l > ../build/output" ) );
+      EXPECT_EQ( "3\n", read_file( "output" ) );
+      EXPECT_EQ( 1, WEXITSTATUS( system( "../build/shellc /tmp/shelltest-server.sock false" ) ) );
+      EXPECT_EQ( 255, WEXITSTATUS( system( "../build/shellc /tmp/shelltest-nothing-here.sock true 2> /dev/null" ) ) );
+      EXPECT_EQ( 2, WEXITSTATUS( system( "../build/shellc 2> /dev/null" ) ) );
+   }
+
+   TEST( Server, LeavesAFileThatIsntASocketAlone ) {
+      const char* path = "/tmp/shelltest-not-a-socket";
+
+      ASSERT_EQ( 0, system( "echo keep > /tmp/shelltest-not-a-socket" ) );
+      EXPECT_EQ( 1, WEXITSTATUS( system( "../build/shell --serve /tmp/shelltest-not-a-socket 2> /dev/null" ) ) );
+      EXPECT_EQ( "keep\n", read_file( path ) );
+      unlink( path );
+   }
+
+   //////////////// HELPERS
+
+   std::string read_file( const char* path ) {
+      std::string text;
+      char buffer[ 4096 ];
+      FILE* file = fopen( path, "r" );
+      size_t n;
+
+      if ( !file )
+         return text;
+      while ( ( n = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+         text.append( buffer, n );
+      fclose( file );
+      return text;
+   }
+}
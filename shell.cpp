@@ -23,16 +23,147 @@ Hint: Ctrl-space to auto complete functions and variables
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 
 
 #include <tao/pegtl.hpp>
 
 #include "grammar.cpp"                                      // Would be nicer to extract this into a header file.
 #include "shell.h"
+#include "command_hash.h"
+#include "transfer.h"
+#include "line_reader.h"
+#include "parse_cache.h"
+#include "job_table.h"
+#include "parallel.h"
+#include "builtins.h"
+#include "trace.h"
+#include "process_waiter.h"
+#include "time_report.h"
+#include "history.h"
+#include "line_editor.h"
+#include "completion.h"
+#include "zygote.h"
+#include "globbing.h"
+#include "variables.h"
+#include "here_document.h"
+#include "script_cache.h"
 
 
 namespace shell
 {
+   launcher default_launcher() noexcept
+   {
+      static const launcher configured = [] {
+         const char* name = getenv( "SHELL_LAUNCHER" );    // SHELL_LAUNCHER=fork selects the fallback, =zygote the helper.
+         if ( name && strcmp( name, "fork" ) == 0 )
+            return launcher::fork;
+         if ( name && strcmp( name, "zygote" ) == 0 )
+            return launcher::zygote;
+         return launcher::spawn;
+      }();
+
+      return configured;
+   }
+
+   shell_session& session() noexcept
+   {
+      static shell_session current;
+      return current;
+   }
+
+   // The number $? shows for a wait status.
+   int exit_code( int status ) noexcept
+   {
+      if ( WIFSIGNALED( status ) )
+         return 128 + WTERMSIG( status );
+      if ( WIFSTOPPED( status ) )
+         return 128 + WSTOPSIG( status );
+      return WEXITSTATUS( status );
+   }
+
+   // A byte count with an optional K or M suffix, like 1M.
+   bool parse_size( std::string_view text, size_t& bytes ) noexcept
+   {
+      size_t value = 0, shift = 0;
+      size_t i;
+
+      for ( i = 0; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i ) {
+         if ( value > ( SIZE_MAX - 9 ) / 10 )
+            return false;
+         value = value * 10 + ( text[i] - '0' );
+      }
+      if ( i == 0 )
+         return false;
+      if ( i + 1 == text.size() && ( text[i] == 'K' || text[i] == 'k' ) )
+         shift = 10;
+      else if ( i + 1 == text.size() && ( text[i] == 'M' || text[i] == 'm' ) )
+         shift = 20;
+      else if ( i != text.size() )
+         return false;
+      if ( value > ( SIZE_MAX >> shift ) )
+         return false;
+
+      bytes = value << shift;
+      return true;
+   }
+
+   // What an unprivileged F_SETPIPE_SZ may ask for, read once.
+   static size_t pipe_size_limit() noexcept
+   {
+      static const size_t limit = [] {
+         size_t bytes = 1 << 20;                            // The kernel's default limit.
+         char text[ 32 ] = {};
+         int fd = open( "/proc/sys/fs/pipe-max-size", O_RDONLY | O_CLOEXEC );
+
+         if ( fd >= 0 ) {
+            if ( read( fd, text, sizeof( text ) - 1 ) > 0 )
+               parse_size( std::string_view( text, strcspn( text, "\n" ) ), bytes );
+            close( fd );
+         }
+         return bytes;
+      }();
+
+      return limit;
+   }
+
+   // pipe2(2) with O_CLOEXEC, then the capacity and packet mode asked for where the kernel allows them.
+   // A size past the system maximum gets the maximum; a kernel without packet pipes gets a plain one.
+   int open_pipe( int fds[2], size_t capacity, bool packets ) noexcept
+   {
+      if ( !packets || pipe2( fds, O_CLOEXEC | O_DIRECT ) < 0 ) {
+         if ( pipe2( fds, O_CLOEXEC ) < 0 )
+            return -1;
+      }
+
+      if ( capacity > 0 )
+         fcntl( fds[1], F_SETPIPE_SZ, int( std::min( capacity, pipe_size_limit() ) ) );
+
+      return 0;
+   }
+
+   command::command( std::pmr::memory_resource* arena ) noexcept 
+      : args( arena ), assignments( arena ), input_file( arena ), output_file( arena ), here_string( arena ), here_delimiter( arena ) 
+   {
+   }
+
+   shell_state::shell_state() noexcept 
+      : arena( initial_buffer, sizeof( initial_buffer ) ) 
+   {
+   }
+   shell_state::~shell_state() noexcept
+   {
+      if ( action )
+         action->~ShellAction();                               // Only the destructor, the memory goes with the arena.
+   }
+
    NopAction::NopAction() noexcept { }
    int NopAction::execute() noexcept { return 0; }
 
@@ -42,9 +173,9 @@ namespace shell
       exit( EXIT_SUCCESS );
    }
 
-   ChangeDirectoryAction::ChangeDirectoryAction( std::string directory ) noexcept 
+   ChangeDirectoryAction::ChangeDirectoryAction( std::string_view directory, std::pmr::memory_resource* arena ) noexcept 
+      : new_directory( directory, arena )
    {
-      new_directory = directory;
    }
    int ChangeDirectoryAction::execute() noexcept 
    {
@@ -58,61 +189,517 @@ namespace shell
                std::cerr << "Unknown error";
          }
       }
-      return rc;
+      session().status = rc != 0;
+
+      return session().status;
    }
    
-   RunCommandsAction::RunCommandsAction() noexcept { }
-   char** RunCommandsAction::convert_to_c_args( std::vector< std::string > args ) noexcept 
+   HashAction::HashAction( std::pmr::memory_resource* arena ) noexcept 
+      : names( arena )
+   {
+   }
+   int HashAction::execute() noexcept
    {
-      char** c_args = new char*[args.size()+1];
-      for ( int i = 0; i < args.size(); ++i )
-         c_args[i] = strdup( args[i].c_str() );
-      c_args[args.size()] = NULL;
+      int rc = 0;
 
-      return c_args;
+      if ( rehash ) {
+         command_hash().rehash();                              // hash -r
+      }
+      else {
+         command_hash().validate();
+      }
+
+      for ( const std::pmr::string& name : names ) {
+         if ( !command_hash().remember( name ) ) {
+            std::cerr << "hash: " << name << ": not found\n";
+            rc = 1;
+         }
+      }
+
+      if ( !rehash && names.empty() ) {
+         command_hash().print( std::cout );
+      }
+      session().status = rc;
+
+      return rc;
    }
-   void RunCommandsAction::free_c_args( char** c_args, int number_of_c_args ) noexcept 
+
+   JobControlAction::JobControlAction( builtin which ) noexcept
+      : which( which )
    {
-      for (int i = 0; i < number_of_c_args; ++i)
-         free( c_args[i] );
-      delete[] c_args;
    }
-   void RunCommandsAction::overlayProcess( std::vector< std::string > args ) noexcept 
+   int JobControlAction::execute() noexcept
    {
-      char** c_args = convert_to_c_args( args );
-      execvp( c_args[0], c_args );
-      // there must be an error if we get to here
-      free_c_args( c_args, args.size() );
-      switch ( errno ) {
-         case ENOENT:
-            std::cerr << "command not found\n";
+      int status;
+
+      job_table().reap();                                      // Report what is known now, not as of the last prompt.
+
+      switch ( which ) {
+         case builtin::jobs:
+            job_table().print( std::cout );
+            status = 0;
+            break;
+         case builtin::foreground:
+            status = job_table().foreground( job );
+            break;
+         case builtin::background:
+            status = job_table().background( job );
             break;
          default:
-            std::cerr << "unknown error\n";
+            status = pid != 0
+               ? job_table().wait_pid( pid )
+               : job_table().wait( job );
       }
-      std::exit( EXIT_FAILURE );
+      session().status = exit_code( status );
+
+      return status;
    }
-   void RunCommandsAction::read_from_file( std::string input_file ) noexcept 
+
+   SetOptionAction::SetOptionAction( std::pmr::memory_resource* arena ) noexcept 
+      : name( arena ), value( arena )
    {
-      int fd = open( input_file.c_str(), O_RDONLY, S_IRUSR );
-      close( STDIN_FILENO );
-      dup( fd );
    }
-   void RunCommandsAction::write_to_file( std::string output_file ) noexcept 
-   { 
-      int fd = open( output_file.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR );
-      close( STDOUT_FILENO );
-      dup( fd );
+   int SetOptionAction::execute() noexcept
+   {
+      size_t bytes = 0;
+
+      if ( name.empty() ) {                                    // set -o
+         std::cout << "packetpipes\t" << ( session().packet_pipes ? "on" : "off" ) << "\n"
+                   << "pipefail\t" << ( session().pipefail ? "on" : "off" ) << "\n"
+                   << "pipesize\t" << session().pipe_size << "\n";
+         return session().status = 0;
+      }
+
+      if ( name == "pipesize" ) {
+         if ( enable && !parse_size( value, bytes ) ) {
+            std::cerr << "set: pipesize: " << ( value.empty() ? "needs a size" : "invalid size " + std::string( value ) ) << "\n";
+            return session().status = 1;
+         }
+         session().pipe_size = bytes;                          // set +o pipesize goes back to the default.
+      }
+      else if ( name == "pipefail" ) {
+         session().pipefail = enable;
+      }
+      else if ( name == "packetpipes" ) {
+         session().packet_pipes = enable;
+      }
+      else {
+         std::cerr << "set: " << name << ": invalid option name\n";
+         return session().status = 1;
+      }
+
+      return session().status = 0;
    }
-   void RunCommandsAction::read_from_pipe( std::array< int, 2 > pipe ) noexcept 
+
+   HistoryAction::HistoryAction() noexcept
    {
-      dup2( pipe[0], 0 );
-      close( pipe[1] );
    }
-   void RunCommandsAction::write_to_pipe( std::array< int, 2 > pipe ) noexcept 
+   int HistoryAction::execute() noexcept
    {
-      close( pipe[0] );
-      dup2( pipe[1], 1 );
+      std::string_view text;
+      size_t total, shown;
+      char number[ 32 ];
+
+      history().refresh();
+      total = history().size();
+      shown = count == 0 || count > total ? total : count;
+
+      for ( size_t age = shown; age-- > 0 && history().entry( age, text ); ) {
+         snprintf( number, sizeof( number ), "%5zu  ", total - age );
+         std::cout << number << text << "\n";
+      }
+
+      return session().status = 0;
+   }
+
+   VariablesAction::VariablesAction( builtin which, std::pmr::memory_resource* arena ) noexcept
+      : which( which ), words( arena )
+   {
+   }
+   int VariablesAction::execute() noexcept
+   {
+      std::string value;
+      std::string_view name;
+      size_t equals;
+
+      if ( which == builtin::exports && words.empty() ) {
+         variables().print_exported( std::cout );
+         return session().status = 0;
+      }
+
+      for ( const std::pmr::string& word : words ) {
+         equals = word.find( '=' );
+         name = std::string_view( word ).substr( 0, equals );
+         if ( which == builtin::unset ) {
+            variables().unset( name );
+            continue;
+         }
+         if ( equals != std::pmr::string::npos ) {
+            variables().expand( std::string_view( word ).substr( equals + 1 ), session().status, value );
+            variables().set( name, value );
+         }
+         if ( which == builtin::exports )
+            variables().export_name( name );
+      }
+      variables().envp();                                      // environ follows right away, for getenv(3) in the shell.
+
+      return session().status = 0;
+   }
+
+   ParallelAction::ParallelAction( std::pmr::memory_resource* arena ) noexcept
+      : command( arena ), inputs( arena ), input_file( arena )
+   {
+   }
+   bool ParallelAction::inherits_stdin() noexcept
+   {
+      return !has_inputs && input_file.empty();
+   }
+   // Exits with the number of failed jobs, at most 101, like GNU parallel.
+   int ParallelAction::execute() noexcept
+   {
+      std::vector< std::string > lines;
+      std::vector< std::string_view > given;
+      std::vector< int > statuses;
+      std::string_view line;
+      size_t failed;
+      int fd;
+
+      if ( command.empty() ) {
+         std::cerr << "parallel: missing command\n";
+         return 1;
+      }
+
+      if ( has_inputs ) {
+         given.assign( inputs.begin(), inputs.end() );
+      }
+      else {
+         if ( ( fd = input_file.empty() ? STDIN_FILENO : open( input_file.c_str(), O_RDONLY | O_CLOEXEC ) ) < 0 ) {
+            std::cerr << input_file << ": " << strerror( errno ) << "\n";
+            return 1;
+         }
+         LineReader reader( fd, fd != STDIN_FILENO );
+         while ( reader.next_line( line ) )
+            lines.emplace_back( line );
+         given.assign( lines.begin(), lines.end() );
+      }
+
+      command_hash().validate();
+      ParallelRunner runner( std::vector< std::string >( command.begin(), command.end() ), slots ? slots : ParallelRunner::default_slots(), STDOUT_FILENO );
+      failed = runner.run( given, statuses );
+
+      session().status = std::min< size_t >( failed, 101 );
+
+      return W_EXITCODE( session().status, 0 );
+   }
+
+   RunCommandsAction::RunCommandsAction( std::pmr::memory_resource* arena ) noexcept 
+      : commands( arena )
+   {
+   }
+   RunCommandsAction::~RunCommandsAction() noexcept
+   {
+      for ( command* cmd : commands )
+         cmd->~command();                                      // Allocated from the same arena as this action.
+   }
+   bool RunCommandsAction::inherits_stdin() noexcept
+   {
+      return !has_file_input( peek_first_command() ) && !has_text_input( peek_first_command() );
+   }
+   std::string* RunCommandsAction::here_document( size_t i, std::string_view& delimiter ) noexcept
+   {
+      if ( i > 0 || peek_first_command()->here_delimiter.empty() )
+         return nullptr;
+
+      delimiter = peek_first_command()->here_delimiter;
+      return &here_document_text;
+   }
+   // The pipeline as the user would have typed it, for the job table and `time`.
+   std::string RunCommandsAction::describe() const noexcept
+   {
+      std::string text;
+
+      for ( const command* cmd : commands ) {
+         if ( !text.empty() )
+            text += " | ";
+         describe( cmd, text );
+      }
+      if ( runInBackground )
+         text += " &";
+
+      return text;
+   }
+   void RunCommandsAction::describe( const command* cmd, std::string& text ) noexcept
+   {
+      for ( const std::pmr::string& assignment : cmd->assignments )
+         text.append( assignment ) += ' ';
+      for ( size_t i = 0; i < cmd->args.size(); ++i ) {
+         if ( i > 0 )
+            text += ' ';
+         text += cmd->args[i];
+      }
+      if ( !cmd->input_file.empty() )
+         text.append( " < " ).append( cmd->input_file );
+      if ( !cmd->here_string.empty() )
+         text.append( " <<< " ).append( cmd->here_string );
+      if ( !cmd->here_delimiter.empty() )
+         text.append( " << " ).append( cmd->here_delimiter );
+      if ( !cmd->output_file.empty() )
+         text.append( " > " ).append( cmd->output_file );
+   }
+   static bool is_expandable( std::string_view word ) noexcept
+   {
+      return word.find( '$' ) != std::string_view::npos || Glob::is_pattern( word );
+   }
+   // The words with variables and patterns expanded, in expanded, or the words themselves when they have neither.
+   // A word that expands to nothing is dropped, as long as that leaves a command.
+   static const std::pmr::vector< std::pmr::string >& expand_words( const std::pmr::vector< std::pmr::string >& words, Glob& glob, std::pmr::vector< std::pmr::string >& expanded ) noexcept
+   {
+      std::string text;
+      std::string_view word;
+
+      if ( std::none_of( words.begin(), words.end(), []( const std::pmr::string& word ) { return is_expandable( word ); } ) )
+         return words;
+
+      expanded.clear();
+      for ( const std::pmr::string& original : words ) {
+         word = original;
+         if ( variables().expand( word, session().status, text ) ) {
+            if ( text.empty() )
+               continue;
+            word = text;
+         }
+         if ( Glob::is_pattern( word ) )
+            glob.expand( word, expanded );
+         else
+            expanded.emplace_back( word );
+      }
+      if ( expanded.empty() )
+         expanded.emplace_back();
+      return expanded;
+   }
+   // The NAME=value prefixes, with their values expanded.
+   static void expand_assignments( const std::pmr::vector< std::pmr::string >& assignments, std::vector< std::string >& expanded ) noexcept
+   {
+      std::string value;
+      size_t equals;
+
+      expanded.clear();
+      for ( const std::pmr::string& assignment : assignments ) {
+         equals = assignment.find( '=' );
+         variables().expand( std::string_view( assignment ).substr( equals + 1 ), session().status, value );
+         expanded.emplace_back( assignment.substr( 0, equals + 1 ) ).append( value );
+      }
+   }
+   static bool is_substitution( std::string_view word ) noexcept
+   {
+      return word.size() >= 3 && ( word[0] == '<' || word[0] == '>' ) && word[1] == '(' && word.back() == ')';
+   }
+   // Starts the pipeline of a <(...) or >(...) in the background, on one end of a new pipe, and gives the other end.
+   static int start_substitution( std::string_view word, std::vector< pid_t >& pids ) noexcept
+   {
+      std::shared_ptr< ShellAction > action;
+      RunCommandsAction* pipeline;
+      bool reads = word[0] == '>';                          // >(...) reads what the command writes to it.
+      int fds[2];
+
+      try {
+         action = parse_cache().parse( word.substr( 2, word.size() - 3 ) );
+      }
+      catch ( std::exception& ) {
+      }
+      if ( ( pipeline = dynamic_cast< RunCommandsAction* >( action.get() ) ) == nullptr || pipeline->runInBackground ) {
+         std::cerr << word << ": not a pipeline\n";
+         return -1;
+      }
+      if ( pipe2( fds, O_CLOEXEC ) < 0 ) {
+         std::cerr << word << ": " << strerror( errno ) << "\n";
+         return -1;
+      }
+
+      pipeline->start_substituted( reads ? fds[0] : fds[1], reads, pids );
+      close( reads ? fds[0] : fds[1] );
+      return reads ? fds[1] : fds[0];
+   }
+   // The words with each <(...) and >(...) started and replaced by /dev/fd/N for the shell's end of its pipe, in
+   // substituted, or the words themselves when there are none. The plan holds on to the fds until the stages are started.
+   const std::pmr::vector< std::pmr::string >& RunCommandsAction::substitute_processes( const std::pmr::vector< std::pmr::string >& words, stage_plan& stage, std::pmr::vector< std::pmr::string >& substituted ) noexcept
+   {
+      int fd;
+
+      if ( std::none_of( words.begin(), words.end(), []( const std::pmr::string& word ) { return is_substitution( word ); } ) )
+         return words;
+
+      substituted.clear();
+      stage.first_substitution = plan->substituted_fds.size();
+      for ( const std::pmr::string& word : words ) {
+         if ( !is_substitution( word ) || ( fd = start_substitution( word, plan->substituted_pids ) ) < 0 ) {
+            substituted.emplace_back( word );
+            continue;
+         }
+         plan->substituted_fds.push_back( fd );
+         substituted.emplace_back( "/dev/fd/" ).append( std::to_string( fd ) );
+      }
+      stage.substitutions = plan->substituted_fds.size() - stage.first_substitution;
+      plan->reusable = false;                               // Started anew with every run.
+
+      return substituted;
+   }
+   // The stages that refer to them have their own copies by now.
+   void RunCommandsAction::close_substitutions() noexcept
+   {
+      for ( int fd : plan->substituted_fds )
+         close( fd );
+      plan->substituted_fds.clear();
+   }
+   void RunCommandsAction::start_substituted( int fd, bool reads, std::vector< pid_t >& pids ) noexcept
+   {
+      bool background = runInBackground;
+
+      standard_fds[ reads ? 0 : 1 ] = fd;
+      substituted_into = &pids;
+      runInBackground = true;                               // Runs alongside the command that reads or writes it.
+      execute();
+      runInBackground = background;
+      substituted_into = nullptr;
+      standard_fds = { -1, -1 };
+   }
+   int RunCommandsAction::shared_fd( int standard ) const noexcept
+   {
+      return standard_fds[ standard ] >= 0 ? standard_fds[ standard ] : standard;
+   }
+   // What a <<< string or << document gives as stdin, with its variables expanded, in text.
+   static void expand_input_text( const command* cmd, const std::string& document, std::string& text ) noexcept
+   {
+      if ( !cmd->here_string.empty() ) {
+         variables().expand( cmd->here_string, session().status, text );
+         text += '\n';
+      }
+      else {
+         variables().expand( document, session().status, text );
+      }
+   }
+   // Turns the parsed pipeline into a plan once, so repeated runs of the same line skip path lookups and argv copies.
+   ExecutionPlan* RunCommandsAction::compiled_plan() noexcept
+   {
+      std::pmr::list< command* >::const_iterator next_command;
+      std::pmr::vector< std::pmr::string > expanded, substituted;
+      std::vector< std::string > assignments;
+      std::string text;
+      Glob glob;                                            // Directory listings shared by every pattern on the line.
+      const char* path;
+      bool in_shell = !runInBackground;                     // A job in the background outlives the line, its stages are processes to wait for.
+      bool has_prev, has_next;
+      int i;
+
+      if ( plan && plan->is_current( zero_copy && in_shell, builtins && in_shell ) )
+         return plan.get();
+
+      plan.reset( new ExecutionPlan );
+      plan->generation = command_hash().generation();
+      plan->zero_copy = zero_copy && in_shell;
+      plan->builtins = builtins && in_shell;
+      plan->stages.reserve( numberOfCommands );
+
+      next_command = commands.begin();
+      for ( i = 0; i < numberOfCommands; i++ ) {
+         command* cmd = *next_command++;
+         stage_plan& stage = plan->stages.emplace_back();
+         const std::pmr::vector< std::pmr::string >& args = expand_words( substitute_processes( cmd->args, stage, substituted ), glob, expanded );
+         has_prev = i != 0;
+         has_next = i != numberOfCommands - 1;
+
+         if ( has_prev ) {
+            stage.input.from = redirect::source::pipe;
+         }
+         else if ( has_file_input( cmd ) ) {
+            stage.input = { redirect::source::file, plan->copy( cmd->input_file ), O_RDONLY };
+         }
+         else if ( has_text_input( cmd ) ) {
+            expand_input_text( cmd, here_document_text, text );
+            stage.input = { redirect::source::text, plan->copy( text ), 0, text.size() };
+            plan->reusable = false;                         // The document is read again with every run.
+         }
+
+         if ( has_next ) {
+            stage.output.from = redirect::source::pipe;
+         }
+         else if ( has_file_output( cmd ) ) {
+            stage.output = { redirect::source::file, plan->copy( cmd->output_file ), O_RDWR | O_CREAT };
+         }
+
+         if ( in_shell && is_pass_through( cmd, has_prev, has_next ) ) {
+            stage.how = stage_plan::kind::transfer;
+            continue;
+         }
+
+         if ( ( path = command_hash().lookup( args[0] ) ) == nullptr ) {
+            stage.how = stage_plan::kind::missing;
+         }
+         else {
+            stage.how = stage_plan::kind::process;
+            stage.path = plan->copy( path );
+         }
+         stage.argv = plan->convert_to_c_args( args );
+
+         if ( plan->builtins && ( stage.tool = find_builtin( args[0] ) ) ) {
+            if ( stage.tool->accepts( stage.argv ) )
+               stage.how = stage_plan::kind::builtin;
+            else
+               stage.tool = nullptr;                        // Asks for something only the real tool does.
+         }
+
+         if ( args[0].find( '/' ) == std::pmr::string::npos && command_hash().depends_on_cwd() )
+            plan->reusable = false;                         // Found relative to the current directory, look again next time.
+         if ( &args == &expanded )
+            plan->reusable = false;                         // What a pattern or a variable expands to can change by the next run.
+
+         if ( !cmd->assignments.empty() ) {
+            expand_assignments( cmd->assignments, assignments );
+            if ( !plan->environment )
+               plan->environment = variables().environment();
+            stage.envp = plan->convert_to_c_env( plan->environment->pointers.data(), assignments );
+            plan->reusable = false;
+         }
+      }
+
+      return plan.get();
+   }
+   static const char* exec_error_message( int error ) noexcept
+   {
+      switch ( error ) {
+         case ENOENT:
+            return "command not found\n";
+         default:
+            return "unknown error\n";
+      }
+   }
+   void RunCommandsAction::report_exec_error( int error ) noexcept
+   {
+      std::cerr << exec_error_message( error );
+   }
+   // Gives the fd a stage should see on one end, or -1 when it keeps the shell's own. Files are opened here, in the parent.
+   // shared_fd is the pipe, or what stands in for the shell's own fd.
+   bool RunCommandsAction::open_redirect( const redirect& end, int shared_fd, int& fd ) noexcept
+   {
+      switch ( end.from ) {
+         case redirect::source::pipe:
+         case redirect::source::inherit:
+            fd = shared_fd;
+            return true;
+         case redirect::source::file:
+            if ( ( fd = open( end.path, end.flags | O_CLOEXEC, S_IRUSR | S_IWUSR ) ) < 0 ) {
+               std::cerr << end.path << ": " << strerror( errno ) << "\n";
+               return false;
+            }
+            return true;
+         case redirect::source::text:
+            if ( ( fd = open_document( std::string_view( end.path, end.size ) ) ) < 0 ) {
+               std::cerr << "here-document: " << strerror( errno ) << "\n";
+               return false;
+            }
+            return true;
+      }
+      return false;
    }
    void RunCommandsAction::close_pipe( std::array< int, 2 > pipe ) noexcept 
    {
@@ -123,55 +710,326 @@ namespace shell
    {
       return cmd->input_file != "";
    }
+   bool RunCommandsAction::has_text_input( command * cmd ) noexcept
+   {
+      return !cmd->here_string.empty() || !cmd->here_delimiter.empty();
+   }
    bool RunCommandsAction::has_file_output( command * cmd ) noexcept 
    {
       return cmd->output_file != "";
    }
    // This would have been nicer with std::optional (C++17) which doesn't compile on MacOSX.
-   pid_t RunCommandsAction::execute_chained( command* cmd, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe ) noexcept 
+   // A pgid of -1 keeps the stage in the shell's process group. With job control the first stage started becomes the leader.
+   pid_t RunCommandsAction::execute_chained( const stage_plan& stage, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe, pid_t& pgid ) noexcept 
+   {
+      int in_fd = -1, out_fd = -1;
+      pid_t pid = -1;
+
+      if ( stage.path == nullptr ) {
+         report_exec_error( ENOENT );                       // Known to be missing, don't bother starting a process.
+      }
+      else if ( open_redirect( stage.input, has_prev_pipe ? prev_pipe[0] : standard_fds[0], in_fd )
+                && open_redirect( stage.output, has_next_pipe ? next_pipe[1] : standard_fds[1], out_fd ) ) {
+         trace_span span( "spawn", stage.path );
+         switch ( launch_with ) {
+            case launcher::spawn:
+               pid = spawn_chained( stage, in_fd, out_fd, pgid );
+               break;
+            case launcher::fork:
+               pid = fork_chained( stage, in_fd, out_fd, pgid );
+               break;
+            case launcher::zygote:
+               pid = zygote_chained( stage, in_fd, out_fd, pgid );
+               break;
+         }
+         if ( pid > 0 && tracer().enabled() )
+            tracer().process_started( pid, stage.argv[0] );
+      }
+
+      if ( pid > 0 && pgid == 0 ) {
+         pgid = pid;
+         if ( !runInBackground )
+            job_table().give_terminal_to( pgid );
+      }
+
+      if ( ( stage.input.from == redirect::source::file || stage.input.from == redirect::source::text ) && in_fd >= 0 )
+         close( in_fd );                                    // The child has its own copy now.
+      if ( stage.output.from == redirect::source::file && out_fd >= 0 )
+         close( out_fd );
+
+      if ( has_prev_pipe ) {                                // If there is a previous pipe, the parent no longer needs it.
+         close_pipe( prev_pipe );
+      }
+
+      return pid;
+   }
+   // Everything was opened with O_CLOEXEC beforehand, so the child is told nothing but which fds go where.
+   pid_t RunCommandsAction::spawn_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept
+   {
+      posix_spawn_file_actions_t actions;
+      posix_spawnattr_t attributes;
+      pid_t pid;
+      int rc;
+
+      posix_spawn_file_actions_init( &actions );
+      posix_spawnattr_init( &attributes );
+      if ( in_fd >= 0 )
+         posix_spawn_file_actions_adddup2( &actions, in_fd, STDIN_FILENO );
+      if ( out_fd >= 0 )
+         posix_spawn_file_actions_adddup2( &actions, out_fd, STDOUT_FILENO );
+      for ( unsigned i = 0; i < stage.substitutions; ++i ) {
+         int fd = plan->substituted_fds[ stage.first_substitution + i ];
+         posix_spawn_file_actions_adddup2( &actions, fd, fd );    // Onto itself only clears O_CLOEXEC.
+      }
+      job_table().prepare_spawn( &attributes, &actions, pgid, !runInBackground );
+
+      rc = posix_spawn( &pid, stage.path, &actions, &attributes, stage.argv, stage.envp ? stage.envp : variables().envp() );
+      posix_spawnattr_destroy( &attributes );
+      posix_spawn_file_actions_destroy( &actions );
+
+      if ( rc != 0 ) {                                      // The exec failed in the child, which has already exited.
+         report_exec_error( rc );
+         return -1;
+      }
+
+      return pid;
+   }
+   // Moves fd onto target in the child, keeping it open across exec even when it already is the target.
+   static void redirect_to( int fd, int target ) noexcept
+   {
+      if ( fd < 0 )
+         return;
+      if ( fd == target )
+         fcntl( fd, F_SETFD, 0 );
+      else
+         dup2( fd, target );
+   }
+   pid_t RunCommandsAction::fork_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept
    {
+      char** envp = stage.envp ? stage.envp : variables().envp();
+      const int* substituted = plan->substituted_fds.data() + stage.first_substitution;
+      const char* message;
       pid_t pid;
 
       if ( (pid = fork()) < 0 ) {
          std::exit( EXIT_FAILURE );                         // Fork failed.
       }
-      else if ( pid == 0 ) {                                // In child process.
-         if ( has_prev_pipe ) {                             // If there is a previous pipe, read from it.
-            read_from_pipe( prev_pipe );
-         } 
-         else if ( has_file_input( cmd ) ) {                // First process in the chain, check if input should be read from file.
-            read_from_file( cmd->input_file );
-         }
+      else if ( pid == 0 ) {                                // In child process, only async-signal-safe calls from here on.
+         job_table().prepare_child( pgid, !runInBackground );
+         redirect_to( in_fd, STDIN_FILENO );
+         redirect_to( out_fd, STDOUT_FILENO );
+         for ( unsigned i = 0; i < stage.substitutions; ++i )
+            redirect_to( substituted[i], substituted[i] );
+         execve( stage.path, stage.argv, envp );            // Overlay the process image with that of the command.
 
-         if ( has_next_pipe ) {
-            write_to_pipe( next_pipe );                     // If there is a next pipe, write to it.
-         }
-         else if ( has_file_output( cmd ) ) {               // Last process in the chain, check if output should be written to file.
-            write_to_file( cmd->output_file );
-         }
-
-         overlayProcess( cmd->args );                       // Overlay the process image with that of the command.
+         message = exec_error_message( errno );             // There must be an error if we get to here.
+         write( STDERR_FILENO, message, strlen( message ) );
+         _exit( EXIT_FAILURE );
       }
-      else {                                                // In parent process.
-         if ( has_prev_pipe ) {                             // If there is a previous pipe, close it.
-            close_pipe( prev_pipe );
-         };
+
+      if ( pgid >= 0 )
+         setpgid( pid, pgid ? pgid : pid );                 // Also from this side, whichever of us gets there first.
+
+      return pid;
+   }
+   // Falls back to posix_spawn when there is no helper, or it can't take this one. The helper only passes on stdio.
+   pid_t RunCommandsAction::zygote_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept
+   {
+      pid_t pid;
+      int error;
+
+      if ( stage.substitutions > 0 || !zygote().spawn( stage.path, stage.argv, stage.envp ? stage.envp : variables().envp(), in_fd, out_fd, pgid, !runInBackground, pid, error ) )
+         return spawn_chained( stage, in_fd, out_fd, pgid );
+
+      if ( error != 0 ) {                                   // Still our child, which exited right away.
+         waitpid( pid, NULL, 0 );
+         report_exec_error( error );
+         return -1;
       }
 
+      if ( pgid >= 0 )
+         setpgid( pid, pgid ? pgid : pid );                 // As fork_chained() does.
+
       return pid;
    }
-   int RunCommandsAction::wait_for_process_chain( std::list< pid_t > pids ) noexcept 
+   // A bare `cat` that has a file on at least one end only moves bytes around, which the shell can do without a process.
+   bool RunCommandsAction::is_pass_through( command* cmd, bool has_prev_pipe, bool has_next_pipe ) noexcept
    {
+      return zero_copy
+         && cmd->args.size() == 1
+         && cmd->args[0] == "cat"
+         && ( ( !has_prev_pipe && has_file_input( cmd ) ) || ( !has_next_pipe && has_file_output( cmd ) && has_prev_pipe ) );
+   }
+   // Builtins that would read the terminal run as processes, so ^C and ^Z reach them.
+   bool RunCommandsAction::runs_in_shell( const stage_plan& stage ) noexcept
+   {
+      if ( stage.substitutions > 0 )
+         return false;                                      // Its /dev/fd paths have to outlive the line, in the background.
+      if ( stage.how == stage_plan::kind::transfer )
+         return true;
+
+      return stage.how == stage_plan::kind::builtin
+         && !( stage.tool->reads_input && stage.input.from == redirect::source::inherit && job_table().job_control() );
+   }
+   // Gives a stage served by the shell its own copy of one end: the pipe or shell fd it shares, or the redirected file.
+   bool RunCommandsAction::open_in_shell( const stage_plan& stage, const redirect& end, int shared_fd, int& fd ) noexcept
+   {
+      if ( end.from == redirect::source::text ) {
+         if ( ( fd = open_document( std::string_view( end.path, end.size ) ) ) < 0 )
+            std::cerr << "here-document: " << strerror( errno ) << "\n";
+         return fd >= 0;
+      }
+      if ( end.from != redirect::source::file ) {
+         fd = fcntl( shared_fd, F_DUPFD_CLOEXEC, 0 );
+         return fd >= 0;
+      }
+
+      if ( ( fd = open( end.path, end.flags | O_CLOEXEC, S_IRUSR | S_IWUSR ) ) < 0 ) {
+         std::cerr << ( stage.how == stage_plan::kind::transfer ? "cat: " : "" ) << end.path << ": " << strerror( errno ) << "\n";
+         return false;
+      }
+      return true;
+   }
+   // Runs a stage on the calling thread with SIGPIPE held back, so a reader that goes away ends the stage, not the shell.
+   static int serve_stage( stage_plan::kind how, const builtin* tool, char** argv, int in_fd, int out_fd ) noexcept
+   {
+      struct timespec poll = { 0, 0 };
+      sigset_t sigpipe, previous;
       int status;
 
-      while ( pids.size() > 1 ) {
-         waitpid( pids.front(), NULL, WUNTRACED );
-         pids.pop_front();
+      trace_span span( how == stage_plan::kind::transfer ? "transfer" : tool->name );
+
+      sigemptyset( &sigpipe );
+      sigaddset( &sigpipe, SIGPIPE );
+      pthread_sigmask( SIG_BLOCK, &sigpipe, &previous );
+
+      if ( how == stage_plan::kind::transfer )
+      {
+         status = transfer( in_fd, out_fd ) ? 0 : W_EXITCODE( 1, 0 );
+         if ( status != 0 && errno != EPIPE )
+            std::cerr << "cat: " << strerror( errno ) << "\n";
+      }
+      else
+         status = tool->run( argv, in_fd, out_fd );
+
+      while ( sigtimedwait( &sigpipe, NULL, &poll ) == SIGPIPE )
+         ;                                                  // Drop what a broken pipe raised before unblocking it.
+      pthread_sigmask( SIG_SETMASK, &previous, NULL );
+
+      return status;
+   }
+   // Works on its own copies of the fds, so the parent can keep closing pipes exactly as it does for processes.
+   std::thread RunCommandsAction::start_in_shell( const stage_plan& stage, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe, std::shared_ptr< stage_outcome > outcome ) noexcept
+   {
+      std::vector< std::string > args;                       // The plan may be gone before a background stage is.
+      stage_plan::kind how = stage.how;
+      const builtin* tool = stage.tool;
+      int in_fd = -1, out_fd = -1;
+
+      if ( open_in_shell( stage, stage.input, has_prev_pipe ? prev_pipe[0] : shared_fd( STDIN_FILENO ), in_fd ) )
+         open_in_shell( stage, stage.output, has_next_pipe ? next_pipe[1] : shared_fd( STDOUT_FILENO ), out_fd );
+
+      if ( has_prev_pipe ) {                                // Same bookkeeping as execute_chained().
+         close_pipe( prev_pipe );
       }
-      waitpid( pids.front(), &status, WUNTRACED );
+
+      for ( char** arg = stage.argv; arg && *arg; ++arg )
+         args.emplace_back( *arg );
+
+      return std::thread( [how, tool, args = std::move( args ), in_fd, out_fd, outcome]() mutable {
+         std::vector< char* > argv;
+
+         for ( std::string& arg : args )
+            argv.push_back( arg.data() );
+         argv.push_back( nullptr );
+
+         outcome->status = in_fd >= 0 && out_fd >= 0
+            ? serve_stage( how, tool, argv.data(), in_fd, out_fd )
+            : W_EXITCODE( 1, 0 );
+
+         if ( in_fd >= 0 )
+            close( in_fd );
+         if ( out_fd >= 0 )
+            close( out_fd );
+         getrusage( RUSAGE_THREAD, &outcome->usage );       // What this stage cost, for `time`.
+      } );
+   }
+   // A pipeline of one stage the shell can serve needs no thread either.
+   void RunCommandsAction::run_in_parent( const stage_plan& stage, stage_outcome& outcome ) noexcept
+   {
+      struct rusage before;
+      int in_fd = -1, out_fd = -1;
+
+      getrusage( RUSAGE_THREAD, &before );
+      outcome.status = open_in_shell( stage, stage.input, shared_fd( STDIN_FILENO ), in_fd ) && open_in_shell( stage, stage.output, shared_fd( STDOUT_FILENO ), out_fd )
+         ? serve_stage( stage.how, stage.tool, stage.argv, in_fd, out_fd )
+         : W_EXITCODE( 1, 0 );
+
+      if ( in_fd >= 0 )
+         close( in_fd );
+      if ( out_fd >= 0 )
+         close( out_fd );
+
+      getrusage( RUSAGE_THREAD, &outcome.usage );
+      timersub( &outcome.usage.ru_utime, &before.ru_utime, &outcome.usage.ru_utime );
+      timersub( &outcome.usage.ru_stime, &before.ru_stime, &outcome.usage.ru_stime );
+      outcome.usage.ru_nvcsw -= before.ru_nvcsw;
+      outcome.usage.ru_nivcsw -= before.ru_nivcsw;
+   }
+   // Waits for the stages in the order they finish. A stage that stops (^Z) turns whatever hasn't exited yet into a stopped job.
+   bool RunCommandsAction::wait_for_process_chain( const std::vector< pid_t >& pids, std::vector< int >& statuses, pid_t pgid, int& stop_status, struct rusage* usages ) noexcept 
+   {
+      std::vector< pid_t > alive;
+      trace_span span( "wait" );
+      int id;
+
+      process_waiter().watch( job_table().signal_fd(), []( void* ) { job_table().reap(); }, nullptr );
+      if ( process_waiter().wait( pids.data(), pids.size(), statuses.data(), &stop_status, usages ) == pids.size() )
+         return true;
+
+      alive = plan->substituted_pids;                       // Become part of the job, so they are still reaped.
+      for ( size_t i = 0; i < pids.size(); ++i )
+         alive.push_back( statuses[i] == ProcessWaiter::running ? pids[i] : 0 );
+      id = job_table().add( alive, pgid, describe(), true );
+      std::cerr << "\n[" << id << "]+  Stopped\t\t" << describe() << "\n";
+      session().status = exit_code( stop_status );
+
+      return false;
+   }
+   // Folds the stage statuses into the pipeline's, and leaves them behind as $? and $PIPESTATUS.
+   int RunCommandsAction::record_statuses( const std::vector< int >& statuses ) noexcept
+   {
+      int status = statuses.back();
+
+      session().pipe_status.clear();
+      for ( int stage : statuses ) {
+         session().pipe_status.push_back( exit_code( stage ) );
+         if ( session().pipefail && exit_code( stage ) != 0 )
+            status = stage;                                   // The rightmost stage that failed.
+      }
+      session().status = exit_code( status );
 
       return status;
    }
+   void RunCommandsAction::report_times( const std::vector< pid_t >& pids, const std::vector< int >& statuses, const std::vector< struct rusage >& usages, double real, int status ) noexcept
+   {
+      pipeline_time times;
+      int i = 0;
+
+      times.command = describe();
+      times.real = real;
+      times.status = exit_code( status );
+      for ( const command* cmd : commands ) {
+         stage_time& stage = times.stages.emplace_back();
+         describe( cmd, stage.command );
+         stage.pid = pids[i];
+         stage.status = exit_code( statuses[i] );
+         stage.usage = usages[i];
+         i++;
+      }
+
+      report_time( std::cerr, times, time_with );
+   }
    command* RunCommandsAction::peek_first_command() noexcept
    {
       return commands.front();
@@ -186,79 +1044,285 @@ namespace shell
    }
    int RunCommandsAction::execute() noexcept
    {
-      std::list < pid_t > pids;
-      std::array< int, 2 > prev_pipe, next_pipe;
-      bool has_prev, has_next;
-      int i;
-      command *cmd;
+      std::vector< pid_t > pids( numberOfCommands, -1 );
+      std::vector< int > statuses( numberOfCommands, W_EXITCODE( 127, 0 ) ); // The status of a stage that could not be started.
+      std::vector< std::shared_ptr< stage_outcome > > outcomes( numberOfCommands );
+      std::vector< struct rusage > usages( timed ? numberOfCommands : 0 );
+      std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+      std::list < std::thread > threads;
+      std::array< int, 2 > prev_pipe = { -1, -1 }, next_pipe = { -1, -1 };
+      bool has_prev = false, has_next;
+      ExecutionPlan* stages;
+      pid_t pgid = job_table().job_control() ? 0 : -1;
+      int i, id, status, stop_status;
+
+      command_hash().validate();                              // Forget resolved paths if $PATH changed underneath us.
+      stages = compiled_plan();                               // The commands are left in place, a cached action runs again.
 
       for ( i = 0; i < numberOfCommands ; i++ ) {      
-         cmd = pop_first_command();                           // Pop the first command.
+         const stage_plan& stage = stages->stages[i];
          has_next = i != numberOfCommands - 1;         
 
-         if ( pipe( next_pipe.data() ) < 0 ) {
+         if ( has_next && open_pipe( next_pipe.data(), pipe_size ? pipe_size : session().pipe_size, packet_pipes || session().packet_pipes ) < 0 ) {
             std::exit( EXIT_FAILURE );                        // Pipe failed.
          }
 
-         pids.push_front( 
-               execute_chained( cmd, has_prev, prev_pipe, has_next, next_pipe ) 
-               );
+         if ( runs_in_shell( stage ) ) {
+            outcomes[i] = std::make_shared< stage_outcome >();   // Shared, the thread may outlive this call.
+            if ( numberOfCommands == 1 && !runInBackground ) {
+               run_in_parent( stage, *outcomes[i] );
+            }
+            else {
+               threads.push_back( 
+                     start_in_shell( stage, has_prev, prev_pipe, has_next, next_pipe, outcomes[i] ) 
+                     );
+            }
+            pids[i] = 0;                                      // Runs in the shell, there is no process to wait for.
+         }
+         else {
+            pids[i] = execute_chained( stage, has_prev, prev_pipe, has_next, next_pipe, pgid );
+         }
 
          prev_pipe = next_pipe;                               // The output pipe for the current process will be the input pipe for the next process.
          has_prev = true;
       }
+      close_substitutions();
+
+      if ( runInBackground ) {
+         if ( substituted_into ) {                            // Waited for along with the command it was substituted into.
+            substituted_into->insert( substituted_into->end(), stages->substituted_pids.begin(), stages->substituted_pids.end() );
+            std::copy_if( pids.begin(), pids.end(), std::back_inserter( *substituted_into ), []( pid_t pid ) { return pid > 0; } );
+            return 0;
+         }
+         pids.insert( pids.begin(), stages->substituted_pids.begin(), stages->substituted_pids.end() );
+         id = job_table().add( pids, pgid, describe(), false );
+         if ( id != 0 && job_table().job_control() )
+            std::cerr << "[" << id << "] " << pids.back() << "\n";
+         return 0;
+      }
+
+      if ( !wait_for_process_chain( pids, statuses, pgid, stop_status, timed ? usages.data() : nullptr ) ) {
+         job_table().take_terminal_back();
+         for ( std::thread& thread : threads )
+            thread.detach();                                  // They carry on when the job is continued.
+         return stop_status;
+      }
+      job_table().take_terminal_back();
+
+      for ( std::thread& thread : threads )
+         thread.join();
+      for ( pid_t pid : stages->substituted_pids )
+         waitpid( pid, NULL, 0 );                             // A >(...) may still be busy with what it was given.
+      for ( i = 0; i < numberOfCommands; i++ ) {
+         if ( !outcomes[i] )
+            continue;
+         statuses[i] = outcomes[i]->status;
+         if ( timed )
+            usages[i] = outcomes[i]->usage;
+      }
 
-      return runInBackground
-         ? 0
-         : wait_for_process_chain( pids );
+      status = record_statuses( statuses );
+      if ( timed )
+         report_times( pids, statuses, usages, std::chrono::duration< double >( std::chrono::steady_clock::now() - started ).count(), status );
+
+      return status;
    }
 
-   void display_prompt() {
+   std::string prompt() {
+      std::string text;
       char buffer[512];
       char* dir = getcwd(buffer, sizeof(buffer));
       if (dir)
-         std::cout << "\e[32m" << dir << "\e[39m";            // the strings starting with '\e' are escape codes, that the terminal application interpets in this case as "set color to green"/"set color to default"
-      std::cout << "$ ";
+         text = std::string( "\e[32m" ) + dir + "\e[39m";    // the strings starting with '\e' are escape codes, that the terminal application interpets in this case as "set color to green"/"set color to default"
+      return text + "$ ";
+   }
+
+   void display_prompt() {
+      std::cout << prompt();
       std::flush(std::cout);
    }
 
-   std::string request_commandLine( bool show_prompt ) {
+   // With an editor, the line is edited at the terminal and goes into the history; it lives in edited until the
+   // next request.
+   bool request_commandLine( LineReader& reader, LineEditor* editor, std::string& edited, bool show_prompt, std::string_view& line ) {
+      trace_span span( "request_commandLine" );
+
+      job_table().reap();                                      // Background jobs that finished while the last line ran.
+      job_table().notify( std::cerr, show_prompt );
+      if ( editor ) {
+         std::flush( std::cout );
+         if ( !editor->read_line( prompt(), edited ) )
+            return false;
+         history().add( edited );
+         line = edited;
+         return true;
+      }
       if ( show_prompt )
          display_prompt();
-      std::string retval;
-      getline( std::cin, retval );
- 
-      return retval;
+
+      return reader.next_line( line );
    }
 
-   void parse_command( std::string input, shell_state& state ) {
-      grammar::string_input<> in( input, "std::string" );
+   // Parses the line where it lies. Everything the action keeps is copied into the state's arena, so the line
+   // doesn't have to outlive the call, and a typical line is parsed without a single heap allocation.
+   void parse_command( std::string_view input, shell_state& state ) {
+      trace_span span( "parse_command", input );
+      grammar::memory_input<> in( input.data(), input.data() + input.size(), "line" );
       tao::pegtl::parse< grammar::grammar, grammar::action >( in, state );
    }
 
+   // The lines up to delimiter, or to the end of the input, from wherever the line that asked for them came from.
+   void read_here_document( LineReader& reader, LineEditor* editor, std::string_view delimiter, std::string& document ) {
+      std::string_view line;
+      std::string edited;
+
+      document.clear();
+      while ( editor ? editor->read_line( "> ", edited ) : reader.next_line( line ) ) {
+         if ( editor )
+            line = edited;
+         if ( line == delimiter )
+            return;
+         document.append( line ) += '\n';
+      }
+   }
+
+   int run_lines( LineReader& reader, bool show_prompt, LineEditor* editor = nullptr ) {
+      std::string_view input, delimiter;
+      std::string edited, line;
+      std::string* document;
+
+      while ( request_commandLine( reader, editor, edited, show_prompt, input ) ) { // Request for input, until there is no more
+         try
+         {
+            std::shared_ptr< ShellAction > action;
+            {
+               trace_span span( "parse", input );
+               action = parse_cache().parse( input );            // Parse the input, or reuse an earlier parse of the same line
+            }
+            for ( size_t i = 0; ( document = action->here_document( i, delimiter ) ); ++i ) {
+               if ( i == 0 )
+                  input = line.assign( input );                  // Reading on moves the reader past it.
+               read_here_document( reader, editor, delimiter, *document );
+            }
+            if ( action->inherits_stdin() )
+               reader.release_input();                           // Children may read the rest of our input.
+            trace_span span( "execute", input );
+            action->execute();                                   // Execute the action
+         }
+         catch ( std::exception& e )
+         {
+            std::cerr << "command not found" << std::endl;
+            session().status = 127;
+         }
+      }
+
+      return 0;
+   }
+
    int run_shell( bool show_prompt ) {
-      using namespace shell;
+      LineReader reader( STDIN_FILENO );
+      LineEditor editor( STDIN_FILENO, STDOUT_FILENO, history() );
+
+      if ( show_prompt && job_table().enable_job_control( STDIN_FILENO ) ) {
+         reader.watch( job_table().signal_fd(), [] { job_table().reap(); } );
+         editor.watch( job_table().signal_fd(), [] { job_table().reap(); } );
+      }
+      if ( default_launcher() == launcher::zygote )
+         zygote().start();                                     // Before the shell grows, which is the point of it.
+      if ( !show_prompt )
+         return run_lines( reader, show_prompt );
 
-      bool loop;
+      history().open( History::default_path() );              // Only interactive shells keep a history.
+      editor.complete_with( completer() );
+      return run_lines( reader, show_prompt, &editor );
+   }
 
-      loop = show_prompt;
+   // Takes the fd over.
+   int run_script( int fd ) {
+      LineReader reader( fd, true );
 
-      do {                                                     
-         shell_state state;
+      return run_lines( reader, false );
+   }
 
-         std::string input = request_commandLine( show_prompt ); // Request for input
+   // Runs a compiled script the way run_lines() runs its text, with the image's records standing in for the lines.
+   int run_image( ScriptImage& image ) {
+      std::string_view text, delimiter, line;
+      std::string* document;
 
+      for ( ;; ) {
+         shell_state state;                                      // Pipelines come back in here, ready to run.
+         std::shared_ptr< ShellAction > parsed;
+         ShellAction* action;
+
+         if ( !image.next( state, text ) )
+            break;
          try
          {
-            parse_command( input, state );                       // Parse the input into shell_state
-            state.action->execute();                             // Execute the action on the state
+            if ( ( action = state.action ) == nullptr ) {
+               trace_span span( "parse", text );
+               parsed = parse_cache().parse( text );               // Anything else was kept as text.
+               action = parsed.get();
+            }
+            for ( size_t i = 0; ( document = action->here_document( i, delimiter ) ); ++i ) {
+               document->clear();
+               while ( image.next_line( line ) && line != delimiter )
+                  document->append( line ) += '\n';
+            }
+            trace_span span( "execute", text );
+            action->execute();
          }
          catch ( std::exception& e )
          {
             std::cerr << "command not found" << std::endl;
+            session().status = 127;
          }
-      } while ( loop );
+      }
 
       return 0;
    }
+
+   // With $SHELL_SCRIPT_CACHE set, scripts run from an image in that directory, compiled and left there by the
+   // first run. Takes the fd over.
+   int run_cached_script( int fd, const char* directory ) {
+      std::string_view script;
+      std::string compiled, path;
+      ScriptImage image;
+      struct stat st;
+      void* mapped;
+      uint64_t hash;
+
+      if ( fstat( fd, &st ) < 0 || !S_ISREG( st.st_mode ) || st.st_size == 0
+           || ( mapped = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ) == MAP_FAILED )
+         return run_script( fd );                                 // Nothing worth caching.
+      close( fd );
+
+      script = std::string_view( static_cast< const char* >( mapped ), st.st_size );
+      hash = ScriptImage::hash( script );
+      path = ScriptImage::path( directory, hash );
+      if ( !image.open( path.c_str(), hash ) ) {
+         trace_span span( "compile", path );
+         ScriptImage::compile( script, compiled );
+         ScriptImage::write( path, compiled );                    // The next run has it, this one goes on regardless.
+         image.use( compiled, hash );
+      }
+      munmap( mapped, st.st_size );
+
+      return run_image( image );
+   }
+
+   int run_script( const char* path ) {
+      int fd = open( path, O_RDONLY | O_CLOEXEC );
+
+      if ( default_launcher() == launcher::zygote )
+         zygote().start();
+
+      if ( fd < 0 ) {
+         std::cerr << path << ": " << strerror( errno ) << "\n";
+         return 127;
+      }
+
+      if ( const char* directory = getenv( "SHELL_SCRIPT_CACHE" ); directory && *directory )
+         return run_cached_script( fd, directory );
+      return run_script( fd );
+   }
 }
@@ -2,24 +2,67 @@
 #define SHELL_H
 
 #include <array>
+#include <cstddef>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <unistd.h>
+#include <sys/resource.h>
 
 #include <iostream>
 
+#include "execution_plan.h"
+#include "time_report.h"
+
 namespace shell 
 {
    struct command
    {
-      std::vector< std::string > args;
-      std::string input_file, output_file;
+      std::pmr::vector< std::pmr::string > args;
+      std::pmr::vector< std::pmr::string > assignments;    // NAME=value prefixes, for this command's environment.
+      std::pmr::string input_file, output_file;
+      std::pmr::string here_string;                        // <<< word
+      std::pmr::string here_delimiter;                     // << WORD, the document is read from the lines that follow.
+      command( std::pmr::memory_resource* arena ) noexcept;
+   };
+
+   // Shell-wide settings, and what the last foreground pipeline left behind.
+   struct shell_session
+   {
+      bool pipefail = false;                               // set -o pipefail
+      size_t pipe_size = 0;                                // set -o pipesize N, 0 for the kernel's default.
+      bool packet_pipes = false;                           // set -o packetpipes, O_DIRECT pipes.
+      int status = 0;                                      // $?
+      std::vector< int > pipe_status;                      // $PIPESTATUS, one exit code per stage.
    };
 
+   shell_session& session() noexcept;
+   int exit_code( int status ) noexcept;
+   bool parse_size( std::string_view text, size_t& bytes ) noexcept;
+   int open_pipe( int fds[2], size_t capacity, bool packets ) noexcept;
+
+   enum class launcher
+   {
+      spawn,                                               // posix_spawn(3), which glibc implements with clone( CLONE_VM | CLONE_VFORK ).
+      fork,                                                // Plain fork(2) + exec, kept as a fallback.
+      zygote                                               // A helper forked at startup, see zygote.h.
+   };
+
+   launcher default_launcher() noexcept;
+
    class ShellAction
    {
    public:
-      virtual int execute() = 0;
+      virtual ~ShellAction() { }
+      virtual int execute() = 0;                           // Must leave the action as it found it, parsed actions are cached and run again.
+      virtual bool inherits_stdin() noexcept { return false; }
+      // The i-th << document the line asks for, to be filled with the lines up to its delimiter before execute().
+      virtual std::string* here_document( size_t i, std::string_view& delimiter ) noexcept { return nullptr; }
    };
 
    class NopAction: public ShellAction
@@ -39,41 +82,154 @@ namespace shell
    class ChangeDirectoryAction: public ShellAction
    {
    public:
-      std::string new_directory;
-      ChangeDirectoryAction( std::string directory ) noexcept;
+      std::pmr::string new_directory;
+      ChangeDirectoryAction( std::string_view directory, std::pmr::memory_resource* arena ) noexcept;
+      int execute() noexcept;
+   };
+
+   class HashAction: public ShellAction
+   {
+   public:
+      bool rehash = false;
+      std::pmr::vector< std::pmr::string > names;
+      HashAction( std::pmr::memory_resource* arena ) noexcept;
       int execute() noexcept;
    };
 
+   class JobControlAction: public ShellAction
+   {
+   public:
+      enum class builtin { jobs, foreground, background, wait };
+      builtin which;
+      int job = 0;                                         // %n, 0 for the current job (or for every job, with wait).
+      pid_t pid = 0;                                       // wait pid
+      JobControlAction( builtin which ) noexcept;
+      int execute() noexcept;
+   };
+
+   class SetOptionAction: public ShellAction
+   {
+   public:
+      bool enable = true;                                  // set -o name, or set +o name.
+      std::pmr::string name;                               // Empty lists the options.
+      std::pmr::string value;                              // set -o pipesize 1M
+      SetOptionAction( std::pmr::memory_resource* arena ) noexcept;
+      int execute() noexcept;
+   };
+
+   // history [N], the last N entries, or all of them.
+   class HistoryAction: public ShellAction
+   {
+   public:
+      size_t count = 0;
+      HistoryAction() noexcept;
+      int execute() noexcept;
+   };
+
+   // NAME=value..., export [NAME[=value]...] and unset NAME...
+   class VariablesAction: public ShellAction
+   {
+   public:
+      enum class builtin { assign, exports, unset };
+      builtin which;
+      std::pmr::vector< std::pmr::string > words;
+      VariablesAction( builtin which, std::pmr::memory_resource* arena ) noexcept;
+      int execute() noexcept;
+   };
+
+   // parallel [-j N] command [args] [::: inputs...] [< file]
+   class ParallelAction: public ShellAction
+   {
+   public:
+      unsigned slots = 0;                                  // -j, 0 for one per CPU.
+      std::pmr::vector< std::pmr::string > command;
+      bool has_inputs = false;                             // :::, otherwise the inputs are lines read from the file or stdin.
+      std::pmr::vector< std::pmr::string > inputs;
+      std::pmr::string input_file;
+      ParallelAction( std::pmr::memory_resource* arena ) noexcept;
+      int execute() noexcept;
+      bool inherits_stdin() noexcept;
+   };
+
+   // What a stage the shell serves itself reports back, once it's done.
+   struct stage_outcome
+   {
+      int status = 0;
+      struct rusage usage = {};
+   };
+
    class RunCommandsAction: public ShellAction
    {
    private:
-      char** convert_to_c_args( std::vector< std::string > args ) noexcept;
-      void free_c_args( char** c_args, int number_of_c_args ) noexcept;
-      void overlayProcess( std::vector< std::string > args ) noexcept;
-      void read_from_file( std::string input_file ) noexcept;
-      void write_to_file( std::string output_file ) noexcept; 
-      void read_from_pipe( std::array< int, 2 > pipe ) noexcept;
-      void write_to_pipe( std::array< int, 2 > pipe ) noexcept;
+      std::unique_ptr< ExecutionPlan > plan;               // Lowered on first run, kept while the resolved paths stay valid.
+      ExecutionPlan* compiled_plan() noexcept;
+      void report_exec_error( int error ) noexcept;
+      std::array< int, 2 > standard_fds = { -1, -1 };      // In place of the shell's stdin and stdout, for a process substitution.
+      std::vector< pid_t >* substituted_into = nullptr;    // Where a process substitution hands what it started.
+      int shared_fd( int standard ) const noexcept;
+      const std::pmr::vector< std::pmr::string >& substitute_processes( const std::pmr::vector< std::pmr::string >& words, stage_plan& stage, std::pmr::vector< std::pmr::string >& substituted ) noexcept;
+      void close_substitutions() noexcept;
+      bool open_redirect( const redirect& end, int shared_fd, int& fd ) noexcept;
       void close_pipe( std::array< int, 2 > pipe ) noexcept;
-      pid_t execute_chained( command* cmd, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe ) noexcept;
-      int wait_for_process_chain( std::list< pid_t > pids ) noexcept;
+      pid_t execute_chained( const stage_plan& stage, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe, pid_t& pgid ) noexcept;
+      pid_t spawn_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept;
+      pid_t fork_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept;
+      pid_t zygote_chained( const stage_plan& stage, int in_fd, int out_fd, pid_t pgid ) noexcept;
+      bool is_pass_through( command* cmd, bool has_prev_pipe, bool has_next_pipe ) noexcept;
+      bool runs_in_shell( const stage_plan& stage ) noexcept;
+      bool open_in_shell( const stage_plan& stage, const redirect& end, int shared_fd, int& fd ) noexcept;
+      std::thread start_in_shell( const stage_plan& stage, bool has_prev_pipe, std::array< int, 2 > prev_pipe, bool has_next_pipe, std::array< int, 2 > next_pipe, std::shared_ptr< stage_outcome > outcome ) noexcept;
+      void run_in_parent( const stage_plan& stage, stage_outcome& outcome ) noexcept;
+      bool wait_for_process_chain( const std::vector< pid_t >& pids, std::vector< int >& statuses, pid_t pgid, int& stop_status, struct rusage* usages ) noexcept;
+      int record_statuses( const std::vector< int >& statuses ) noexcept;
+      void report_times( const std::vector< pid_t >& pids, const std::vector< int >& statuses, const std::vector< struct rusage >& usages, double real, int status ) noexcept;
+      static void describe( const command* cmd, std::string& text ) noexcept;
       bool has_file_input( command * cmd ) noexcept;
+      bool has_text_input( command * cmd ) noexcept;
       bool has_file_output( command * cmd ) noexcept;
    public:
       int numberOfCommands = 0;
-      std::list< command* > commands;
+      std::pmr::list< command* > commands;
       bool runInBackground = false;
-      RunCommandsAction() noexcept;
+      launcher launch_with = default_launcher();
+      bool zero_copy = true;                               // Serve pass-through `cat` stages from inside the shell.
+      bool builtins = true;                                // Serve echo, cat, head, tail, wc and true from inside the shell.
+      bool timed = false;                                  // time
+      size_t pipe_size = 0;                                // pipesize N, 0 for the shell-wide setting.
+      bool packet_pipes = false;                           // pipesize -d N
+      time_format time_with = time_format::human;
+      std::string here_document_text;                      // Read anew for every run of the line.
+      RunCommandsAction( std::pmr::memory_resource* arena ) noexcept;
+      ~RunCommandsAction() noexcept;
       int execute() noexcept;
+      bool inherits_stdin() noexcept;
+      std::string* here_document( size_t i, std::string_view& delimiter ) noexcept;
+      void start_substituted( int fd, bool reads, std::vector< pid_t >& pids ) noexcept;
+      std::string describe() const noexcept;
+      const ExecutionPlan* current_plan() const noexcept { return plan.get(); }
       command *peek_first_command() noexcept;
       command *pop_first_command() noexcept;
    };
 
+   // The action parsed from one line, and the arena that it, its commands and their strings are allocated from.
+   // All of it is released in one go when the state goes away.
    struct shell_state
    {
       ShellAction * action = 0;
+      alignas( std::max_align_t ) std::byte initial_buffer[ 4096 ];  // Typical lines never touch the heap.
+      std::pmr::monotonic_buffer_resource arena;
+      shell_state() noexcept;
+      ~shell_state() noexcept;
+      shell_state( const shell_state& ) = delete;
+      shell_state& operator=( const shell_state& ) = delete;
+
+      template< typename T, typename... Args >
+         T* make( Args&&... args )
+         {
+            return new ( arena.allocate( sizeof( T ), alignof( T ) ) ) T( std::forward< Args >( args )... );
+         }
    };
 
-   void parse_command( std::string input, shell_state& state );
+   void parse_command( std::string_view input, shell_state& state );
 }
 #endif
@@ -3,9 +3,14 @@
 #include <fcntl.h>
 
 #include <list>
+#include <memory>
+#include <regex>
 
 #include "grammar.h"
 #include "shell.h"
+#include "parse_cache.h"
+#include "command_hash.h"
+#include "history.h"
 
 using namespace std;
 using namespace shell;
@@ -17,11 +22,23 @@ namespace {
    void execute( std::string command, std::string expectedOutput );
    void execute( std::string command, std::string expectedOutput, std::string expectedErrors );
    void execute( std::string command, std::string expectedOutput, std::string expectedOutputFile, std::string expectedOutputFileContent );
+   void execute_piped( std::string command, std::string expectedOutput );
+   void execute_script( std::string script, std::string expectedOutput );
+   void execute_command_on_path( std::string name );
    bool try_parse_nop_action( std::string input, NopAction **nop );
    bool try_parse_exit_action( std::string input, ExitAction **exit);
    bool try_parse_change_directory_action( std::string input, ChangeDirectoryAction **change_directory );
+   bool try_parse_hash_action( std::string input, HashAction **hash );
+   bool try_parse_job_control_action( std::string input, JobControlAction **job_control );
+   bool try_parse_set_option_action( std::string input, SetOptionAction **set_option );
+   bool try_parse_history_action( std::string input, HistoryAction **history_action );
+   bool try_parse_parallel_action( std::string input, ParallelAction **parallel );
+   bool try_parse_variables_action( std::string input, VariablesAction **variables_action );
    bool try_parse_run_commands_action( std::string input, RunCommandsAction **run_commands );
    bool try_parse_single_command( std::string input, command **cmd );
+   std::string as_string( const std::pmr::string& text );
+   long resident_set_size();
+   std::vector< std::string > as_strings( const std::pmr::vector< std::pmr::string >& texts );
 
    TEST( Shell, ParseNop ) {
       NopAction *nop = nullptr;
@@ -44,22 +61,216 @@ namespace {
       expected_dir = "tmp";
 
       EXPECT_TRUE( try_parse_change_directory_action( "cd tmp", &chdir ) );
-      EXPECT_EQ( expected_dir, chdir->new_directory );
+      EXPECT_EQ( expected_dir, as_string( chdir->new_directory ) );
 
       expected_dir = "tmp";
 
       EXPECT_TRUE( try_parse_change_directory_action( "cd tmp ", &chdir ) );
-      EXPECT_EQ( expected_dir, chdir->new_directory );
+      EXPECT_EQ( expected_dir, as_string( chdir->new_directory ) );
 
       expected_dir = "tmp";
 
       EXPECT_TRUE( try_parse_change_directory_action( "cd tmp ", &chdir ) );
-      EXPECT_EQ( expected_dir, chdir->new_directory );
+      EXPECT_EQ( expected_dir, as_string( chdir->new_directory ) );
 
       expected_dir = "..";
 
       EXPECT_TRUE( try_parse_change_directory_action( "cd ..", &chdir ) );
-      EXPECT_EQ( expected_dir, chdir->new_directory );
+      EXPECT_EQ( expected_dir, as_string( chdir->new_directory ) );
+   }
+
+   TEST( Shell, ParseHash ) {
+      HashAction * hash = nullptr;
+      std::vector<std::string> expected_names;
+
+      EXPECT_TRUE( try_parse_hash_action( "hash", &hash ) );
+      EXPECT_FALSE( hash->rehash );
+      EXPECT_TRUE( hash->names.empty() );
+
+      EXPECT_TRUE( try_parse_hash_action( "hash -r", &hash ) );
+      EXPECT_TRUE( hash->rehash );
+
+      expected_names = { "ls", "cat" };
+
+      EXPECT_TRUE( try_parse_hash_action( " hash ls cat ", &hash ) );
+      EXPECT_EQ( expected_names, as_strings( hash->names ) );
+   }
+
+   TEST( Shell, ParseJobControl ) {
+      JobControlAction * job_control = nullptr;
+
+      EXPECT_TRUE( try_parse_job_control_action( "jobs", &job_control ) );
+      EXPECT_EQ( JobControlAction::builtin::jobs, job_control->which );
+
+      EXPECT_TRUE( try_parse_job_control_action( " fg %2 ", &job_control ) );
+      EXPECT_EQ( JobControlAction::builtin::foreground, job_control->which );
+      EXPECT_EQ( 2, job_control->job );
+
+      EXPECT_TRUE( try_parse_job_control_action( "bg 3", &job_control ) );
+      EXPECT_EQ( JobControlAction::builtin::background, job_control->which );
+      EXPECT_EQ( 3, job_control->job );
+
+      EXPECT_TRUE( try_parse_job_control_action( "wait", &job_control ) );
+      EXPECT_EQ( JobControlAction::builtin::wait, job_control->which );
+      EXPECT_EQ( 0, job_control->job );
+      EXPECT_EQ( 0, job_control->pid );
+
+      EXPECT_TRUE( try_parse_job_control_action( "wait 1234", &job_control ) );
+      EXPECT_EQ( 1234, job_control->pid );
+   }
+
+   TEST( Shell, ParseSetOption ) {
+      SetOptionAction * set_option = nullptr;
+
+      EXPECT_TRUE( try_parse_set_option_action( "set -o pipefail", &set_option ) );
+      EXPECT_TRUE( set_option->enable );
+      EXPECT_EQ( "pipefail", as_string( set_option->name ) );
+
+      EXPECT_TRUE( try_parse_set_option_action( " set +o pipefail ", &set_option ) );
+      EXPECT_FALSE( set_option->enable );
+      EXPECT_EQ( "pipefail", as_string( set_option->name ) );
+
+      EXPECT_TRUE( try_parse_set_option_action( "set -o", &set_option ) );
+      EXPECT_TRUE( set_option->name.empty() );
+
+      EXPECT_TRUE( try_parse_set_option_action( "set -o pipesize 256K", &set_option ) );
+      EXPECT_EQ( "pipesize", as_string( set_option->name ) );
+      EXPECT_EQ( "256K", as_string( set_option->value ) );
+   }
+
+   TEST( Shell, ParseHistory ) {
+      HistoryAction * history_action = nullptr;
+
+      EXPECT_TRUE( try_parse_history_action( "history", &history_action ) );
+      EXPECT_EQ( 0u, history_action->count );
+
+      EXPECT_TRUE( try_parse_history_action( " history 20 ", &history_action ) );
+      EXPECT_EQ( 20u, history_action->count );
+   }
+
+   TEST( Shell, ParseParallel ) {
+      ParallelAction * parallel = nullptr;
+      std::vector<std::string> expected_command = { "gzip", "-k", "{}" };
+      std::vector<std::string> expected_inputs = { "a.txt", "b.txt" };
+
+      EXPECT_TRUE( try_parse_parallel_action( "parallel -j 4 gzip -k {} ::: a.txt b.txt", &parallel ) );
+      EXPECT_EQ( 4u, parallel->slots );
+      EXPECT_EQ( expected_command, as_strings( parallel->command ) );
+      EXPECT_TRUE( parallel->has_inputs );
+      EXPECT_EQ( expected_inputs, as_strings( parallel->inputs ) );
+      EXPECT_FALSE( parallel->inherits_stdin() );
+
+      EXPECT_TRUE( try_parse_parallel_action( " parallel wc -l ", &parallel ) );
+      EXPECT_EQ( 0u, parallel->slots );
+      EXPECT_FALSE( parallel->has_inputs );
+      EXPECT_TRUE( parallel->inherits_stdin() );
+
+      EXPECT_TRUE( try_parse_parallel_action( "parallel wc -l < files", &parallel ) );
+      EXPECT_EQ( "files", as_string( parallel->input_file ) );
+      EXPECT_FALSE( parallel->inherits_stdin() );
+   }
+
+   TEST( Shell, ParseVariables ) {
+      VariablesAction * variables_action = nullptr;
+      RunCommandsAction * run_commands = nullptr;
+      std::vector<std::string> expected_words = { "A=1", "PATH=$PATH:/opt/bin" };
+
+      EXPECT_TRUE( try_parse_variables_action( " A=1 PATH=$PATH:/opt/bin ", &variables_action ) );
+      EXPECT_EQ( VariablesAction::builtin::assign, variables_action->which );
+      EXPECT_EQ( expected_words, as_strings( variables_action->words ) );
+
+      expected_words = { "A=${B}c", "B" };
+      EXPECT_TRUE( try_parse_variables_action( "export A=${B}c B", &variables_action ) );
+      EXPECT_EQ( VariablesAction::builtin::exports, variables_action->which );
+      EXPECT_EQ( expected_words, as_strings( variables_action->words ) );
+
+      expected_words = { "A", "B" };
+      EXPECT_TRUE( try_parse_variables_action( "unset A B", &variables_action ) );
+      EXPECT_EQ( VariablesAction::builtin::unset, variables_action->which );
+      EXPECT_EQ( expected_words, as_strings( variables_action->words ) );
+
+      expected_words = { "A=1", "B=" };
+      EXPECT_TRUE( try_parse_run_commands_action( "A=1 B= ls $HOME | wc -l", &run_commands ) );
+      EXPECT_EQ( 2, run_commands->numberOfCommands );
+      EXPECT_EQ( expected_words, as_strings( run_commands->commands.front()->assignments ) );
+      EXPECT_EQ( ( std::vector<std::string>{ "ls", "$HOME" } ), as_strings( run_commands->commands.front()->args ) );
+      EXPECT_TRUE( run_commands->commands.back()->assignments.empty() );
+   }
+
+   TEST( Shell, ParseHereDocuments ) {
+      RunCommandsAction * run_commands = nullptr;
+      std::string_view delimiter;
+
+      EXPECT_TRUE( try_parse_run_commands_action( "cat <<< $A,b | wc -c", &run_commands ) );
+      EXPECT_EQ( 2, run_commands->numberOfCommands );
+      EXPECT_EQ( "$A,b", run_commands->commands.front()->here_string );
+      EXPECT_EQ( nullptr, run_commands->here_document( 0, delimiter ) );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "cat <<END > out", &run_commands ) );
+      EXPECT_EQ( "END", run_commands->commands.front()->here_delimiter );
+      EXPECT_EQ( "out", run_commands->commands.front()->output_file );
+      EXPECT_EQ( &run_commands->here_document_text, run_commands->here_document( 0, delimiter ) );
+      EXPECT_EQ( "END", delimiter );
+      EXPECT_EQ( nullptr, run_commands->here_document( 1, delimiter ) );
+      EXPECT_EQ( "cat << END > out", run_commands->describe() );
+   }
+
+   TEST( Shell, ParseProcessSubstitution ) {
+      RunCommandsAction * run_commands = nullptr;
+
+      EXPECT_TRUE( try_parse_run_commands_action( "diff <(sort 1) <(ls -1 | head -n 2) > out", &run_commands ) );
+      EXPECT_EQ( 1, run_commands->numberOfCommands );
+      EXPECT_EQ( ( std::vector<std::string>{ "diff", "<(sort 1)", "<(ls -1 | head -n 2)" } ), as_strings( run_commands->commands.front()->args ) );
+      EXPECT_EQ( "out", run_commands->commands.front()->output_file );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "tee >(wc -l) <(cat <(ls)) < 1", &run_commands ) );
+      EXPECT_EQ( ( std::vector<std::string>{ "tee", ">(wc -l)", "<(cat <(ls))" } ), as_strings( run_commands->commands.front()->args ) );
+      EXPECT_EQ( "1", run_commands->commands.front()->input_file );
+   }
+
+   TEST( Shell, ParseTime ) {
+      RunCommandsAction * run_commands = nullptr;
+      std::vector<std::string> expected_args = { "ls", "-la" };
+
+      EXPECT_TRUE( try_parse_run_commands_action( "ls -la", &run_commands ) );
+      EXPECT_FALSE( run_commands->timed );
+
+      EXPECT_TRUE( try_parse_run_commands_action( " time ls -la | sort", &run_commands ) );
+      EXPECT_TRUE( run_commands->timed );
+      EXPECT_EQ( time_format::human, run_commands->time_with );
+      EXPECT_EQ( 2, run_commands->numberOfCommands );
+      EXPECT_EQ( expected_args, as_strings( run_commands->commands.front()->args ) );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "time -p ls -la", &run_commands ) );
+      EXPECT_EQ( time_format::posix, run_commands->time_with );
+      EXPECT_EQ( expected_args, as_strings( run_commands->commands.front()->args ) );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "time -j ls -la", &run_commands ) );
+      EXPECT_EQ( time_format::json, run_commands->time_with );
+   }
+
+   TEST( Shell, ParsePipeSize ) {
+      RunCommandsAction * run_commands = nullptr;
+      std::vector<std::string> expected_args = { "cat" };
+
+      EXPECT_TRUE( try_parse_run_commands_action( "cat | cat", &run_commands ) );
+      EXPECT_EQ( 0u, run_commands->pipe_size );
+      EXPECT_FALSE( run_commands->packet_pipes );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "pipesize 1M cat | cat", &run_commands ) );
+      EXPECT_EQ( 1024u * 1024, run_commands->pipe_size );
+      EXPECT_FALSE( run_commands->packet_pipes );
+      EXPECT_EQ( 2, run_commands->numberOfCommands );
+      EXPECT_EQ( expected_args, as_strings( run_commands->commands.front()->args ) );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "time pipesize -d 65536 cat", &run_commands ) );
+      EXPECT_TRUE( run_commands->timed );
+      EXPECT_EQ( 65536u, run_commands->pipe_size );
+      EXPECT_TRUE( run_commands->packet_pipes );
+
+      EXPECT_TRUE( try_parse_run_commands_action( "pipesize", &run_commands ) );
+      EXPECT_EQ( 0u, run_commands->pipe_size );
+      EXPECT_EQ( std::vector<std::string>{ "pipesize" }, as_strings( run_commands->commands.front()->args ) );
    }
 
    TEST( Shell, ParseSingleCommandWithoutArguments ) {
@@ -69,19 +280,19 @@ namespace {
       expected_args = { "foo" };
 
       EXPECT_TRUE( try_parse_single_command( "foo", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
 
       EXPECT_TRUE( try_parse_single_command( " foo", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
 
       EXPECT_TRUE( try_parse_single_command( " foo ", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
 
       EXPECT_TRUE( try_parse_single_command( "  foo  ", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
 
       EXPECT_TRUE( try_parse_single_command( "   foo   ", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
    }
 
    TEST( Shell, ParseSingleCommandWithArguments ) {
@@ -91,7 +302,17 @@ namespace {
       expected_args = { "cmd", "1", "-n", "u" };
 
       EXPECT_TRUE( try_parse_single_command( "cmd 1 -n u", &cmd ) );
-      EXPECT_EQ( expected_args, cmd->args );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
+   }
+
+   TEST( Shell, ParseSingleCommandWithPatterns ) {
+      command *cmd = nullptr;
+      std::vector<std::string> expected_args;
+
+      expected_args = { "ls", "*.cpp", "src/**/?.h", "[!a-c]x", "[^]]" };
+
+      EXPECT_TRUE( try_parse_single_command( "ls *.cpp src/**/?.h [!a-c]x [^]]", &cmd ) );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );  // Expanded when the line runs, not when it is parsed.
    }
 
    TEST( Shell, ParseSingleCommandNoArgumentsWithRedirectStdin ) {
@@ -104,8 +325,8 @@ namespace {
 
       try_parse_single_command( "cmd < inputfile", &cmd );
 
-      EXPECT_EQ( expected_args, cmd->args );
-      EXPECT_EQ( expected_input_file, cmd->input_file );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
+      EXPECT_EQ( expected_input_file, as_string( cmd->input_file ) );
       EXPECT_EQ( "", cmd->output_file );
    }
 
@@ -119,8 +340,8 @@ namespace {
 
       try_parse_single_command( "cmd arg1 < inputfile", &cmd );
 
-      EXPECT_EQ( expected_args, cmd->args );
-      EXPECT_EQ( expected_input_file, cmd->input_file );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
+      EXPECT_EQ( expected_input_file, as_string( cmd->input_file ) );
       EXPECT_EQ( "", cmd->output_file );
    }
 
@@ -134,8 +355,8 @@ namespace {
 
       try_parse_single_command( "cmd arg1 > outputfile", &cmd );
 
-      EXPECT_EQ( expected_args, cmd->args );
-      EXPECT_EQ( expected_output_file, cmd->output_file );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
+      EXPECT_EQ( expected_output_file, as_string( cmd->output_file ) );
       EXPECT_EQ( "", cmd->input_file );
    }
 
@@ -150,9 +371,9 @@ namespace {
 
       try_parse_single_command( "cmd arg1 < inputfile > outputfile", &cmd );
 
-      EXPECT_EQ( expected_args, cmd->args );
-      EXPECT_EQ( expected_output_file, cmd->output_file );
-      EXPECT_EQ( expected_input_file, cmd->input_file );
+      EXPECT_EQ( expected_args, as_strings( cmd->args ) );
+      EXPECT_EQ( expected_output_file, as_string( cmd->output_file ) );
+      EXPECT_EQ( expected_input_file, as_string( cmd->input_file ) );
    }
 
    TEST( Shell, ParseRunCommands ) {
@@ -177,7 +398,7 @@ namespace {
 
       try_parse_run_commands_action( "foo &", &run_commands );
 
-      EXPECT_EQ( expected_args, run_commands->commands.front()->args );
+      EXPECT_EQ( expected_args, as_strings( run_commands->commands.front()->args ) );
       EXPECT_TRUE( run_commands->runInBackground );
    }
 
@@ -203,8 +424,28 @@ namespace {
       try_parse_run_commands_action( "ls -la < inputfile | sort | uniq -l > outputfile", &run_commands );
 
       EXPECT_EQ( expected_number_of_commands, run_commands->numberOfCommands );
-      EXPECT_EQ( expected_input_file, run_commands->commands.front()->input_file );
-      EXPECT_EQ( expected_output_file, run_commands->commands.back()->output_file );
+      EXPECT_EQ( expected_input_file, as_string( run_commands->commands.front()->input_file ) );
+      EXPECT_EQ( expected_output_file, as_string( run_commands->commands.back()->output_file ) );
+   }
+
+   TEST( Shell, AMillionLinesRunInConstantMemory ) {
+      ParseCache cache;
+      long before = 0;
+
+      for ( int i = 0; i < 1000000; ++i ) {
+         if ( i % 2 ) {                                     // Distinct lines, so the cache keeps evicting.
+            cache.parse( "ls -la arg" + std::to_string( i ) + " < in | sort -n | uniq > out &" );
+         }
+         else {
+            shell_state state;
+            parse_command( "cd .", state );
+            state.action->execute();
+         }
+         if ( i == 100000 )
+            before = resident_set_size();
+      }
+
+      EXPECT_GT( 1 << 20, resident_set_size() - before );
    }
 
    TEST( Shell, ReadFromFile ) {
@@ -220,6 +461,116 @@ namespace {
       execute("cat < 1 | head -n 3 | tail -n 1 > ../foobar", "", "../foobar", "line 3\n");
    }
 
+   TEST( Shell, PassThroughCat ) {
+      execute( "ls -1 | cat > ../foobar", "", "../foobar", "1\n2\n3\n4\n" );
+      execute( "cat < 1 | tail -n 1", "line 4" );
+      execute( "cat < file-that-doesnt-exist", "", "cat: file-that-doesnt-exist: No such file or directory\n" );
+   }
+
+   TEST( Shell, MissingRedirectFile ) {
+      execute( "head -n 1 < file-that-doesnt-exist", "", "file-that-doesnt-exist: No such file or directory\n" );
+      execute( "ls | head -n 1 > directory-that-doesnt-exist/out", "", "directory-that-doesnt-exist/out: No such file or directory\n" );
+   }
+
+   TEST( Shell, PlanIsReusedForRepeatedRuns ) {
+      RunCommandsAction* run_commands;
+      const ExecutionPlan* plan;
+
+      try_parse_run_commands_action( "true | cat > /dev/null", &run_commands );
+      EXPECT_EQ( 0, run_commands->execute() );
+      plan = run_commands->current_plan();
+      ASSERT_EQ( 2u, plan->stages.size() );
+      EXPECT_EQ( stage_plan::kind::builtin, plan->stages[0].how );
+      EXPECT_NE( nullptr, plan->stages[0].path );           // Still there for when the builtin can't be used.
+      EXPECT_STREQ( "true", plan->stages[0].argv[0] );
+      EXPECT_EQ( nullptr, plan->stages[0].argv[1] );
+      EXPECT_EQ( stage_plan::kind::transfer, plan->stages[1].how );
+      EXPECT_STREQ( "/dev/null", plan->stages[1].output.path );
+
+      EXPECT_EQ( 0, run_commands->execute() );
+      EXPECT_EQ( plan, run_commands->current_plan() );
+
+      command_hash().rehash();                              // Paths resolved before this may be stale.
+      EXPECT_EQ( 0, run_commands->execute() );
+      EXPECT_EQ( command_hash().generation(), run_commands->current_plan()->generation );
+   }
+
+   TEST( Shell, PipeStatus ) {
+      RunCommandsAction* run_commands;
+      std::vector< int > expected_statuses;
+
+      try_parse_run_commands_action( "false | program-that-doesnt-exist | true", &run_commands );
+      testing::internal::CaptureStderr();
+      EXPECT_EQ( 0, run_commands->execute() );
+      testing::internal::GetCapturedStderr();
+      expected_statuses = { 1, 127, 0 };
+      EXPECT_EQ( expected_statuses, session().pipe_status );
+      EXPECT_EQ( 0, session().status );
+
+      try_parse_run_commands_action( "sleep 0.2 | false", &run_commands );
+      EXPECT_EQ( W_EXITCODE( 1, 0 ), run_commands->execute() );
+      expected_statuses = { 0, 1 };
+      EXPECT_EQ( expected_statuses, session().pipe_status );
+   }
+
+   TEST( Shell, Pipefail ) {
+      RunCommandsAction* run_commands;
+
+      session().pipefail = true;
+      try_parse_run_commands_action( "false | sleep 0.1 | true", &run_commands );
+      EXPECT_EQ( W_EXITCODE( 1, 0 ), run_commands->execute() );
+      EXPECT_EQ( 1, session().status );
+      session().pipefail = false;
+
+      execute( "set -o pipefail\nset -o\nset +o pipefail", "packetpipes\toff\npipefail\ton\npipesize\t0\n" );
+      execute( "set -o nounset", "", "set: nounset: invalid option name\n" );
+   }
+
+   TEST( Shell, PipeSize ) {
+      int fds[2];
+
+      ASSERT_EQ( 0, open_pipe( fds, 256 * 1024, true ) );
+      EXPECT_GE( fcntl( fds[1], F_GETPIPE_SZ ), 256 * 1024 );
+      EXPECT_TRUE( fcntl( fds[1], F_GETFL ) & O_DIRECT );
+      EXPECT_TRUE( fcntl( fds[0], F_GETFD ) & FD_CLOEXEC );
+      close( fds[0] );
+      close( fds[1] );
+
+      ASSERT_EQ( 0, open_pipe( fds, size_t( 1 ) << 40, false ) );  // Held to the system maximum.
+      EXPECT_GT( fcntl( fds[1], F_GETPIPE_SZ ), 0 );
+      EXPECT_FALSE( fcntl( fds[1], F_GETFL ) & O_DIRECT );
+      close( fds[0] );
+      close( fds[1] );
+
+      execute( "pipesize 1M ls -1 ../test-dir | head -n 1", "1\n" );
+      execute( "pipesize -d 64K ls -1 ../test-dir | head -n 1", "1\n" );
+      execute( "set -o pipesize 128K\nset -o packetpipes\nls -1 ../test-dir | head -n 1\nset -o\nset +o pipesize\nset +o packetpipes",
+               "1\npacketpipes\ton\npipefail\toff\npipesize\t131072\n" );
+      execute( "set -o pipesize", "", "set: pipesize: needs a size\n" );
+      execute_command_on_path( "set-up" );
+   }
+
+   TEST( Shell, Time ) {
+      RunCommandsAction* run_commands;
+      std::string report;
+
+      try_parse_run_commands_action( "time -j cat < /dev/null | sleep 0.1", &run_commands );
+      testing::internal::CaptureStderr();
+      EXPECT_EQ( 0, run_commands->execute() );
+      report = testing::internal::GetCapturedStderr();
+
+      EXPECT_TRUE( std::regex_match( report, std::regex(
+         "\\{\"command\":\"cat < /dev/null \\| sleep 0.1\",\"status\":0,\"real\":0\\.1[0-9]{2},\"user\":[0-9.]+,\"sys\":[0-9.]+,\"stages\":\\["
+         "\\{\"command\":\"cat < /dev/null\",\"pid\":0,\"status\":0,.*\\},"
+         "\\{\"command\":\"sleep 0.1\",\"pid\":[1-9][0-9]*,\"status\":0,.*\"max_rss_kb\":[1-9][0-9]*,.*\\}\\]\\}\n" ) ) ) << report;
+
+      try_parse_run_commands_action( "time -p true", &run_commands );
+      testing::internal::CaptureStderr();
+      run_commands->execute();
+      report = testing::internal::GetCapturedStderr();
+      EXPECT_TRUE( std::regex_match( report, std::regex( "real 0\\.0[0-9]{2}\nuser [0-9.]+\nsys [0-9.]+\n" ) ) ) << report;
+   }
+
    TEST( Shell, WriteToFile ) {
       execute("ls -1 > ../foobar", "", "../foobar", "1\n2\n3\n4\n");
    }
@@ -238,8 +589,143 @@ namespace {
       execute( "program-that-doesnt-exist | program-that-doesnt-exist | ls", "1\n2\n3\n4\n", "command not found\ncommand not found\n" );
    }
 
+   TEST( Shell, ExecuteChainedWithForkLauncher ) {
+      setenv( "SHELL_LAUNCHER", "fork", 1 );
+      execute( "ls -1 | head -n 2 | tail -n 1", "2\n" );
+      execute( "cat < 1 | head -n 3 > ../foobar", "", "../foobar", "line 1\nline 2\nline 3\n" );
+      execute( "program-that-doesnt-exist | ls", "1\n2\n3\n4\n", "command not found\n" );
+      unsetenv( "SHELL_LAUNCHER" );
+   }
+
+   TEST( Shell, ExpandPatterns ) {
+      execute( "echo *", "1 2 3 4\n" );
+      execute( "echo [!13] ?", "2 4 1 2 3 4\n" );
+      execute( "echo ../test-dir/[3-9]", "../test-dir/3 ../test-dir/4\n" );
+      execute( "echo nothing-like-this*", "nothing-like-this*\n" );   // Left as it is, like sh does.
+      execute( "ls -d ../test-d*/", "../test-dir/\n" );
+      execute( "cat [1] | wc -l", "3\n" );
+   }
+
+   TEST( Shell, ExpandVariables ) {
+      execute( "A=hello\necho $A ${A}x $NOTHING_HERE done", "hello hellox done\n" );
+      execute( "false\necho $? $", "1 $\n" );
+      execute( "A=a\nB=$A$A\necho $B", "aa\n" );
+   }
+
+   TEST( Shell, ExportVariables ) {
+      execute( "export B=exported\nprintenv B", "exported\n" );
+      execute( "C=local\nprintenv C\necho $C", "local\n" );         // Not exported, so only the shell has it.
+      execute( "C=local\nexport C\nprintenv C", "local\n" );
+      execute( "D=prefixed printenv D\nprintenv D\necho ${D}end", "prefixed\nend\n" );
+      execute( "export E=1\nE=2 printenv E | cat\nprintenv E", "2\n1\n" );
+      execute( "export E=1\nunset E\nprintenv E\necho $E.", ".\n" );
+      execute_command_on_path( "export-data" );
+      execute_command_on_path( "unset-x" );
+   }
+
+   TEST( Shell, HereDocuments ) {
+      execute( "A=there\ncat <<< hello,$A", "hello,there\n" );
+      execute( "cat <<EOF\none $?\ntwo\nEOF\necho after", "one 0\ntwo\nafter\n" );
+      execute( "sort << END | head -n 1\nb\na\nEND", "a\n" );            // Through a process, not just the builtins.
+      execute( "tr a-z A-Z <<<quiet > ../foobar", "", "../foobar", "QUIET\n" );
+      execute( "cat <<EOF\nfirst\nEOF\ncat <<EOF\nsecond\nEOF", "first\nsecond\n" );  // The same line, read again.
+      execute( "cat <<EOF\nnever ends", "never ends\n" );
+      std::string line( 999, 'x' );
+      execute( "wc -c <<EOF\n" + line + "\n" + line + "\n" + line + "\n" + line + "\n" + line + "\nEOF", "5000\n" );  // Past a pipe's worth.
+   }
+
+   TEST( Shell, ProcessSubstitution ) {
+      execute( "cat <(ls -1) | wc -l", "4\n" );
+      execute( "paste <(ls -1 | head -n 2) <(ls -1 | tail -n 2)", "1\t3\n2\t4\n" );
+      execute( "diff <(ls -1) <(ls -1 | head -n 4)", "" );
+      execute( "cat <(cat <(ls -1 | head -n 1))", "1\n" );
+      execute( "cat 1 | tee >(wc -l > ../foobar) > /dev/null", "", "../foobar", "3\n" );
+      execute( "cat <(ls -1) > ../foobar &\nwait", "", "../foobar", "1\n2\n3\n4\n" );
+      execute( "cat <(ls -1 | head -n 1)\ncat <(ls -1 | head -n 1)", "1\n1\n" );   // Started again with every run.
+   }
+
+   TEST( Shell, ExecuteChainedWithZygoteLauncher ) {
+      setenv( "SHELL_LAUNCHER", "zygote", 1 );
+      execute( "ls -1 | head -n 2 | tail -n 1", "2\n" );
+      execute( "cat < 1 | head -n 3 > ../foobar", "", "../foobar", "line 1\nline 2\nline 3\n" );
+      execute( "program-that-doesnt-exist | ls", "1\n2\n3\n4\n", "command not found\n" );
+      execute( "cd /\nls -d tmp", "tmp\n" );                // In the shell's directory, not the helper's.
+      execute( "paste <(ls -1) <(ls -1) | head -n 1", "1\t1\n" );
+      unsetenv( "SHELL_LAUNCHER" );
+   }
+
+   TEST( Shell, ExecuteBuiltins ) {
+      execute( "echo hello world | wc -c", "12\n" );
+      execute( "head -n 2 < 1", "line 1\nline 2\n" );
+      execute( "ls -1 | tail -n 2 | head -n 1", "3\n" );
+      execute( "echo -e a", "a\n" );                        // Not something the builtin does, the real echo gets it.
+      execute( "true | wc -l > ../foobar", "", "../foobar", "0\n" );
+   }
+
    TEST( Shell, ExecuteInBackground ) {
-      execute( "ls &", "" );
+      time_t started = time( NULL );
+
+      execute( "sleep 2 &", "" );                            // Something slow and silent, a background `ls` races with the next test.
+      EXPECT_GT( 2, time( NULL ) - started );
+   }
+
+   TEST( Shell, WaitForStagesTheShellWouldServe ) {
+      execute( "cat < 1 | wc -l > ../foobar &\nwait", "", "../foobar", "3\n" );
+      execute( "echo hello > ../foobar &\nwait", "", "../foobar", "hello\n" );
+      execute( "cat < 1 > ../foobar &\nwait", "", "../foobar", "line 1\nline 2\nline 3\nline 4" );
+   }
+
+   TEST( Shell, JobControl ) {
+      execute( "sleep 0.1 | cat &\nsleep 0.5 &\nwait %1\njobs\nwait\njobs", "[2]  Running\t\tsleep 0.5 &\n", "" );
+      execute( "sleep 0.1 &\nwait %2", "", "wait: %2: no such job\n" );
+      execute( "false &\nwait %1\necho $?", "1\n" );
+      execute( "false &\nsleep 0.2\nwait %1\necho $?", "1\n" );   // Already reaped while sleep ran.
+      execute( "wait 999999\necho $?", "127\n", "wait: pid 999999 is not a child of this shell\n" );
+      execute( "fg\necho $?", "1\n", "fg: no job control\n" );
+      execute( "fg", "", "fg: no job control\n" );
+      execute( "bg %1", "", "bg: no job control\n" );
+      execute_command_on_path( "wait-for-it.sh" );
+      execute_command_on_path( "jobs.sh" );
+   }
+
+   TEST( Shell, History ) {
+      HistoryAction* history_action;
+
+      unlink( "/tmp/shelltest-shell-history" );
+      ASSERT_TRUE( history().open( "/tmp/shelltest-shell-history" ) );
+      history().add( "ls -1" );
+      history().add( "echo a" );
+
+      try_parse_history_action( "history", &history_action );
+      testing::internal::CaptureStdout();
+      history_action->execute();
+      std::flush( std::cout );
+      EXPECT_EQ( "    1  ls -1\n    2  echo a\n", testing::internal::GetCapturedStdout() );
+
+      try_parse_history_action( "history 1", &history_action );
+      testing::internal::CaptureStdout();
+      history_action->execute();
+      std::flush( std::cout );
+      EXPECT_EQ( "    2  echo a\n", testing::internal::GetCapturedStdout() );
+
+      history().close();
+      unlink( "/tmp/shelltest-shell-history" );
+      execute( "history", "" );                                // Scripts and piped input keep none.
+      execute_command_on_path( "history.py" );
+   }
+
+   TEST( Shell, Parallel ) {
+      ParallelAction * parallel = nullptr;
+
+      execute( "parallel -j 2 echo ::: a b c", "a\nb\nc\n" );
+      execute( "parallel echo < 1", "line 1\nline 2\nline 3\nline 4\n" );
+      execute( "parallel -j 2 echo\nx\ny", "x\ny\n" );
+      execute( "parallel program-that-doesnt-exist ::: a", "", "parallel: program-that-doesnt-exist: command not found\n" );
+      execute_command_on_path( "parallel-lint" );
+
+      EXPECT_TRUE( try_parse_parallel_action( "parallel false ::: a b", &parallel ) );
+      EXPECT_EQ( W_EXITCODE( 2, 0 ), parallel->execute() );
+      EXPECT_EQ( 2, session().status );
    }
 
    TEST( Shell, ChangeDirectory ) {
@@ -250,6 +736,65 @@ namespace {
       execute( "cd this-directory-doesnt-exist", "", "No such file or directory" );
    }
 
+   TEST( Shell, Hash ) {
+      execute( "hash ls", "", "" );
+      execute( "hash program-that-doesnt-exist", "", "hash: program-that-doesnt-exist: not found\n" );
+      execute( "hash -r", "", "" );
+      execute( "hash", "hash: hash table empty\n", "" );
+      execute_command_on_path( "hash-files" );              // Not the builtin, it only starts with its name.
+   }
+
+   // They work on the shell's own state, so they can't be a stage of a pipeline, whose stages may be processes.
+   TEST( Shell, StateBuiltinsTakeTheWholeLine ) {
+      execute( "history | wc -l\necho $?", "127\n", "command not found\n" );
+      execute( "jobs | wc -l", "", "command not found\n" );
+      execute( "set -o | cat", "", "command not found\n" );
+      execute( "hash | cat", "", "command not found\n" );
+      execute( "export | cat", "", "command not found\n" );
+   }
+
+   TEST( Shell, BuiltinsLeaveTheirStatus ) {
+      execute( "false\njobs\necho $?", "0\n" );
+      execute( "false\nhistory\necho $?", "0\n" );
+      execute( "false\nexport A=1\necho $?", "0\n" );
+      execute( "false\nset +o pipefail\necho $?", "0\n" );
+      execute( "set -o nonsense\necho $?", "1\n", "set: nonsense: invalid option name\n" );
+      execute( "hash program-that-doesnt-exist\necho $?", "1\n", "hash: program-that-doesnt-exist: not found\n" );
+      execute( "cd this-directory-doesnt-exist\necho $?", "1\n", "No such file or directory" );
+      execute( "ls |\necho $?", "127\n", "command not found\n" );
+   }
+
+   TEST( Shell, ExecuteEveryLine ) {
+      execute( "ls -1 | head -n 1\n\ncat < 1 | head -n 1\n", "1\nline 1\n" );
+      execute_piped( "ls -1 | head -n 1\n\ncat < 1 | head -n 1", "1\nline 1\n" );
+   }
+
+   TEST( Shell, ExecuteRepeatedLine ) {
+      execute( "ls -1 | head -n 1\n  ls -1  |  head -n 1\nls -1 | head -n 1", "1\n1\n1\n" );
+   }
+
+   TEST( Shell, ChildrenReadTheRestOfTheInput ) {
+      execute( "head -n 1\nthis line is for head\nls -1 | tail -n 1", "this line is for head\n4\n" );
+   }
+
+   TEST( Shell, ExecuteScript ) {
+      execute_script( "ls -1 | head -n 2\ncat < 1 | tail -n 1\nexit\nls", "1\n2\nline 4" );
+   }
+
+   TEST( Shell, ExecuteCachedScript ) {
+      std::string directory = std::string( getcwd( nullptr, 0 ) ) + "/shc";
+      std::string script = "ls -1 | head -n 2\n\nA=1\ncat <<END | wc -l\none\nls\nEND\necho $A > ../foobar\ncat ../foobar\nnot a | command\nexit\nls";
+
+      system( ( "rm -rf " + directory ).c_str() );
+      setenv( "SHELL_SCRIPT_CACHE", directory.c_str(), 1 );
+      execute_script( script, "1\n2\n2\n1\n" );          // Compiles and leaves the image behind.
+      EXPECT_EQ( 0, system( ( "test -s " + directory + "/*.shc" ).c_str() ) );
+      execute_script( script, "1\n2\n2\n1\n" );          // Runs from it.
+      execute_script( script + "\n", "1\n2\n2\n1\n" );   // Another script, another image.
+      EXPECT_EQ( 0, system( ( "test $(ls " + directory + " | wc -l) -eq 2" ).c_str() ) );
+      unsetenv( "SHELL_SCRIPT_CACHE" );
+   }
+
    TEST( Shell, Exit ) {
       execute( "exit", "", "" );
    }
@@ -329,10 +874,65 @@ namespace {
       unlink(expectedOutputLocation.c_str());
    }
 
-   bool try_parse_nop_action( std::string input, NopAction **nop ) {
-      shell_state state;
+   void execute_piped( std::string command, std::string expectedOutput ) {
+      filewrite( "input", command );
+      system( "cd ../test-dir; cat ../build/input | " SHELL " > ../build/output 2> /dev/null" );
+      std::string got = filecontents( "output" );
+      EXPECT_EQ( expectedOutput, got );
+   }
+
+   void execute_script( std::string script, std::string expectedOutput ) {
+      filewrite( "script", script );
+      system( "cd ../test-dir; ../build/shell ../build/script > ../build/output 2> /dev/null < /dev/null" );
+      std::string got = filecontents( "output" );
+      EXPECT_EQ( expectedOutput, got );
+   }
+
+   // Runs a script called name from a directory put in front of $PATH, which should print its name.
+   void execute_command_on_path( std::string name ) {
+      std::string directory = "/tmp/shelltest-path", saved_path = getenv( "PATH" );
+
+      mkdir( directory.c_str(), 0700 );
+      filewrite( directory + "/" + name, "#!/bin/sh\necho " + name + "\n" );
+      chmod( ( directory + "/" + name ).c_str(), 0700 );
+      setenv( "PATH", ( directory + ":" + saved_path ).c_str(), 1 );
+      execute( name, name + "\n", "" );
+      setenv( "PATH", saved_path.c_str(), 1 );
+      unlink( ( directory + "/" + name ).c_str() );
+      rmdir( directory.c_str() );
+   }
+
+   std::unique_ptr< shell_state > parsed;                 // Actions live in the state's arena, keep it until the next parse.
 
-      parse_command( input, state );
+   shell_state& parse( std::string input ) {
+      parsed.reset( new shell_state );
+      parse_command( input, *parsed );
+      return *parsed;
+   }
+
+   std::string as_string( const std::pmr::string& text ) {
+      return std::string( text.begin(), text.end() );
+   }
+
+   std::vector< std::string > as_strings( const std::pmr::vector< std::pmr::string >& texts ) {
+      std::vector< std::string > strings;
+      for ( const std::pmr::string& text : texts )
+         strings.push_back( as_string( text ) );
+      return strings;
+   }
+
+   long resident_set_size() {
+      long pages = 0, resident = 0;
+      FILE* statm = fopen( "/proc/self/statm", "r" );
+      if ( statm ) {
+         fscanf( statm, "%ld %ld", &pages, &resident );
+         fclose( statm );
+      }
+      return resident * sysconf( _SC_PAGESIZE );
+   }
+
+   bool try_parse_nop_action( std::string input, NopAction **nop ) {
+      shell_state& state = parse( input );
 
       if ( ( *nop = static_cast< NopAction* >( state.action ) ) ) {
          return true;
@@ -341,9 +941,7 @@ namespace {
    }
 
    bool try_parse_exit_action( std::string input, ExitAction **exit ) {
-      shell_state state;
-
-      parse_command( input, state );
+      shell_state& state = parse( input );
 
       if ( ( *exit = static_cast< ExitAction* >( state.action ) ) ) {
          return true;
@@ -352,9 +950,7 @@ namespace {
    }
 
    bool try_parse_change_directory_action( std::string input, ChangeDirectoryAction **change_directory ) {
-      shell_state state;
-
-      parse_command( input, state );
+      shell_state& state = parse( input );
 
       if ( ( *change_directory = static_cast< ChangeDirectoryAction* >( state.action ) ) ) {
          return true;
@@ -362,10 +958,62 @@ namespace {
       return false;
    }
 
-   bool try_parse_run_commands_action( std::string input, RunCommandsAction **run_commands ) {
-      shell_state state;
+   bool try_parse_hash_action( std::string input, HashAction **hash ) {
+      shell_state& state = parse( input );
+
+      if ( ( *hash = static_cast< HashAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_job_control_action( std::string input, JobControlAction **job_control ) {
+      shell_state& state = parse( input );
+
+      if ( ( *job_control = static_cast< JobControlAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_set_option_action( std::string input, SetOptionAction **set_option ) {
+      shell_state& state = parse( input );
+
+      if ( ( *set_option = static_cast< SetOptionAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_variables_action( std::string input, VariablesAction **variables_action ) {
+      shell_state& state = parse( input );
+
+      if ( ( *variables_action = static_cast< VariablesAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_history_action( std::string input, HistoryAction **history_action ) {
+      shell_state& state = parse( input );
+
+      if ( ( *history_action = static_cast< HistoryAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_parallel_action( std::string input, ParallelAction **parallel ) {
+      shell_state& state = parse( input );
 
-      parse_command( input, state );
+      if ( ( *parallel = static_cast< ParallelAction* >( state.action ) ) ) {
+         return true;
+      } 
+      return false;
+   }
+
+   bool try_parse_run_commands_action( std::string input, RunCommandsAction **run_commands ) {
+      shell_state& state = parse( input );
 
       if ( ( *run_commands = static_cast< RunCommandsAction* >( state.action ) ) ) {
          return true;
@@ -0,0 +1,32 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "server.h"
+
+// shellc SOCKET COMMAND... runs the command line in the shell serving SOCKET (shell --serve SOCKET), with this
+// process's stdin, stdout, stderr and working directory, and exits with its status.
+int main( int argc, char** argv ) {
+    std::string line;
+    int status;
+
+    if ( argc < 3 ) {
+        fprintf( stderr, "usage: shellc SOCKET COMMAND...\n" );
+        return 2;
+    }
+
+    for ( int i = 2; i < argc; ++i ) {
+        if ( i > 2 )
+            line += ' ';
+        line += argv[i];
+    }
+
+    if ( !shell::request( argv[1], line, status ) ) {
+        fprintf( stderr, "shellc: %s: %s\n", argv[1], strerror( errno ) );
+        return 255;
+    }
+
+    return status;
+}
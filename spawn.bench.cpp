@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "shell.h"
+#include "zygote.h"
+
+using namespace shell;
+
+namespace {
+   std::vector< char > ballast;                             // Grows the benchmark's address space, like a long-lived shell.
+   const bool helper_started = zygote().start();            // At startup, the way the shell starts it.
+
+   void grow_address_space( size_t megabytes ) {
+      std::vector< char >().swap( ballast );                 // Shrinks it back too, for the runs without ballast.
+      ballast.resize( megabytes << 20 );
+      memset( ballast.data(), 1, ballast.size() );           // Touch every page so it is really mapped.
+   }
+
+   std::string pipeline_of( int stages ) {
+      std::string line = "true";
+      for ( int i = 1; i < stages; ++i )
+         line += " | true";
+      return line;
+   }
+
+   // Args: number of pipeline stages, megabytes of touched memory in the shell.
+   void spawn_latency( benchmark::State& st, launcher with ) {
+      int stages = st.range( 0 );
+      std::string line = pipeline_of( stages );
+
+      grow_address_space( st.range( 1 ) );
+
+      for ( auto _ : st ) {
+         st.PauseTiming();
+         shell_state state;
+         parse_command( line, state );
+         RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+         run_commands->launch_with = with;
+         run_commands->builtins = false;                    // Real processes, `true` is a builtin otherwise.
+         st.ResumeTiming();
+
+         run_commands->execute();
+      }
+
+      st.counters[ "per_stage" ] = benchmark::Counter( st.iterations() * stages, benchmark::Counter::kIsRate | benchmark::Counter::kInvert );
+   }
+
+   BENCHMARK_CAPTURE( spawn_latency, spawn, launcher::spawn )
+      ->ArgsProduct( { { 1, 4, 16 }, { 0, 256 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+   BENCHMARK_CAPTURE( spawn_latency, fork, launcher::fork )
+      ->ArgsProduct( { { 1, 4, 16 }, { 0, 256 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+   BENCHMARK_CAPTURE( spawn_latency, zygote, launcher::zygote )  // Should stay flat as the ballast grows.
+      ->ArgsProduct( { { 1, 4, 16 }, { 0, 256, 1024 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+}
@@ -0,0 +1,99 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "time_report.h"
+
+namespace shell
+{
+   static double seconds( const struct timeval& t ) noexcept
+   {
+      return t.tv_sec + t.tv_usec / 1e6;
+   }
+
+   // 0m0.003s, the way bash prints its times.
+   static std::string minutes_and_seconds( double t ) noexcept
+   {
+      long long milliseconds = llround( t * 1000 );         // Rounded first, so 59.9996 is 1m0.000s and not 0m60.000s.
+      char text[ 64 ];
+
+      snprintf( text, sizeof( text ), "%lldm%lld.%03llds", milliseconds / 60000, milliseconds % 60000 / 1000, milliseconds % 1000 );
+      return text;
+   }
+
+   static std::string fixed( double t ) noexcept
+   {
+      char text[ 64 ];
+
+      snprintf( text, sizeof( text ), "%.3f", t );
+      return text;
+   }
+
+   static std::string quoted( const std::string& text ) noexcept
+   {
+      std::string result = "\"";
+
+      for ( char c : text ) {
+         if ( c == '"' || c == '\\' )
+            result += '\\';
+         result += c;
+      }
+
+      return result + "\"";
+   }
+
+   void report_time( std::ostream& out, const pipeline_time& times, time_format format ) noexcept
+   {
+      double user = 0, sys = 0;
+
+      for ( const stage_time& stage : times.stages ) {
+         user += seconds( stage.usage.ru_utime );
+         sys += seconds( stage.usage.ru_stime );
+      }
+
+      switch ( format ) {
+         case time_format::posix:
+            out << "real " << fixed( times.real ) << "\n"
+                << "user " << fixed( user ) << "\n"
+                << "sys " << fixed( sys ) << "\n";
+            break;
+
+         case time_format::json:
+            out << "{\"command\":" << quoted( times.command )
+                << ",\"status\":" << times.status
+                << ",\"real\":" << fixed( times.real )
+                << ",\"user\":" << fixed( user )
+                << ",\"sys\":" << fixed( sys )
+                << ",\"stages\":[";
+            for ( size_t i = 0; i < times.stages.size(); ++i ) {
+               const stage_time& stage = times.stages[i];
+               out << ( i ? "," : "" )
+                   << "{\"command\":" << quoted( stage.command )
+                   << ",\"pid\":" << stage.pid
+                   << ",\"status\":" << stage.status
+                   << ",\"user\":" << fixed( seconds( stage.usage.ru_utime ) )
+                   << ",\"sys\":" << fixed( seconds( stage.usage.ru_stime ) )
+                   << ",\"max_rss_kb\":" << stage.usage.ru_maxrss
+                   << ",\"voluntary_switches\":" << stage.usage.ru_nvcsw
+                   << ",\"involuntary_switches\":" << stage.usage.ru_nivcsw
+                   << "}";
+            }
+            out << "]}\n";
+            break;
+
+         default:
+            out << "\n"
+                << "real\t" << minutes_and_seconds( times.real ) << "\n"
+                << "user\t" << minutes_and_seconds( user ) << "\n"
+                << "sys\t" << minutes_and_seconds( sys ) << "\n";
+            for ( const stage_time& stage : times.stages ) {     // Which stage the time went to.
+               out << "\t" << fixed( seconds( stage.usage.ru_utime ) ) << "u "
+                   << fixed( seconds( stage.usage.ru_stime ) ) << "s "
+                   << stage.usage.ru_maxrss << "k "
+                   << stage.usage.ru_nvcsw << "+" << stage.usage.ru_nivcsw << "cs"
+                   << "\t" << stage.command << "\n";
+            }
+      }
+
+      out << std::flush;
+   }
+}
@@ -0,0 +1,38 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace shell
+{
+   enum class time_format
+   {
+      human,                                               // time
+      posix,                                               // time -p
+      json                                                 // time -j, one object per line.
+   };
+
+   struct stage_time
+   {
+      std::string command;
+      pid_t pid = 0;                                       // 0 for a stage the shell ran itself, -1 if it never started.
+      int status = 0;                                      // Exit code.
+      struct rusage usage = {};
+   };
+
+   struct pipeline_time
+   {
+      std::string command;
+      double real = 0;                                     // Seconds, for the whole pipeline.
+      int status = 0;                                      // Exit code.
+      std::vector< stage_time > stages;
+   };
+
+   void report_time( std::ostream& out, const pipeline_time& times, time_format format ) noexcept;
+}
+#endif
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "time_report.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   pipeline_time example();
+
+   TEST( TimeReport, Human ) {
+      std::ostringstream out;
+
+      report_time( out, example(), time_format::human );
+      EXPECT_EQ( "\nreal\t1m2.500s\nuser\t0m1.750s\nsys\t0m0.250s\n"
+                 "\t1.500u 0.000s 2048k 3+1cs\tsort\n"
+                 "\t0.250u 0.250s 1024k 0+0cs\tuniq -c\n", out.str() );
+   }
+
+   TEST( TimeReport, HumanRoundsBeforeSplittingOffMinutes ) {
+      pipeline_time times;
+      std::ostringstream out;
+
+      times.real = 59.9996;
+      times.stages.resize( 1 );
+      times.stages[0].usage.ru_utime = { 119, 999900 };
+      report_time( out, times, time_format::human );
+      EXPECT_EQ( "\nreal\t1m0.000s\nuser\t2m0.000s\nsys\t0m0.000s\n"
+                 "\t120.000u 0.000s 0k 0+0cs\t\n", out.str() );
+   }
+
+   TEST( TimeReport, Posix ) {
+      std::ostringstream out;
+
+      report_time( out, example(), time_format::posix );
+      EXPECT_EQ( "real 62.500\nuser 1.750\nsys 0.250\n", out.str() );
+   }
+
+   TEST( TimeReport, Json ) {
+      std::ostringstream out;
+
+      report_time( out, example(), time_format::json );
+      EXPECT_EQ( "{\"command\":\"sort | uniq -c\",\"status\":1,\"real\":62.500,\"user\":1.750,\"sys\":0.250,\"stages\":["
+                 "{\"command\":\"sort\",\"pid\":100,\"status\":0,\"user\":1.500,\"sys\":0.000,\"max_rss_kb\":2048,\"voluntary_switches\":3,\"involuntary_switches\":1},"
+                 "{\"command\":\"uniq -c\",\"pid\":101,\"status\":1,\"user\":0.250,\"sys\":0.250,\"max_rss_kb\":1024,\"voluntary_switches\":0,\"involuntary_switches\":0}"
+                 "]}\n", out.str() );
+   }
+
+   pipeline_time example() {
+      pipeline_time times;
+
+      times.command = "sort | uniq -c";
+      times.real = 62.5;
+      times.status = 1;
+      times.stages.resize( 2 );
+      times.stages[0].command = "sort";
+      times.stages[0].pid = 100;
+      times.stages[0].usage.ru_utime = { 1, 500000 };
+      times.stages[0].usage.ru_maxrss = 2048;
+      times.stages[0].usage.ru_nvcsw = 3;
+      times.stages[0].usage.ru_nivcsw = 1;
+      times.stages[1].command = "uniq -c";
+      times.stages[1].pid = 101;
+      times.stages[1].status = 1;
+      times.stages[1].usage.ru_utime = { 0, 250000 };
+      times.stages[1].usage.ru_stime = { 0, 250000 };
+      times.stages[1].usage.ru_maxrss = 1024;
+
+      return times;
+   }
+}
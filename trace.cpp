@@ -0,0 +1,163 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "trace.h"
+
+namespace shell
+{
+   Tracer& tracer() noexcept
+   {
+      static Tracer trace;
+      return trace;
+   }
+
+   static double microseconds( std::chrono::steady_clock::time_point t ) noexcept
+   {
+      return std::chrono::duration< double, std::micro >( t.time_since_epoch() ).count();
+   }
+
+   static void append_quoted( std::string& out, std::string_view text ) noexcept
+   {
+      char escaped[ 8 ];
+
+      out += '"';
+      for ( char c : text ) {
+         if ( c == '"' || c == '\\' ) {
+            out += '\\';
+            out += c;
+         }
+         else if ( static_cast< unsigned char >( c ) < 0x20 ) {
+            snprintf( escaped, sizeof( escaped ), "\\u%04x", c );
+            out += escaped;
+         }
+         else {
+            out += c;
+         }
+      }
+      out += '"';
+   }
+
+   Tracer::Tracer() noexcept
+   {
+      const char* path = getenv( "SHELL_TRACE" );
+
+      if ( path && *path )
+         open( path );
+   }
+
+   Tracer::~Tracer() noexcept
+   {
+      close();
+   }
+
+   bool Tracer::open( const char* path ) noexcept
+   {
+      close();
+      if ( ( fd = ::open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR ) ) < 0 )
+         return false;
+
+      shell_pid = getpid();
+      first = true;
+      buffer.reserve( flush_size * 2 );
+      return true;
+   }
+
+   // Ends the JSON array, which viewers also do without when the shell never gets this far.
+   void Tracer::close() noexcept
+   {
+      if ( fd < 0 )
+         return;
+
+      buffer += first ? "[]\n" : "\n]\n";
+      flush();
+      ::close( fd );
+      fd = -1;
+   }
+
+   void Tracer::event( std::string_view text ) noexcept
+   {
+      std::lock_guard< std::mutex > guard( lock );
+
+      buffer += first ? "[\n" : ",\n";
+      buffer += text;
+      first = false;
+
+      if ( buffer.size() >= flush_size )
+         write_buffer();
+   }
+
+   // A span on the track of the calling thread.
+   void Tracer::complete( std::string_view name, std::chrono::steady_clock::time_point start, std::string_view detail ) noexcept
+   {
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      std::string text;
+      char numbers[ 128 ];
+
+      text = "{\"name\":";
+      append_quoted( text, name );
+      snprintf( numbers, sizeof( numbers ), ",\"cat\":\"shell\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                microseconds( start ), microseconds( end ) - microseconds( start ), int( shell_pid ), int( gettid() ) );
+      text += numbers;
+      if ( !detail.empty() ) {
+         text += ",\"args\":{\"detail\":";
+         append_quoted( text, detail );
+         text += "}";
+      }
+      text += "}";
+
+      event( text );
+   }
+
+   // Opens the track of a child, named after its command.
+   void Tracer::process_started( pid_t pid, std::string_view command ) noexcept
+   {
+      std::string text;
+      char numbers[ 128 ];
+
+      text = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string( pid ) + ",\"args\":{\"name\":";
+      append_quoted( text, command );
+      text += "}},\n{\"name\":";
+      append_quoted( text, command );
+      snprintf( numbers, sizeof( numbers ), ",\"cat\":\"stage\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                microseconds( std::chrono::steady_clock::now() ), int( pid ), int( pid ) );
+      text += numbers;
+
+      event( text );
+   }
+
+   void Tracer::process_ended( pid_t pid, int status ) noexcept
+   {
+      char text[ 160 ];
+
+      snprintf( text, sizeof( text ), "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"status\":%d}}",
+                microseconds( std::chrono::steady_clock::now() ), int( pid ), int( pid ),
+                WIFSIGNALED( status ) ? 128 + WTERMSIG( status ) : WEXITSTATUS( status ) );
+
+      event( text );
+   }
+
+   void Tracer::flush() noexcept
+   {
+      std::lock_guard< std::mutex > guard( lock );
+
+      write_buffer();
+   }
+
+   // With the lock held.
+   void Tracer::write_buffer() noexcept
+   {
+      ssize_t written;
+
+      if ( fd < 0 || getpid() != shell_pid )
+         return;                                            // A forked child leaves the buffer to the shell.
+
+      for ( size_t at = 0; at < buffer.size(); at += written ) {
+         if ( ( written = write( fd, buffer.data() + at, buffer.size() - at ) ) <= 0 )
+            break;
+      }
+      buffer.clear();
+   }
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace shell
+{
+   // Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev) of where the shell's time goes, written to the
+   // file named by $SHELL_TRACE. Spans of the shell itself go on the track of the thread that ran them; every
+   // child process gets a track of its own, from the moment it is started until it is reaped.
+   //
+   // Events are collected in memory and written out in large blocks, and at exit. Without $SHELL_TRACE every
+   // hook comes down to one test of enabled().
+   class Tracer
+   {
+   private:
+      int fd = -1;
+      pid_t shell_pid = 0;
+      bool first = true;
+      std::string buffer;
+      std::mutex lock;                                     // Stages served on threads trace too.
+      void event( std::string_view text ) noexcept;
+      void write_buffer() noexcept;
+   public:
+      static const size_t flush_size = 64 * 1024;
+      Tracer() noexcept;
+      ~Tracer() noexcept;
+      Tracer( const Tracer& ) = delete;
+      Tracer& operator=( const Tracer& ) = delete;
+      bool enabled() const noexcept { return fd >= 0; }
+      bool open( const char* path ) noexcept;
+      void close() noexcept;
+      void complete( std::string_view name, std::chrono::steady_clock::time_point start, std::string_view detail ) noexcept;
+      void process_started( pid_t pid, std::string_view command ) noexcept;
+      void process_ended( pid_t pid, int status ) noexcept;
+      void flush() noexcept;
+   };
+
+   Tracer& tracer() noexcept;
+
+   // Records the enclosing scope as one span.
+   class trace_span
+   {
+   private:
+      const char* name;
+      std::string_view detail;                             // Must outlive the span.
+      std::chrono::steady_clock::time_point start;
+      bool on;
+   public:
+      trace_span( const char* name, std::string_view detail = {} ) noexcept
+         : name( name ), detail( detail ), on( tracer().enabled() )
+      {
+         if ( on )
+            start = std::chrono::steady_clock::now();
+      }
+      ~trace_span() noexcept
+      {
+         if ( on )
+            tracer().complete( name, start, detail );
+      }
+      trace_span( const trace_span& ) = delete;
+      trace_span& operator=( const trace_span& ) = delete;
+   };
+}
+#endif
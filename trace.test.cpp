@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "shell.h"
+#include "trace.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   const char* trace_file = "/tmp/shelltest-trace.json";
+
+   std::string read_file( const char* path );
+   size_t count( const std::string& text, const std::string& what );
+
+   TEST( Trace, OffUnlessAsked ) {
+      EXPECT_FALSE( tracer().enabled() );
+   }
+
+   TEST( Trace, SpansAndStageTracks ) {
+      shell_state state;
+
+      ASSERT_TRUE( tracer().open( trace_file ) );
+      parse_command( "ls | head -n 1 | wc -l > /dev/null", state );
+      state.action->execute();
+      tracer().close();
+
+      std::string json = read_file( trace_file );
+      EXPECT_EQ( "[\n", json.substr( 0, 2 ) );
+      EXPECT_EQ( "\n]\n", json.substr( json.size() - 3 ) );
+      EXPECT_EQ( 1u, count( json, "\"name\":\"parse_command\"" ) );
+      EXPECT_EQ( 1u, count( json, "\"name\":\"spawn\"" ) );          // Only ls is a process.
+      EXPECT_EQ( 1u, count( json, "\"name\":\"wait\"" ) );
+      EXPECT_EQ( 1u, count( json, "\"name\":\"head\"" ) );           // The builtins, on their threads.
+      EXPECT_EQ( 1u, count( json, "\"name\":\"wc\"" ) );
+      EXPECT_EQ( 1u, count( json, "\"args\":{\"name\":\"ls\"}" ) ); // The track of the ls process.
+      EXPECT_EQ( 1u, count( json, "\"ph\":\"B\"" ) );
+      EXPECT_EQ( 1u, count( json, "\"ph\":\"E\"" ) );
+      EXPECT_FALSE( tracer().enabled() );
+      unlink( trace_file );
+   }
+
+   TEST( Trace, EscapesDetails ) {
+      ASSERT_TRUE( tracer().open( trace_file ) );
+      { trace_span span( "execute", "echo \"a\\b\"\t" ); }
+      tracer().close();
+
+      EXPECT_EQ( 1u, count( read_file( trace_file ), "\"args\":{\"detail\":\"echo \\\"a\\\\b\\\"\\u0009\"}" ) );
+      unlink( trace_file );
+   }
+
+   //////////////// HELPERS
+
+   std::string read_file( const char* path ) {
+      std::string text;
+      char buffer[ 4096 ];
+      int fd = open( path, O_RDONLY );
+      ssize_t n;
+
+      while ( fd >= 0 && ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+         text.append( buffer, n );
+      if ( fd >= 0 )
+         close( fd );
+      return text;
+   }
+
+   size_t count( const std::string& text, const std::string& what ) {
+      size_t found = 0;
+
+      for ( size_t at = text.find( what ); at != std::string::npos; at = text.find( what, at + 1 ) )
+         found++;
+      return found;
+   }
+}
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "shell.h"
+
+using namespace shell;
+
+namespace {
+   const char* big_file = "/tmp/shellbench-transfer-input";
+   const char* out_file = "/tmp/shellbench-transfer-output";
+
+   void make_big_file( size_t megabytes ) {
+      std::vector< char > block( 1 << 20 );
+      int fd = open( big_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+
+      for ( size_t i = 0; i < block.size(); ++i )
+         block[i] = 'a' + i % 26;
+      for ( size_t i = 0; i < megabytes; ++i )
+         write( fd, block.data(), block.size() );
+      close( fd );
+   }
+
+   // Args: file size in MiB. Compares the shell moving the bytes itself with the external `cat` it replaces.
+   void pass_through( benchmark::State& st, std::string line, bool zero_copy ) {
+      size_t megabytes = st.range( 0 );
+
+      make_big_file( megabytes );
+
+      for ( auto _ : st ) {
+         st.PauseTiming();
+         unlink( out_file );
+         shell_state state;
+         parse_command( line, state );
+         RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+         run_commands->zero_copy = zero_copy;
+         st.ResumeTiming();
+
+         run_commands->execute();
+      }
+
+      st.SetBytesProcessed( st.iterations() * ( megabytes << 20 ) );
+      unlink( out_file );
+      unlink( big_file );
+   }
+
+   const std::string file_to_file = std::string( "cat < " ) + big_file + " > " + out_file;
+   const std::string file_to_pipe = std::string( "cat < " ) + big_file + " | wc -c > /dev/null";
+   const std::string pipe_to_file = std::string( "cat < " ) + big_file + " | cat > " + out_file;
+
+   BENCHMARK_CAPTURE( pass_through, file_to_file_zero_copy, file_to_file, true )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+   BENCHMARK_CAPTURE( pass_through, file_to_file_cat, file_to_file, false )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+   BENCHMARK_CAPTURE( pass_through, file_to_pipe_zero_copy, file_to_pipe, true )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+   BENCHMARK_CAPTURE( pass_through, file_to_pipe_cat, file_to_pipe, false )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+   BENCHMARK_CAPTURE( pass_through, pipe_to_file_zero_copy, pipe_to_file, true )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+   BENCHMARK_CAPTURE( pass_through, pipe_to_file_cat, pipe_to_file, false )->Arg( 1024 )->Arg( 4096 )->UseRealTime()->Unit( benchmark::kMillisecond );
+}
@@ -0,0 +1,111 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "transfer.h"
+
+namespace shell
+{
+   namespace
+   {
+      const size_t chunk_size = 1 << 30;                    // Upper bound per system call, the kernel clamps it anyway.
+
+      // Each of these returns 1 when done, 0 when the mechanism isn't supported for these fds and -1 on error.
+      int copy_range( int in_fd, int out_fd, bool& moved_any ) noexcept
+      {
+         ssize_t n;
+
+         while ( ( n = copy_file_range( in_fd, NULL, out_fd, NULL, chunk_size, 0 ) ) != 0 ) {
+            if ( n < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               if ( !moved_any && ( errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF ) )
+                  return 0;
+               return -1;
+            }
+            moved_any = true;
+         }
+         return 1;
+      }
+
+      int splice_all( int in_fd, int out_fd, bool& moved_any ) noexcept
+      {
+         ssize_t n;
+
+         while ( ( n = splice( in_fd, NULL, out_fd, NULL, chunk_size, SPLICE_F_MOVE | SPLICE_F_MORE ) ) != 0 ) {
+            if ( n < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               if ( !moved_any && ( errno == EINVAL || errno == ENOSYS ) )
+                  return 0;
+               return -1;
+            }
+            moved_any = true;
+         }
+         return 1;
+      }
+
+      int send_all( int in_fd, int out_fd, bool& moved_any ) noexcept
+      {
+         ssize_t n;
+
+         while ( ( n = sendfile( out_fd, in_fd, NULL, chunk_size ) ) != 0 ) {
+            if ( n < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               if ( !moved_any && ( errno == EINVAL || errno == ENOSYS ) )
+                  return 0;
+               return -1;
+            }
+            moved_any = true;
+         }
+         return 1;
+      }
+
+      int copy_through_buffer( int in_fd, int out_fd ) noexcept
+      {
+         char buffer[ 64 * 1024 ];
+         ssize_t n, written;
+
+         while ( ( n = read( in_fd, buffer, sizeof( buffer ) ) ) != 0 ) {
+            if ( n < 0 ) {
+               if ( errno == EINTR )
+                  continue;
+               return -1;
+            }
+            for ( ssize_t offset = 0; offset < n; offset += written ) {
+               if ( ( written = write( out_fd, buffer + offset, n - offset ) ) < 0 ) {
+                  if ( errno != EINTR )
+                     return -1;
+                  written = 0;
+               }
+            }
+         }
+         return 1;
+      }
+   }
+
+   bool transfer( int in_fd, int out_fd ) noexcept
+   {
+      struct stat in_stat, out_stat;
+      bool moved_any = false, appends;
+      int rc = 0, flags;
+
+      if ( fstat( in_fd, &in_stat ) < 0 || fstat( out_fd, &out_stat ) < 0 || ( flags = fcntl( out_fd, F_GETFL ) ) < 0 )
+         return false;
+      appends = flags & O_APPEND;                           // copy_file_range refuses O_APPEND (EBADF), splice and sendfile too (EINVAL).
+
+      if ( S_ISREG( in_stat.st_mode ) && S_ISREG( out_stat.st_mode ) && !appends )
+         rc = copy_range( in_fd, out_fd, moved_any );
+      if ( rc == 0 && ( S_ISFIFO( in_stat.st_mode ) || S_ISFIFO( out_stat.st_mode ) ) )
+         rc = splice_all( in_fd, out_fd, moved_any );
+      if ( rc == 0 && S_ISREG( in_stat.st_mode ) )
+         rc = send_all( in_fd, out_fd, moved_any );
+      if ( rc == 0 )
+         rc = copy_through_buffer( in_fd, out_fd );
+
+      return rc > 0;
+   }
+}
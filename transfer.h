@@ -0,0 +1,10 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+namespace shell
+{
+   // Moves everything readable from in_fd to out_fd, keeping the data inside the kernel where possible
+   // (copy_file_range for file to file, splice when either side is a pipe, sendfile otherwise).
+   bool transfer( int in_fd, int out_fd ) noexcept;
+}
+#endif
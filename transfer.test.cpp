@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "transfer.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   int scratch_file( std::string content );
+   std::string read_all( int fd );
+
+   const std::string payload( 3 * 1024 * 1024 + 17, 'x' );   // Bigger than a pipe, and not a multiple of a page.
+
+   TEST( Transfer, FileToFile ) {
+      int in = scratch_file( payload ), out = scratch_file( "" );
+
+      EXPECT_TRUE( transfer( in, out ) );
+      EXPECT_EQ( payload, read_all( out ) );
+
+      close( in );
+      close( out );
+   }
+
+   TEST( Transfer, FileToPipeToFile ) {
+      int in = scratch_file( payload ), out = scratch_file( "" );
+      int fds[2];
+      bool sent = false, received = false;
+
+      ASSERT_EQ( 0, pipe( fds ) );
+
+      std::thread writer( [&] { sent = transfer( in, fds[1] ); close( fds[1] ); } );
+      received = transfer( fds[0], out );
+      writer.join();
+
+      EXPECT_TRUE( sent );
+      EXPECT_TRUE( received );
+      EXPECT_EQ( payload, read_all( out ) );
+
+      close( fds[0] );
+      close( in );
+      close( out );
+   }
+
+   TEST( Transfer, AppendsToFile ) {
+      int in = scratch_file( payload ), out = scratch_file( "log\n" );
+
+      fcntl( out, F_SETFL, fcntl( out, F_GETFL ) | O_APPEND );
+      EXPECT_TRUE( transfer( in, out ) );
+      EXPECT_EQ( "log\n" + payload, read_all( out ) );
+
+      close( in );
+      close( out );
+   }
+
+
+   //////////////// HELPERS
+
+   int scratch_file( std::string content ) {
+      char name[] = "/tmp/transfer-XXXXXX";
+      int fd = mkstemp( name );
+      unlink( name );
+      write( fd, content.data(), content.size() );
+      lseek( fd, 0, SEEK_SET );
+      return fd;
+   }
+
+   std::string read_all( int fd ) {
+      std::string content;
+      char buffer[4096];
+      ssize_t n;
+
+      lseek( fd, 0, SEEK_SET );
+      while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+         content.append( buffer, n );
+      return content;
+   }
+}
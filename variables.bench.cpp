@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "shell.h"
+#include "variables.h"
+
+using namespace shell;
+
+namespace {
+   // n exported variables of about the size of a real environment's, taken away again when done.
+   struct large_environment
+   {
+      int n;
+      large_environment( int n ) : n( n ) {
+         for ( int i = 0; i < n; ++i ) {
+            std::string name = "SHELLBENCH_" + std::to_string( i );
+            variables().set( name, "/usr/local/lib/some/where/" + std::to_string( i ) );
+            variables().export_name( name );
+         }
+      }
+      ~large_environment() {
+         for ( int i = 0; i < n; ++i )
+            variables().unset( "SHELLBENCH_" + std::to_string( i ) );
+         variables().envp();
+      }
+   };
+
+   // Args: exported variables, and whether one of them changes before every spawn. That is what building
+   // envp for every exec costs, against the block that is built once and reused.
+   void spawn_with_environment( benchmark::State& st ) {
+      large_environment environment( st.range( 0 ) );
+      bool changing = st.range( 1 );
+      int counter = 0;
+
+      for ( auto _ : st ) {
+         st.PauseTiming();
+         shell_state state;
+         parse_command( "true", state );
+         RunCommandsAction *run_commands = static_cast< RunCommandsAction* >( state.action );
+         run_commands->builtins = false;
+         if ( changing )
+            variables().set( "SHELLBENCH_0", std::to_string( counter++ ) );
+         st.ResumeTiming();
+
+         run_commands->execute();
+      }
+   }
+
+   void build_environment( benchmark::State& st ) {
+      large_environment environment( st.range( 0 ) );
+      int counter = 0;
+
+      for ( auto _ : st ) {
+         variables().set( "SHELLBENCH_0", std::to_string( counter++ ) );
+         benchmark::DoNotOptimize( variables().envp() );
+      }
+      st.SetItemsProcessed( st.iterations() * st.range( 0 ) );
+   }
+
+   BENCHMARK( spawn_with_environment )
+      ->ArgsProduct( { { 10, 1000, 5000 }, { 0, 1 } } )
+      ->UseRealTime()
+      ->Unit( benchmark::kMicrosecond );
+   BENCHMARK( build_environment )->Arg( 10 )->Arg( 1000 )->Arg( 5000 )->Unit( benchmark::kMicrosecond );
+}
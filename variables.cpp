@@ -0,0 +1,180 @@
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "variables.h"
+
+namespace shell
+{
+   Variables& variables() noexcept
+   {
+      static Variables table;
+      return table;
+   }
+
+   Variables::Variables() noexcept
+   {
+      for ( char** entry = environ; entry && *entry; ++entry ) {
+         const char* equals = strchr( *entry, '=' );
+         if ( equals != nullptr )
+            values[ std::string( *entry, equals - *entry ) ] = { equals + 1, true };
+      }
+   }
+
+   bool Variables::is_name( std::string_view name ) noexcept
+   {
+      if ( name.empty() || !( isalpha( (unsigned char)name[0] ) || name[0] == '_' ) )
+         return false;
+      return std::all_of( name.begin(), name.end(), []( char c ) { return isalnum( (unsigned char)c ) || c == '_'; } );
+   }
+
+   const std::string* Variables::get( std::string_view name ) const noexcept
+   {
+      std::unordered_map< std::string, variable >::const_iterator found = values.find( std::string( name ) );
+
+      return found == values.end() ? nullptr : &found->second.value;
+   }
+
+   bool Variables::is_exported( std::string_view name ) const noexcept
+   {
+      std::unordered_map< std::string, variable >::const_iterator found = values.find( std::string( name ) );
+
+      return found != values.end() && found->second.exported;
+   }
+
+   void Variables::set( std::string_view name, std::string_view value ) noexcept
+   {
+      variable& v = values[ std::string( name ) ];
+
+      v.value = value;
+      stale |= v.exported;
+   }
+
+   // An exported name that was never set is exported empty.
+   void Variables::export_name( std::string_view name ) noexcept
+   {
+      variable& v = values[ std::string( name ) ];
+
+      stale |= !v.exported;
+      v.exported = true;
+   }
+
+   void Variables::unset( std::string_view name ) noexcept
+   {
+      std::unordered_map< std::string, variable >::iterator found = values.find( std::string( name ) );
+
+      if ( found == values.end() )
+         return;
+      stale |= found->second.exported;
+      values.erase( found );
+   }
+
+   // export without names, sorted like bash's `export -p`.
+   void Variables::print_exported( std::ostream& out ) const noexcept
+   {
+      std::vector< std::pair< std::string_view, std::string_view > > exported;
+
+      for ( const auto& [ name, v ] : values ) {
+         if ( v.exported )
+            exported.emplace_back( name, v.value );
+      }
+      std::sort( exported.begin(), exported.end() );
+      for ( const auto& [ name, value ] : exported )
+         out << "export " << name << "=" << value << "\n";
+   }
+
+   char** Variables::envp() noexcept
+   {
+      if ( !stale && !current )
+         return environ;                                    // Nothing changed since the shell started.
+      return const_cast< char** >( environment()->pointers.data() );
+   }
+
+   std::shared_ptr< const environment_block > Variables::environment() noexcept
+   {
+      if ( stale || !current )
+         rebuild();
+      return current;
+   }
+
+   // Two passes, so the text never moves under the pointers.
+   void Variables::rebuild() noexcept
+   {
+      std::shared_ptr< environment_block > block = std::make_shared< environment_block >();
+      size_t size = 0, count = 0, at = 0;
+
+      for ( const auto& [ name, v ] : values ) {
+         if ( v.exported ) {
+            size += name.size() + v.value.size() + 2;
+            ++count;
+         }
+      }
+
+      block->text.resize( size );
+      block->pointers.reserve( count + 1 );
+      for ( const auto& [ name, v ] : values ) {
+         if ( !v.exported )
+            continue;
+         block->pointers.push_back( block->text.data() + at );
+         memcpy( block->text.data() + at, name.data(), name.size() );
+         at += name.size();
+         block->text[ at++ ] = '=';
+         memcpy( block->text.data() + at, v.value.c_str(), v.value.size() + 1 );
+         at += v.value.size() + 1;
+      }
+      block->pointers.push_back( nullptr );
+
+      environ = block->pointers.data();
+      current = std::move( block );
+      stale = false;
+      ++rebuilds;
+   }
+
+   bool Variables::expand( std::string_view word, int status, std::string& expanded ) const noexcept
+   {
+      const std::string* value;
+      size_t at = 0, dollar, end;
+      bool any = false;
+
+      expanded.clear();
+      while ( ( dollar = word.find( '$', at ) ) != std::string_view::npos ) {
+         expanded.append( word.substr( at, dollar - at ) );
+         at = dollar + 1;
+
+         if ( at < word.size() && word[ at ] == '?' ) {
+            expanded += std::to_string( status );
+            at++;
+            any = true;
+            continue;
+         }
+
+         if ( at < word.size() && word[ at ] == '{' ) {
+            end = word.find( '}', at );
+            if ( end != std::string_view::npos && is_name( word.substr( at + 1, end - at - 1 ) ) ) {
+               if ( ( value = get( word.substr( at + 1, end - at - 1 ) ) ) )
+                  expanded += *value;
+               at = end + 1;
+               any = true;
+               continue;
+            }
+         }
+         else if ( at < word.size() && ( isalpha( (unsigned char)word[ at ] ) || word[ at ] == '_' ) ) {
+            for ( end = at; end < word.size() && ( isalnum( (unsigned char)word[ end ] ) || word[ end ] == '_' ); ++end )
+               ;
+            if ( ( value = get( word.substr( at, end - at ) ) ) )
+               expanded += *value;
+            at = end;
+            any = true;
+            continue;
+         }
+
+         expanded += '$';                                   // Starts nothing, so it stays.
+      }
+      expanded.append( word.substr( at ) );
+
+      return any;
+   }
+}
@@ -0,0 +1,61 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace shell
+{
+   // The exported variables as execve(2) wants them: every NAME=value in one block, and the pointers to them.
+   struct environment_block
+   {
+      std::vector< char > text;
+      std::vector< char* > pointers;                       // NULL terminated, into text.
+   };
+
+   // Shell variables, and which of them are exported; the environment the shell started with is where they
+   // start out.
+   //
+   // The exported ones are handed to every exec as one contiguous envp block, which is built once after they
+   // change rather than for every process started, so a spawn costs the same with thousands of variables as
+   // with a few. A block never changes once built. A change makes a new one, and whoever still holds the old
+   // one (a plan that is running) keeps it alive. environ points at the current block, so getenv(3) in the
+   // shell agrees with what its children get.
+   class Variables
+   {
+   private:
+      struct variable
+      {
+         std::string value;
+         bool exported = false;
+      };
+      std::unordered_map< std::string, variable > values;
+      std::shared_ptr< const environment_block > current;  // Empty until the first change: environ is still the one we got.
+      bool stale = false;                                  // An exported variable changed since current was built.
+      unsigned rebuilds = 0;
+      void rebuild() noexcept;
+   public:
+      Variables() noexcept;
+      Variables( const Variables& ) = delete;
+      Variables& operator=( const Variables& ) = delete;
+      static bool is_name( std::string_view name ) noexcept;
+      const std::string* get( std::string_view name ) const noexcept;
+      bool is_exported( std::string_view name ) const noexcept;
+      void set( std::string_view name, std::string_view value ) noexcept;
+      void export_name( std::string_view name ) noexcept;
+      void unset( std::string_view name ) noexcept;
+      void print_exported( std::ostream& out ) const noexcept;
+      char** envp() noexcept;
+      std::shared_ptr< const environment_block > environment() noexcept;
+      unsigned generation() const noexcept { return rebuilds; }
+      // $NAME and ${NAME}, with $? for status; names that aren't set expand to nothing.
+      bool expand( std::string_view word, int status, std::string& expanded ) const noexcept;
+   };
+
+   Variables& variables() noexcept;
+}
+#endif
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <sstream>
+#include <string>
+
+#include "variables.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   std::string expand( const Variables& table, std::string_view word, int status = 0 ) {
+      std::string expanded;
+      table.expand( word, status, expanded );
+      return expanded;
+   }
+
+   std::string find( char** envp, const char* name ) {
+      size_t length = strlen( name );
+
+      for ( ; *envp; ++envp ) {
+         if ( strncmp( *envp, name, length ) == 0 && ( *envp )[ length ] == '=' )
+            return *envp + length + 1;
+      }
+      return "(none)";
+   }
+
+   TEST( Variables, StartsWithTheEnvironment ) {
+      Variables table;
+
+      ASSERT_NE( nullptr, getenv( "PATH" ) );
+      ASSERT_NE( nullptr, table.get( "PATH" ) );
+      EXPECT_EQ( getenv( "PATH" ), *table.get( "PATH" ) );
+      EXPECT_TRUE( table.is_exported( "PATH" ) );
+      EXPECT_EQ( environ, table.envp() );                   // Nothing changed, nothing built.
+   }
+
+   TEST( Variables, BuildsTheEnvironmentOncePerChange ) {
+      char** saved = environ;
+      Variables table;
+      char** envp;
+
+      table.set( "SHELLTEST_LOCAL", "1" );
+      EXPECT_EQ( environ, table.envp() );                   // Not exported.
+
+      table.set( "SHELLTEST_EXPORTED", "2" );
+      table.export_name( "SHELLTEST_EXPORTED" );
+      envp = table.envp();
+      EXPECT_EQ( 1u, table.generation() );
+      EXPECT_EQ( envp, table.envp() );
+      EXPECT_EQ( envp, environ );                           // getenv(3) sees it too.
+      EXPECT_STREQ( "2", getenv( "SHELLTEST_EXPORTED" ) );
+      EXPECT_EQ( "2", find( envp, "SHELLTEST_EXPORTED" ) );
+      EXPECT_EQ( "(none)", find( envp, "SHELLTEST_LOCAL" ) );
+
+      std::shared_ptr< const environment_block > held = table.environment();
+      table.set( "SHELLTEST_EXPORTED", "3" );
+      table.set( "SHELLTEST_LOCAL", "4" );
+      EXPECT_EQ( "3", find( table.envp(), "SHELLTEST_EXPORTED" ) );
+      EXPECT_EQ( 2u, table.generation() );
+      EXPECT_EQ( "2", find( const_cast< char** >( held->pointers.data() ), "SHELLTEST_EXPORTED" ) );  // The old block is left alone.
+
+      table.unset( "SHELLTEST_EXPORTED" );
+      EXPECT_EQ( "(none)", find( table.envp(), "SHELLTEST_EXPORTED" ) );
+      EXPECT_EQ( nullptr, table.get( "SHELLTEST_EXPORTED" ) );
+      environ = saved;
+   }
+
+   TEST( Variables, Expand ) {
+      Variables table;
+      std::string expanded;
+
+      table.set( "A", "x" );
+      table.set( "LONG_NAME_2", "y" );
+      EXPECT_EQ( "x", expand( table, "$A" ) );
+      EXPECT_EQ( "x.y", expand( table, "$A.$LONG_NAME_2" ) );
+      EXPECT_EQ( "xb", expand( table, "${A}b" ) );
+      EXPECT_EQ( "", expand( table, "$Ab" ) );               // There is no Ab.
+      EXPECT_EQ( "7", expand( table, "$?", 7 ) );
+      EXPECT_EQ( "$ $1 ${} a$", expand( table, "$ $1 ${} a$" ) );
+      EXPECT_FALSE( table.expand( "plain", 0, expanded ) );
+      EXPECT_TRUE( table.expand( "$NOT_SET_ANYWHERE", 0, expanded ) );
+      EXPECT_EQ( "", expanded );
+   }
+
+   TEST( Variables, PrintExported ) {
+      char** saved = environ;
+      Variables table;
+      std::ostringstream out;
+
+      table.set( "SHELLTEST_B", "2" );
+      table.export_name( "SHELLTEST_B" );
+      table.export_name( "SHELLTEST_A" );
+      table.print_exported( out );
+      EXPECT_NE( std::string::npos, out.str().find( "export SHELLTEST_A=\nexport SHELLTEST_B=2\n" ) );
+      environ = saved;
+   }
+
+   TEST( Variables, IsName ) {
+      EXPECT_TRUE( Variables::is_name( "_a1" ) );
+      EXPECT_FALSE( Variables::is_name( "1a" ) );
+      EXPECT_FALSE( Variables::is_name( "" ) );
+      EXPECT_FALSE( Variables::is_name( "a-b" ) );
+   }
+}
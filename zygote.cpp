@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "zygote.h"
+#include "job_table.h"
+
+namespace shell
+{
+   namespace
+   {
+      const int passed_fds = 4;                            // stdin, stdout, stderr and the working directory.
+
+      struct request_header
+      {
+         pid_t pgid;                                       // As for JobTable::prepare_child().
+         int foreground;
+         uint32_t argc, envc;                              // The path, then argv and envp, each string NUL terminated.
+      };
+
+      struct answer
+      {
+         pid_t pid;
+         int error;                                        // errno of a failed exec, 0 when it went through.
+      };
+
+      void reply( int channel, pid_t pid, int error ) noexcept
+      {
+         answer a = { pid, error };
+
+         while ( write( channel, &a, sizeof( a ) ) < 0 && errno == EINTR )
+            ;
+      }
+
+      // Collects count NUL terminated strings from text, false if they run past its end.
+      bool split_strings( const char*& text, const char* end, uint32_t count, std::vector< char* >& strings ) noexcept
+      {
+         strings.clear();
+         for ( uint32_t i = 0; i < count; ++i ) {
+            const char* nul = static_cast< const char* >( memchr( text, '\0', end - text ) );
+            if ( nul == nullptr )
+               return false;
+            strings.push_back( const_cast< char* >( text ) );
+            text = nul + 1;
+         }
+         strings.push_back( nullptr );
+         return true;
+      }
+
+      // The new process, between clone and exec, so only async-signal-safe calls.
+      void start_child( const request_header& header, const char* path, char** argv, char** envp, const int fds[], int errors ) noexcept
+      {
+         int error;
+
+         job_table().prepare_child( header.pgid, header.foreground );
+         for ( int i = 0; i < 3; ++i )
+            dup2( fds[i], i );                              // Received with MSG_CMSG_CLOEXEC, the copies aren't.
+         fchdir( fds[3] );
+         execve( path, argv, envp );
+
+         error = errno;
+         write( errors, &error, sizeof( error ) );
+         _exit( 127 );
+      }
+
+      // The helper's side; never returns.
+      [[noreturn]] void serve_requests( int channel ) noexcept
+      {
+         std::vector< char > buffer( sizeof( request_header ) + Zygote::request_limit );
+         std::vector< char* > argv, envp;
+         char control[ CMSG_SPACE( passed_fds * sizeof( int ) ) ];
+         struct iovec data = { buffer.data(), buffer.size() };
+         struct msghdr message = {};
+         struct cmsghdr* cmsg;
+         request_header header;
+         const char *text, *end, *path;
+         int fds[ passed_fds ], errors[2], error;
+         ssize_t n;
+         pid_t pid;
+
+         job_table();                                       // Set up once here, rather than in every child.
+
+         for ( ;; ) {
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof( control );
+            if ( ( n = recvmsg( channel, &message, MSG_CMSG_CLOEXEC ) ) <= 0 ) {
+               if ( n < 0 && errno == EINTR )
+                  continue;
+               _exit( 0 );                                  // The shell is gone.
+            }
+
+            cmsg = CMSG_FIRSTHDR( &message );
+            if ( cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN( sizeof( fds ) ) ) {
+               reply( channel, -1, EINVAL );
+               continue;
+            }
+            memcpy( fds, CMSG_DATA( cmsg ), sizeof( fds ) );
+
+            text = buffer.data() + sizeof( header );
+            end = buffer.data() + n;
+            memcpy( &header, buffer.data(), sizeof( header ) );
+            path = text;
+            if ( ( message.msg_flags & ( MSG_TRUNC | MSG_CTRUNC ) ) || (size_t)n <= sizeof( header )
+                 || ( text = static_cast< const char* >( memchr( text, '\0', end - text ) ) ) == nullptr
+                 || !split_strings( ++text, end, header.argc, argv ) || !split_strings( text, end, header.envc, envp ) ) {
+               reply( channel, -1, EINVAL );
+            }
+            else if ( pipe2( errors, O_CLOEXEC ) < 0 ) {
+               reply( channel, -1, errno );
+            }
+            else {
+               // A child of the shell, not of this helper. Nothing runs in it but exec, so the raw syscall will do.
+               if ( ( pid = syscall( SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0 ) ) == 0 )
+                  start_child( header, path, argv.data(), envp.data(), fds, errors[1] );
+
+               error = pid < 0 ? errno : 0;
+               close( errors[1] );
+               if ( pid > 0 ) {
+                  while ( ( n = read( errors[0], &error, sizeof( error ) ) ) < 0 && errno == EINTR )
+                     ;
+                  if ( n != sizeof( error ) )
+                     error = 0;                             // Closed on exec.
+               }
+               close( errors[0] );
+               reply( channel, pid, error );
+            }
+
+            for ( int fd : fds )
+               close( fd );
+         }
+      }
+   }
+
+   Zygote& zygote() noexcept
+   {
+      static Zygote helper;
+      return helper;
+   }
+
+   Zygote::Zygote() noexcept
+   {
+   }
+
+   Zygote::~Zygote() noexcept
+   {
+      stop();
+   }
+
+   bool Zygote::start() noexcept
+   {
+      int fds[2];
+
+      if ( running() )
+         return true;
+      if ( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds ) < 0 )
+         return false;
+
+      if ( ( helper = fork() ) < 0 ) {
+         close( fds[0] );
+         close( fds[1] );
+         return false;
+      }
+      if ( helper == 0 ) {
+         close( fds[0] );
+         serve_requests( fds[1] );
+      }
+
+      close( fds[1] );
+      channel = fds[0];
+      return true;
+   }
+
+   void Zygote::stop() noexcept
+   {
+      if ( !running() )
+         return;
+
+      close( channel );                                     // The helper exits when it reads the end of the channel.
+      channel = -1;
+      waitpid( helper, NULL, 0 );
+      helper = -1;
+   }
+
+   bool Zygote::spawn( const char* path, char* const argv[], char* const envp[], int in_fd, int out_fd, pid_t pgid, bool foreground, pid_t& pid, int& error ) noexcept
+   {
+      request_header header = { pgid, foreground, 0, 0 };
+      int fds[ passed_fds ] = { in_fd >= 0 ? in_fd : STDIN_FILENO, out_fd >= 0 ? out_fd : STDOUT_FILENO, STDERR_FILENO, -1 };
+      char control[ CMSG_SPACE( sizeof( fds ) ) ] = {};
+      struct iovec data;
+      struct msghdr packet = {};
+      struct cmsghdr* cmsg;
+      answer a;
+      ssize_t n;
+
+      if ( !running() )
+         return false;
+
+      message.assign( sizeof( header ), '\0' );
+      message.append( path, strlen( path ) + 1 );
+      for ( ; argv[ header.argc ]; ++header.argc )
+         message.append( argv[ header.argc ], strlen( argv[ header.argc ] ) + 1 );
+      for ( ; envp[ header.envc ]; ++header.envc )
+         message.append( envp[ header.envc ], strlen( envp[ header.envc ] ) + 1 );
+      if ( message.size() > sizeof( header ) + request_limit )
+         return false;
+      memcpy( message.data(), &header, sizeof( header ) );
+
+      if ( ( fds[3] = open( ".", O_PATH | O_DIRECTORY | O_CLOEXEC ) ) < 0 )
+         return false;                                      // A directory that is gone, which an ordinary spawn copes with.
+
+      data = { message.data(), message.size() };
+      packet.msg_iov = &data;
+      packet.msg_iovlen = 1;
+      packet.msg_control = control;
+      packet.msg_controllen = sizeof( control );
+      cmsg = CMSG_FIRSTHDR( &packet );
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+      memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ) );
+
+      while ( ( n = sendmsg( channel, &packet, MSG_NOSIGNAL ) ) < 0 && errno == EINTR )
+         ;
+      close( fds[3] );
+      if ( n < 0 ) {
+         if ( errno == EPIPE || errno == ECONNRESET )
+            stop();                                         // The helper died, everything is spawned directly from now on.
+         return false;                                      // A closed stdio fd, or a message the socket won't take.
+      }
+
+      while ( ( n = read( channel, &a, sizeof( a ) ) ) < 0 && errno == EINTR )
+         ;
+      if ( n != sizeof( a ) ) {
+         stop();
+         return false;
+      }
+      if ( a.pid < 0 )
+         return false;                                      // Couldn't clone, let the caller try.
+
+      pid = a.pid;
+      error = a.error;
+      return true;
+   }
+}
@@ -0,0 +1,39 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <sys/types.h>
+
+#include <string>
+
+namespace shell
+{
+   // A helper process forked while the shell is still small, which starts processes on the shell's behalf, so
+   // what a spawn costs doesn't grow with the shell's address space, its history and its caches.
+   //
+   // The shell sends one SOCK_SEQPACKET message per process: the path, argv and environment, with stdin,
+   // stdout, stderr and the working directory as SCM_RIGHTS. The helper starts the process with
+   // clone( CLONE_PARENT ), which makes it a child of the shell rather than of the helper, so the shell waits
+   // for it, puts it in a process group and gets its SIGCHLD exactly as if it had started it itself. The
+   // answer is the pid, and the exec error, if there was one, in which case the shell still reaps the pid.
+   class Zygote
+   {
+   private:
+      int channel = -1;
+      pid_t helper = -1;
+      std::string message;                                 // Reused between requests.
+   public:
+      static const size_t request_limit = 128 * 1024;      // Larger requests are left to the caller.
+      Zygote() noexcept;
+      ~Zygote() noexcept;
+      Zygote( const Zygote& ) = delete;
+      Zygote& operator=( const Zygote& ) = delete;
+      bool start() noexcept;
+      void stop() noexcept;
+      bool running() const noexcept { return channel >= 0; }
+      // False when the helper can't take the request, and the caller should start the process itself.
+      bool spawn( const char* path, char* const argv[], char* const envp[], int in_fd, int out_fd, pid_t pgid, bool foreground, pid_t& pid, int& error ) noexcept;
+   };
+
+   Zygote& zygote() noexcept;
+}
+#endif
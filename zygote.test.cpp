@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "zygote.h"
+
+using namespace std;
+using namespace shell;
+
+namespace {
+   std::string run( Zygote& helper, std::vector< const char* > args, std::vector< const char* > env, int& status );
+
+   TEST( Zygote, StartsChildrenOfTheCaller ) {
+      Zygote helper;
+      int status;
+
+      ASSERT_TRUE( helper.start() );
+      EXPECT_EQ( "hello\n", run( helper, { "/bin/echo", "hello" }, {}, status ) );
+      EXPECT_EQ( W_EXITCODE( 0, 0 ), status );              // Reaped right here, so it was ours.
+      run( helper, { "/bin/sh", "-c", "exit 3" }, {}, status );
+      EXPECT_EQ( W_EXITCODE( 3, 0 ), status );
+   }
+
+   TEST( Zygote, RunsInTheCallersDirectoryWithTheGivenEnvironment ) {
+      Zygote helper;
+      char saved[ 4096 ];
+      int status;
+
+      ASSERT_TRUE( helper.start() );                        // Started in one directory, used from another.
+      ASSERT_NE( nullptr, getcwd( saved, sizeof( saved ) ) );
+      ASSERT_EQ( 0, chdir( "/tmp" ) );
+      EXPECT_EQ( "/tmp\n", run( helper, { "/bin/sh", "-c", "pwd" }, {}, status ) );
+      EXPECT_EQ( "yes\n", run( helper, { "/bin/sh", "-c", "echo $ZYGOTE_TEST" }, { "ZYGOTE_TEST=yes" }, status ) );
+      ASSERT_EQ( 0, chdir( saved ) );
+   }
+
+   TEST( Zygote, ReportsExecErrors ) {
+      Zygote helper;
+      const char* argv[] = { "program-that-doesnt-exist", nullptr };
+      const char* envp[] = { nullptr };
+      pid_t pid = 0;
+      int error = 0, status;
+
+      ASSERT_TRUE( helper.start() );
+      ASSERT_TRUE( helper.spawn( "/no/such/program", const_cast< char** >( argv ), const_cast< char** >( envp ), -1, -1, -1, false, pid, error ) );
+      EXPECT_EQ( ENOENT, error );
+      EXPECT_EQ( pid, waitpid( pid, &status, 0 ) );         // Still a child to reap.
+   }
+
+   TEST( Zygote, LeavesItToTheCallerWhenStopped ) {
+      Zygote helper;
+      const char* argv[] = { "true", nullptr };
+      const char* envp[] = { nullptr };
+      pid_t pid = 0;
+      int error = 0;
+
+      ASSERT_TRUE( helper.start() );
+      helper.stop();
+      EXPECT_FALSE( helper.running() );
+      EXPECT_FALSE( helper.spawn( "/bin/true", const_cast< char** >( argv ), const_cast< char** >( envp ), -1, -1, -1, false, pid, error ) );
+   }
+
+   //////////////// HELPERS
+
+   // Runs the command through the helper with its stdout on a pipe, and gives back what it wrote.
+   std::string run( Zygote& helper, std::vector< const char* > args, std::vector< const char* > env, int& status ) {
+      std::string output;
+      char buffer[ 256 ];
+      int fds[2], error = 0;
+      pid_t pid = -1;
+      ssize_t n;
+
+      args.push_back( nullptr );
+      env.push_back( nullptr );
+      status = -1;
+      if ( pipe2( fds, O_CLOEXEC ) < 0 )
+         return output;
+      if ( helper.spawn( args[0], const_cast< char** >( args.data() ), const_cast< char** >( env.data() ), -1, fds[1], -1, false, pid, error ) && error == 0 ) {
+         close( fds[1] );
+         while ( ( n = read( fds[0], buffer, sizeof( buffer ) ) ) > 0 )
+            output.append( buffer, n );
+         waitpid( pid, &status, 0 );
+      }
+      else {
+         close( fds[1] );
+      }
+      close( fds[0] );
+      return output;
+   }
+}